@@ -0,0 +1,214 @@
+//
+//  Adaptive slice render benchmark
+//
+//  Renders X, Y and Z slices of the provided geometries with the exact tiled
+//  path and with the adaptive path, reporting the number of geometry queries,
+//  render times and the number of pixels which differ between both. When a
+//  camera is provided, an orthographic 3D view is compared too, where the
+//  queries are the traced rays.
+//
+//  Usage:
+//
+//    GeometryViewerAdaptiveBench [options] geometries...
+//
+//  where each geometry is specified as
+//
+//    --config  file   PenRed geometry configuration file
+//    --quadric file   quadric geometry file
+//    --mesh    file   triangular mesh geometry file
+//
+//  and the available options are
+//
+//    --size   width height   Image resolution in pixels (default 2000 2000)
+//    --pixel  size           Pixel size in cm (default 0.01)
+//    --center x y z          Slices center in cm (default 0 0 0)
+//    --repeat n              Renders per slice and path (default 3)
+//    --camera x y z          Orthographic 3D view from (x,y,z) looking at the
+//                            center (default none)
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <QCoreApplication>
+#include <QLibrary>
+
+#include "pen_geoViewInterface.hh"
+#include "slicerender.h"
+#include "camerarender.h"
+#include "geometryconfig.h"
+
+typedef pen_geoViewInterface* (*viewerConstructor)();
+typedef void (*viewerDestructor)(pen_geoViewInterface*);
+
+struct benchGeometry{
+    std::string type; //config, quadric or mesh
+    std::string file;
+};
+
+static double renderTime(const renderRequest& request, renderFrame& frame,
+                         const bool exact, renderStats& stats){
+
+    const auto start = std::chrono::steady_clock::now();
+    if(request.perspective == 3){
+        if(exact){
+            cameraRenderer::renderOrthoTiles(request, request.width3D, request.height3D,
+                                             request.pixelSize3D, frame, cancelToken());
+            stats.queries += frame.nPixels();
+        }else{
+            cameraRenderer::renderOrthoAdaptive(request, frame, cancelToken(), &stats);
+        }
+    }else if(exact)
+        sliceRenderer::renderTiles(request, frame, cancelToken(), &stats);
+    else
+        sliceRenderer::renderAdaptive(request, frame, cancelToken(), &stats);
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    unsigned width = 2000, height = 2000;
+    double pixelSize = 0.01;
+    double center[3] = {0.0, 0.0, 0.0};
+    unsigned repeat = 3;
+    bool view3D = false;
+    double camera[3] = {0.0, 0.0, 0.0};
+    std::vector<benchGeometry> geometries;
+
+    for(int i = 1; i < argc; ++i){
+        const std::string arg(argv[i]);
+        if((arg == "--config" || arg == "--quadric" || arg == "--mesh") && i+1 < argc){
+            geometries.push_back(benchGeometry{arg.substr(2), argv[++i]});
+        }else if(arg == "--size" && i+2 < argc){
+            width = static_cast<unsigned>(std::atoi(argv[++i]));
+            height = static_cast<unsigned>(std::atoi(argv[++i]));
+        }else if(arg == "--pixel" && i+1 < argc){
+            pixelSize = std::atof(argv[++i]);
+        }else if(arg == "--center" && i+3 < argc){
+            center[0] = std::atof(argv[++i]);
+            center[1] = std::atof(argv[++i]);
+            center[2] = std::atof(argv[++i]);
+        }else if(arg == "--camera" && i+3 < argc){
+            view3D = true;
+            camera[0] = std::atof(argv[++i]);
+            camera[1] = std::atof(argv[++i]);
+            camera[2] = std::atof(argv[++i]);
+        }else if(arg == "--repeat" && i+1 < argc){
+            repeat = std::max(1, std::atoi(argv[++i]));
+        }else{
+            printf("Unknown or incomplete argument '%s'\n", arg.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(geometries.empty()){
+        printf("usage: %s [--size width height] [--pixel size] [--center x y z] [--repeat n]\n"
+               "       [--camera x y z]\n"
+               "       (--config file | --quadric file | --mesh file)...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    //Load the geometry library as the main window does
+    QLibrary viewerLib(QCoreApplication::applicationDirPath() + "/libgeoView_C");
+    if(!viewerLib.load()){
+        printf("Unable to load geometry library: %s\n", viewerLib.errorString().toStdString().c_str());
+        return EXIT_FAILURE;
+    }
+    viewerConstructor constructViewer = (viewerConstructor) viewerLib.resolve("pen_geoView_new");
+    viewerDestructor destroyViewer = (viewerDestructor) viewerLib.resolve("pen_geoView_delete");
+    if(!constructViewer || !destroyViewer){
+        printf("Unable to load the viewer constructor and destructor functions\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("# Resolution %u x %u, pixel size %.4e cm, %u threads\n",
+           width, height, pixelSize, tileScheduler::instance().readThreads());
+    printf("# %-8s %-40s %10s %10s %8s %10s %10s %10s\n",
+           "view", "geometry", "exact(q)", "adapt(q)", "saved", "exact(ms)", "adapt(ms)", "diff(px)");
+
+    const char* perspectiveNames[4] = {"X", "Y", "Z", "3D ortho"};
+
+    for(const benchGeometry& geometry : geometries){
+
+        pen_geoViewInterface* penRedViewer = constructViewer();
+        const std::string configFile = geometryConfig::prepare(geometry.type, geometry.file, "Bench");
+        if(configFile.empty() || penRedViewer->init(configFile.c_str(), 0) != 0){
+            printf("Error loading geometry '%s'\n", geometry.file.c_str());
+            destroyViewer(penRedViewer);
+            continue;
+        }
+
+        const unsigned nViews = view3D ? 4 : 3;
+        for(unsigned perspective = 0; perspective < nViews; ++perspective){
+
+            renderRequest request;
+            request.pPenRedViewer = penRedViewer;
+            request.perspective = perspective;
+            request.x = center[0];
+            request.y = center[1];
+            request.z = center[2];
+            request.pixelSize = pixelSize;
+            request.width = width;
+            request.height = height;
+            request.labelBytes = labelImage::bytesFor(penRedViewer->getBodies());
+            if(perspective == 3){
+                request.ortho3D = true;
+                request.width3D = width;
+                request.height3D = height;
+                request.pixelSize3D = pixelSize;
+                request.camera3DX = camera[0];
+                request.camera3DY = camera[1];
+                request.camera3DZ = camera[2];
+                request.u = center[0] - camera[0];
+                request.v = center[1] - camera[1];
+                request.w = center[2] - camera[2];
+                request.omega = -1.5707963267948966;
+            }
+
+            //3D frames are sized by the renders
+            renderFrame exactFrame, adaptiveFrame;
+            for(renderFrame* frame : {&exactFrame, &adaptiveFrame}){
+                frame->request = request;
+                frame->width = width;
+                frame->height = height;
+                frame->matImage.resize(frame->nPixels());
+                frame->bodyImage.resize(frame->nPixels(), request.labelBytes);
+            }
+
+            double exactTime = 0.0, adaptiveTime = 0.0;
+            renderStats exactStats, adaptiveStats;
+            for(unsigned irep = 0; irep < repeat; ++irep){
+                exactTime += renderTime(request, exactFrame, true, exactStats);
+                adaptiveTime += renderTime(request, adaptiveFrame, false, adaptiveStats);
+            }
+
+            size_t differences = 0;
+            for(size_t i = 0; i < exactFrame.nPixels(); ++i){
+                if(exactFrame.bodyImage[i] != adaptiveFrame.bodyImage[i] ||
+                   exactFrame.matImage[i] != adaptiveFrame.matImage[i])
+                    ++differences;
+            }
+
+            const double exactQueries = static_cast<double>(exactStats.queries)/repeat;
+            const double adaptiveQueries = static_cast<double>(adaptiveStats.queries)/repeat;
+            printf("  %-8s %-40s %10.0f %10.0f %7.2f%% %10.2f %10.2f %10lu\n",
+                   perspectiveNames[perspective], geometry.file.c_str(),
+                   exactQueries, adaptiveQueries,
+                   100.0*(1.0 - adaptiveQueries/exactQueries),
+                   exactTime/repeat, adaptiveTime/repeat,
+                   static_cast<unsigned long>(differences));
+            fflush(stdout);
+        }
+
+        destroyViewer(penRedViewer);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,325 @@
+//
+//  Viewer frame pipeline benchmark
+//
+//  Drives complete viewer frames offscreen, i.e. 'viewer::render' until the
+//  frame is displayed, 'viewer::updateMatView' and 'viewer::resizeImage',
+//  for the X, Y, Z and 3D perspectives, several resolutions, material and
+//  body views and thread counts. Latency percentiles of each stage and the
+//  pixel throughput are written as JSON.
+//
+//  Usage:
+//
+//    GeometryViewerBench [options] (--config file | --quadric file | --mesh file)
+//
+//  and the available options are
+//
+//    --sizes   s1,s2,...      Square image resolutions in pixels (default 500,1000,2000)
+//    --views   xyz3           Perspectives to run (default xyz3)
+//    --threads n              Run with 1, 2, 4... up to n render threads (default all cores)
+//    --pixel   size           2D and 3D pixel size in cm (default 0.05)
+//    --center  x y z          Slices center and 3D look at point in cm (default 0 0 0)
+//    --rho     r              3D camera distance to the center in cm (default 100)
+//    --window  width height   Viewer widget size in pixels (default 800 800)
+//    --repeat  n              Frames per configuration (default 10)
+//    --output  file           JSON output file (default stdout)
+//
+//  The stages reported are
+//
+//    frame          From 'viewer::render' to the frame displayed, including
+//                   its colorization
+//    updateMatView  Colorization and key of the displayed frame
+//    resizeImage    Display update and repaint of the frame at the widget size
+//
+//  The frame cache, prefetching and progressive previews are disabled, so
+//  every frame is rendered completely. Thread counts apply to the 2D
+//  slice renders, 3D renders are threaded by the geometry library.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <QApplication>
+#include <QLibrary>
+
+#include "pen_geoViewInterface.hh"
+#include "viewer.h"
+#include "framecache.h"
+#include "tilescheduler.h"
+#include "geometryconfig.h"
+
+typedef pen_geoViewInterface* (*viewerConstructor)();
+typedef void (*viewerDestructor)(pen_geoViewInterface*);
+
+struct stageStats{
+    std::vector<double> times; //ms
+
+    double percentile(const double p) const{
+        std::vector<double> sorted(times);
+        std::sort(sorted.begin(), sorted.end());
+        const size_t index = static_cast<size_t>(p*(sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    double mean() const{
+        double sum = 0.0;
+        for(const double t : times)
+            sum += t;
+        return sum/times.size();
+    }
+};
+
+struct benchResult{
+    unsigned perspective;
+    unsigned width, height;
+    unsigned threads;
+    bool matView;
+    stageStats frame, update, resize;
+};
+
+static double elapsed(const std::chrono::steady_clock::time_point& start){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void writeStage(FILE* fout, const char* name, const stageStats& stats, const bool last){
+    fprintf(fout, "        \"%s\": {\"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+            name, stats.mean(), stats.percentile(0.0), stats.percentile(0.5),
+            stats.percentile(0.9), stats.percentile(0.99), stats.percentile(1.0),
+            last ? "" : ",");
+}
+
+int main(int argc, char *argv[])
+{
+    //Run without display unless a platform has been selected
+    if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    std::vector<unsigned> sizes = {500, 1000, 2000};
+    std::string views("xyz3");
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    double pixelSize = 0.05;
+    double center[3] = {0.0, 0.0, 0.0};
+    double rho = 100.0;
+    int windowWidth = 800, windowHeight = 800;
+    unsigned repeat = 10;
+    std::string outputFile;
+    std::string geometryType, geometryFile;
+
+    for(int i = 1; i < argc; ++i){
+        const std::string arg(argv[i]);
+        if((arg == "--config" || arg == "--quadric" || arg == "--mesh") && i+1 < argc){
+            geometryType = arg.substr(2);
+            geometryFile = argv[++i];
+        }else if(arg == "--sizes" && i+1 < argc){
+            sizes.clear();
+            for(const char* s = argv[++i]; *s != '\0'; ){
+                char* end;
+                const long size = std::strtol(s, &end, 10);
+                if(end == s)
+                    break;
+                if(size > 0)
+                    sizes.push_back(static_cast<unsigned>(size));
+                s = *end == ',' ? end + 1 : end;
+            }
+        }else if(arg == "--views" && i+1 < argc){
+            views = argv[++i];
+        }else if(arg == "--threads" && i+1 < argc){
+            maxThreads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        }else if(arg == "--pixel" && i+1 < argc){
+            pixelSize = std::atof(argv[++i]);
+        }else if(arg == "--center" && i+3 < argc){
+            center[0] = std::atof(argv[++i]);
+            center[1] = std::atof(argv[++i]);
+            center[2] = std::atof(argv[++i]);
+        }else if(arg == "--rho" && i+1 < argc){
+            rho = std::atof(argv[++i]);
+        }else if(arg == "--window" && i+2 < argc){
+            windowWidth = std::max(10, std::atoi(argv[++i]));
+            windowHeight = std::max(10, std::atoi(argv[++i]));
+        }else if(arg == "--repeat" && i+1 < argc){
+            repeat = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        }else if(arg == "--output" && i+1 < argc){
+            outputFile = argv[++i];
+        }else{
+            printf("Unknown or incomplete argument '%s'\n", arg.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(geometryFile.empty() || sizes.empty() || pixelSize <= 0.0){
+        printf("usage: %s [--sizes s1,s2,...] [--views xyz3] [--threads n] [--pixel size]\n"
+               "       [--center x y z] [--rho r] [--window width height] [--repeat n]\n"
+               "       [--output file] (--config file | --quadric file | --mesh file)\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    //Resolutions are limited to the viewer maximum
+    const unsigned maxSize = static_cast<unsigned>(viewer::maxWidth < viewer::maxHeight ?
+                                                   viewer::maxWidth : viewer::maxHeight);
+    for(unsigned& size : sizes)
+        size = std::min(size, maxSize);
+
+    //Thread counts 1, 2, 4... and the maximum
+    std::vector<unsigned> threadCounts;
+    for(unsigned n = 1; n < maxThreads; n *= 2)
+        threadCounts.push_back(n);
+    threadCounts.push_back(maxThreads);
+
+    //Load the geometry library as the main window does
+    QLibrary viewerLib(QCoreApplication::applicationDirPath() + "/libgeoView_C");
+    if(!viewerLib.load()){
+        printf("Unable to load geometry library: %s\n", viewerLib.errorString().toStdString().c_str());
+        return EXIT_FAILURE;
+    }
+    viewerConstructor constructViewer = (viewerConstructor) viewerLib.resolve("pen_geoView_new");
+    viewerDestructor destroyViewer = (viewerDestructor) viewerLib.resolve("pen_geoView_delete");
+    if(!constructViewer || !destroyViewer){
+        printf("Unable to load the viewer constructor and destructor functions\n");
+        return EXIT_FAILURE;
+    }
+
+    pen_geoViewInterface* penRedViewer = constructViewer();
+    const std::string configFile = geometryConfig::prepare(geometryType, geometryFile, "Bench");
+    if(configFile.empty() || penRedViewer->init(configFile.c_str(), 0) != 0){
+        printf("Error loading geometry '%s'\n", geometryFile.c_str());
+        destroyViewer(penRedViewer);
+        return EXIT_FAILURE;
+    }
+
+    viewer::loadBodyNames(penRedViewer);
+
+    //Render every frame
+    frameCache::instance().setBudget(0);
+    viewer::resetColors();
+
+    std::vector<benchResult> results;
+
+    for(const unsigned nthreads : threadCounts){
+
+        //The calling thread takes part in the renders
+        tileScheduler scheduler(nthreads - 1);
+
+        for(const char view : views){
+            const char* viewPos = strchr("xyz3", view);
+            if(view == '\0' || viewPos == nullptr)
+                continue;
+            const unsigned perspective = static_cast<unsigned>(viewPos - "xyz3");
+
+            for(const unsigned size : sizes){
+                for(const bool matView : {true, false}){
+
+                    //Configure the viewer before the geometry is
+                    //set, so the setters don't trigger renders
+                    viewer view2bench;
+                    view2bench.resize(windowWidth, windowHeight);
+                    view2bench.show();
+                    QCoreApplication::processEvents();
+
+                    view2bench.setScheduler(&scheduler);
+                    view2bench.setProgressiveRender(false);
+                    view2bench.setPrefetchPlanes(0);
+                    view2bench.setExactRender(true);
+                    view2bench.setMatView(matView);
+                    view2bench.setImageWidth(size);
+                    view2bench.setImageHeight(size);
+                    view2bench.setPixelSize(pixelSize);
+                    view2bench.setImage3DWidth(size);
+                    view2bench.setImage3DHeight(size);
+                    view2bench.setPixelSize3D(pixelSize);
+                    view2bench.setX(center[0]);
+                    view2bench.setY(center[1]);
+                    view2bench.setZ(center[2]);
+                    view2bench.setRho(rho);
+                    view2bench.setPerspective(perspective);
+                    view2bench.setViewer(penRedViewer, true);
+
+                    unsigned long long displayed = 0;
+                    QObject::connect(&view2bench, &viewer::rendered, [&displayed](viewer*){ ++displayed; });
+
+                    auto displayFrame = [&](){
+                        const unsigned long long previous = displayed;
+                        view2bench.render();
+                        while(displayed == previous)
+                            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+                    };
+
+                    //Warm up
+                    displayFrame();
+
+                    benchResult result;
+                    result.perspective = perspective;
+                    result.width = size;
+                    result.height = size;
+                    result.threads = nthreads;
+                    result.matView = matView;
+                    for(unsigned irep = 0; irep < repeat; ++irep){
+                        auto start = std::chrono::steady_clock::now();
+                        displayFrame();
+                        result.frame.times.push_back(elapsed(start));
+
+                        start = std::chrono::steady_clock::now();
+                        view2bench.updateMatView();
+                        result.update.times.push_back(elapsed(start));
+
+                        start = std::chrono::steady_clock::now();
+                        view2bench.resizeImage();
+                        view2bench.repaint();
+                        result.resize.times.push_back(elapsed(start));
+                    }
+                    results.push_back(result);
+
+                    fprintf(stderr, "%c %5ux%-5u %2u threads %-4s frame p50 %9.2f ms\n",
+                            view, size, size, nthreads, matView ? "mat" : "body",
+                            result.frame.percentile(0.5));
+                }
+            }
+        }
+    }
+
+    //Write the results
+    FILE* fout = outputFile.empty() ? stdout : fopen(outputFile.c_str(), "w");
+    if(fout == nullptr){
+        printf("Unable to open output file '%s'\n", outputFile.c_str());
+        destroyViewer(penRedViewer);
+        return EXIT_FAILURE;
+    }
+
+    const char* perspectiveNames[4] = {"X", "Y", "Z", "3D"};
+    fprintf(fout, "{\n");
+    fprintf(fout, "  \"geometry\": \"%s\",\n", geometryFile.c_str());
+    fprintf(fout, "  \"qt\": \"%s\",\n", qVersion());
+    fprintf(fout, "  \"hardwareThreads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(fout, "  \"pixelSize\": %.6e,\n", pixelSize);
+    fprintf(fout, "  \"window\": [%d, %d],\n", windowWidth, windowHeight);
+    fprintf(fout, "  \"repeat\": %u,\n", repeat);
+    fprintf(fout, "  \"results\": [\n");
+    for(size_t i = 0; i < results.size(); ++i){
+        const benchResult& result = results[i];
+        const double pixels = static_cast<double>(result.width)*result.height;
+        fprintf(fout, "    {\n");
+        fprintf(fout, "      \"view\": \"%s\",\n", perspectiveNames[result.perspective]);
+        fprintf(fout, "      \"width\": %u,\n", result.width);
+        fprintf(fout, "      \"height\": %u,\n", result.height);
+        fprintf(fout, "      \"threads\": %u,\n", result.threads);
+        fprintf(fout, "      \"label\": \"%s\",\n", result.matView ? "mat" : "body");
+        fprintf(fout, "      \"pixelsPerSecond\": %.1f,\n", 1000.0*pixels/result.frame.mean());
+        fprintf(fout, "      \"stages\": {\n");
+        writeStage(fout, "frame", result.frame, false);
+        writeStage(fout, "updateMatView", result.update, false);
+        writeStage(fout, "resizeImage", result.resize, true);
+        fprintf(fout, "      }\n");
+        fprintf(fout, "    }%s\n", i+1 < results.size() ? "," : "");
+    }
+    fprintf(fout, "  ]\n");
+    fprintf(fout, "}\n");
+    if(fout != stdout)
+        fclose(fout);
+
+    destroyViewer(penRedViewer);
+    return EXIT_SUCCESS;
+}
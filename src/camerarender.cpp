@@ -0,0 +1,1194 @@
+#include "camerarender.h"
+
+#include <cmath>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+
+//Distance of the pixels with no hit until the frame range is known
+static constexpr float noHit = -1.0f;
+
+float cameraRenderer::imageAxes(const renderRequest& request,
+                                double eh[3], double ev[3], double dir[3]){
+
+    double norm = std::sqrt(request.u*request.u + request.v*request.v + request.w*request.w);
+    if(norm <= 0.0)
+        norm = 1.0;
+    double rot[9];
+    const float phi = static_cast<float>(request.pPenRedViewer->z2dir(request.u/norm, request.v/norm,
+                                                                      request.w/norm, request.omega,
+                                                                      rot, request.phi3D, 1.0e-4));
+    for(unsigned k = 0; k < 3; ++k){
+        eh[k] = rot[3*k];
+        ev[k] = rot[3*k + 1];
+        dir[k] = rot[3*k + 2];
+    }
+    return phi;
+}
+
+//Traces the grid of 'ncols' x 'nrows' pixels of a 'width' x 'height' view
+//starting at pixel (col0,row0) as an orthographic view centered at the
+//grid center. With a stride greater than one, only one of each 'stride'
+//pixels is included along both image axes, and the grid can exceed the
+//view. Results are stored contiguously, and pixels with no hit, which the
+//library sets to the maximum distance of the call, are marked with 'noHit'
+static void traceGrid(const renderRequest& request, const double eh[3], const double ev[3],
+                      const double pixelSize, const unsigned nBodies,
+                      const unsigned width, const unsigned height,
+                      const unsigned col0, const unsigned row0,
+                      const unsigned ncols, const unsigned nrows, const unsigned stride,
+                      unsigned char* renderMat, unsigned int* renderBody, float* distances){
+
+    const long icol = static_cast<long>(col0 + (ncols/2)*stride) - static_cast<long>(width/2);
+    const long irow = static_cast<long>(row0 + (nrows/2)*stride) - static_cast<long>(height/2);
+    const double a = static_cast<double>(icol)*pixelSize;
+    const double b = -static_cast<double>(irow)*pixelSize;
+    const double camera[3] = {request.camera3DX, request.camera3DY, request.camera3DZ};
+    float center[3];
+    for(unsigned k = 0; k < 3; ++k)
+        center[k] = static_cast<float>(camera[k] + a*eh[k] + b*ev[k]);
+
+    const double gridPixelSize = pixelSize*static_cast<double>(stride);
+    float phi = request.phi3D;
+    float minD, maxD;
+    request.pPenRedViewer->render3Dortho(renderMat, renderBody,
+                                         center[0], center[1], center[2],
+                                         request.u, request.v, request.w, request.omega, phi,
+                                         gridPixelSize, gridPixelSize, ncols, nrows,
+                                         distances, minD, maxD);
+
+    const size_t gridPixels = static_cast<size_t>(ncols)*nrows;
+    for(size_t i = 0; i < gridPixels; ++i){
+        if(renderBody[i] >= nBodies && distances[i] == maxD)
+            distances[i] = noHit;
+    }
+}
+
+//Traces the region with 'ncols' x 'nrows' pixels starting at pixel
+//(col0,row0) of the frame, see 'traceGrid', and stores it in the frame
+static void traceRegion(const renderRequest& request, const double eh[3], const double ev[3],
+                        const double pixelSize, const unsigned nBodies,
+                        const unsigned col0, const unsigned row0,
+                        const unsigned ncols, const unsigned nrows,
+                        renderFrame& frame){
+
+    const unsigned width = frame.width;
+
+    thread_local std::vector<unsigned char> regionMat;
+    thread_local std::vector<unsigned int> regionBody;
+    thread_local std::vector<float> regionDistances;
+    const size_t regionPixels = static_cast<size_t>(ncols)*nrows;
+    regionMat.resize(regionPixels);
+    regionBody.resize(regionPixels);
+    regionDistances.resize(regionPixels);
+
+    traceGrid(request, eh, ev, pixelSize, nBodies, width, frame.height,
+              col0, row0, ncols, nrows, 1,
+              regionMat.data(), regionBody.data(), regionDistances.data());
+
+    //Copy the region rows to the frame
+    for(unsigned j = 0; j < nrows; ++j){
+        const size_t from = static_cast<size_t>(j)*ncols;
+        const size_t to = static_cast<size_t>(row0 + j)*width + col0;
+        std::copy(regionMat.begin() + from, regionMat.begin() + from + ncols, frame.matImage.begin() + to);
+        frame.bodyImage.store(to, regionBody.data() + from, ncols);
+        std::copy(regionDistances.begin() + from, regionDistances.begin() + from + ncols,
+                  frame.distances.begin() + to);
+    }
+}
+
+//Traces the rectangle of the frame with 'ncols' x 'nrows' pixels starting
+//at pixel (col0, row0) in tiles. Returns false if the render has been cancelled
+static bool traceRectangle(const renderRequest& request, const double eh[3], const double ev[3],
+                           const double pixelSize, const unsigned nBodies,
+                           const unsigned col0, const unsigned row0,
+                           const unsigned ncols, const unsigned nrows,
+                           renderFrame& frame, const cancelToken& token,
+                           tileScheduler& scheduler){
+
+    if(ncols == 0 || nrows == 0)
+        return true;
+
+    const unsigned tileSize = cameraRenderer::tileSize;
+    const unsigned tilesX = (ncols + tileSize - 1)/tileSize;
+    const unsigned tilesY = (nrows + tileSize - 1)/tileSize;
+
+    std::atomic<bool> skipped(false);
+    scheduler.parallelFor(static_cast<size_t>(tilesX)*tilesY, [&](size_t itile){
+
+        if(token.cancelled()){
+            skipped = true;
+            return;
+        }
+
+        const unsigned tileCol0 = col0 + static_cast<unsigned>(itile % tilesX)*tileSize;
+        const unsigned tileRow0 = row0 + static_cast<unsigned>(itile / tilesX)*tileSize;
+        traceRegion(request, eh, ev, pixelSize, nBodies, tileCol0, tileRow0,
+                    std::min(tileSize, col0 + ncols - tileCol0),
+                    std::min(tileSize, row0 + nrows - tileRow0), frame);
+    });
+
+    return !skipped;
+}
+
+//Checks if both requests share the camera axes and calculates them
+static bool sameAxes(const renderRequest& request, const renderRequest& lastRequest,
+                     double eh[3], double ev[3], double dir[3]){
+
+    if(!request.ortho3D || !lastRequest.ortho3D ||
+       request.perspective != 3 || lastRequest.perspective != 3 ||
+       request.width3D != lastRequest.width3D || request.height3D != lastRequest.height3D ||
+       request.width3D == 0 || request.height3D == 0)
+        return false;
+
+    double ehLast[3], evLast[3], dirLast[3];
+    cameraRenderer::imageAxes(request, eh, ev, dir);
+    cameraRenderer::imageAxes(lastRequest, ehLast, evLast, dirLast);
+    const double tolerance = 1.0e-7;
+    for(unsigned k = 0; k < 3; ++k){
+        if(std::fabs(eh[k] - ehLast[k]) > tolerance ||
+           std::fabs(ev[k] - evLast[k]) > tolerance ||
+           std::fabs(dir[k] - dirLast[k]) > tolerance)
+            return false;
+    }
+    return true;
+}
+
+//Camera displacement projected on the camera axes
+static void cameraOffset(const renderRequest& request, const renderRequest& lastRequest,
+                         const double eh[3], const double ev[3], const double dir[3],
+                         double& h, double& v, double& depth){
+    const double offset[3] = {request.camera3DX - lastRequest.camera3DX,
+                              request.camera3DY - lastRequest.camera3DY,
+                              request.camera3DZ - lastRequest.camera3DZ};
+    h = v = depth = 0.0;
+    for(unsigned k = 0; k < 3; ++k){
+        h += offset[k]*eh[k];
+        v += offset[k]*ev[k];
+        depth += offset[k]*dir[k];
+    }
+}
+
+bool cameraRenderer::renderOrthoTiles(const renderRequest& request,
+                                      const unsigned width, const unsigned height,
+                                      const double pixelSize, renderFrame& frame,
+                                      const cancelToken& token,
+                                      tileScheduler& scheduler){
+
+    frame.width = width;
+    frame.height = height;
+    const size_t nPixels = frame.nPixels();
+    frame.matImage.resize(nPixels);
+    frame.bodyImage.resize(nPixels, request.labelBytes);
+    frame.distances.resize(nPixels);
+
+    double eh[3], ev[3], dir[3];
+    frame.phi3D = imageAxes(request, eh, ev, dir);
+
+    //Points outside the geometry, i.e. rays with no hit, get this label
+    const unsigned nBodies = request.pPenRedViewer->getBodies();
+
+    if(!traceRectangle(request, eh, ev, pixelSize, nBodies, 0, 0, width, height,
+                       frame, token, scheduler))
+        return false;
+
+    finishDistances(frame, scheduler);
+    return true;
+}
+
+void cameraRenderer::finishDistances(renderFrame& frame, tileScheduler& scheduler){
+
+    const unsigned width = frame.width;
+    const unsigned height = frame.height;
+
+    struct range{
+        float minD = std::numeric_limits<float>::max();
+        float maxD = 0.0f;
+    };
+
+    const unsigned rowsPerTask = 16;
+    const unsigned nTasks = (height + rowsPerTask - 1)/rowsPerTask;
+    std::vector<range> ranges(nTasks);
+
+    //Distance range of the pixels with hit
+    scheduler.parallelFor(nTasks, [&](size_t itask){
+        const size_t begin = itask*rowsPerTask*static_cast<size_t>(width);
+        const size_t end = std::min<size_t>(height, (itask + 1)*rowsPerTask)*width;
+        range& r = ranges[itask];
+        for(size_t i = begin; i < end; ++i){
+            const float distance = frame.distances[i];
+            if(distance >= 0.0f){
+                r.minD = std::min(r.minD, distance);
+                r.maxD = std::max(r.maxD, distance);
+            }
+        }
+    });
+
+    float minD = std::numeric_limits<float>::max();
+    float maxD = 0.0f;
+    for(const range& r : ranges){
+        minD = std::min(minD, r.minD);
+        maxD = std::max(maxD, r.maxD);
+    }
+    if(minD > maxD){
+        minD = 0.0f;
+        maxD = 1.0f;
+    }
+    frame.minD = minD;
+    frame.maxD = maxD;
+
+    //Move the pixels with no hit to the maximum distance
+    scheduler.parallelFor(nTasks, [&](size_t itask){
+        const size_t begin = itask*rowsPerTask*static_cast<size_t>(width);
+        const size_t end = std::min<size_t>(height, (itask + 1)*rowsPerTask)*width;
+        for(size_t i = begin; i < end; ++i){
+            if(frame.distances[i] < 0.0f)
+                frame.distances[i] = maxD;
+        }
+    });
+}
+
+//Traces a single tile of an adaptive orthographic render. Like the slice
+//adaptive tiles (see 'sliceRenderer::renderAdaptive'), the tile is covered
+//by a lattice of points with a whole number of coarse blocks per side, and
+//lattice points are traced only when required, grouping close points of
+//each lattice row in a single call. A block is filled without more rays
+//when its corners and center share material, body and hit, and its surface
+//is flat enough to interpolate the distances, i.e. the center and the twist
+//of the corners deviate from the bilinear interpolation up to 'tolerance'
+static void adaptiveOrthoTile(const renderRequest& request,
+                              const double eh[3], const double ev[3],
+                              const unsigned nBodies, const double tolerance,
+                              const unsigned col0, const unsigned row0,
+                              const unsigned ncols, const unsigned nrows,
+                              renderFrame& frame, renderStats* stats){
+
+    struct block{
+        unsigned x, y, size;
+    };
+
+    const double pixelSize = request.pixelSize3D;
+    const unsigned width = frame.width;
+    const unsigned height = frame.height;
+
+    const unsigned B0 = cameraRenderer::adaptiveBlock;
+    const unsigned latticeW = ((ncols + B0 - 1)/B0)*B0;
+    const unsigned latticeH = ((nrows + B0 - 1)/B0)*B0;
+    const size_t latticeWidth = static_cast<size_t>(latticeW) + 1;
+    const size_t nLattice = latticeWidth*(static_cast<size_t>(latticeH) + 1);
+
+    //Lattice point states
+    const unsigned char unknown = 0;
+    const unsigned char requested = 1;
+    const unsigned char known = 2;
+
+    thread_local std::vector<unsigned char> latticeMat;
+    thread_local std::vector<unsigned int> latticeBody;
+    thread_local std::vector<float> latticeDistances;
+    thread_local std::vector<unsigned char> latticeState;
+    thread_local std::vector<unsigned char> sampleMat;
+    thread_local std::vector<unsigned int> sampleBody;
+    thread_local std::vector<float> sampleDistances;
+    thread_local std::vector<block> blocks;
+    thread_local std::vector<block> children;
+
+    latticeMat.resize(nLattice);
+    latticeBody.resize(nLattice);
+    latticeDistances.resize(nLattice);
+    latticeState.assign(nLattice, unknown);
+
+    unsigned long long queries = 0;
+    unsigned long long calls = 0;
+
+    //Trace the coarse lattice with a single call
+    const unsigned nCoarseX = latticeW/B0 + 1;
+    const unsigned nCoarseY = latticeH/B0 + 1;
+    const size_t nCoarse = static_cast<size_t>(nCoarseX)*nCoarseY;
+    sampleMat.resize(nCoarse);
+    sampleBody.resize(nCoarse);
+    sampleDistances.resize(nCoarse);
+    traceGrid(request, eh, ev, pixelSize, nBodies, width, height,
+              col0, row0, nCoarseX, nCoarseY, B0,
+              sampleMat.data(), sampleBody.data(), sampleDistances.data());
+    queries += nCoarse;
+    ++calls;
+    for(unsigned j = 0; j < nCoarseY; ++j){
+        for(unsigned i = 0; i < nCoarseX; ++i){
+            const size_t il = static_cast<size_t>(j*B0)*latticeWidth + i*B0;
+            const size_t is = static_cast<size_t>(j)*nCoarseX + i;
+            latticeMat[il] = sampleMat[is];
+            latticeBody[il] = sampleBody[is];
+            latticeDistances[il] = sampleDistances[is];
+            latticeState[il] = known;
+        }
+    }
+
+    //Traces all requested lattice points with the specified step. Runs of
+    //requested points separated by up to 'maxGap' points are traced in a
+    //single call, as a few more rays are cheaper than a call
+    const unsigned maxGap = 4;
+    size_t nRequested = 0;
+    auto sampleRequested = [&](const unsigned step){
+        if(nRequested == 0)
+            return;
+        nRequested = 0;
+        for(unsigned ly = 0; ly <= latticeH; ly += step){
+            const size_t rowOffset = static_cast<size_t>(ly)*latticeWidth;
+            unsigned lx = 0;
+            while(lx <= latticeW){
+                if(latticeState[rowOffset + lx] != requested){
+                    lx += step;
+                    continue;
+                }
+                //Find the requested points up to the next gap
+                unsigned lxEnd = lx;
+                unsigned gap = 0;
+                for(unsigned lxNext = lx + step; lxNext <= latticeW && gap < maxGap; lxNext += step){
+                    if(latticeState[rowOffset + lxNext] == requested){
+                        lxEnd = lxNext;
+                        gap = 0;
+                    }else{
+                        ++gap;
+                    }
+                }
+
+                const unsigned n = (lxEnd - lx)/step + 1;
+                sampleMat.resize(n);
+                sampleBody.resize(n);
+                sampleDistances.resize(n);
+                traceGrid(request, eh, ev, pixelSize, nBodies, width, height,
+                          col0 + lx, row0 + ly, n, 1, step,
+                          sampleMat.data(), sampleBody.data(), sampleDistances.data());
+                queries += n;
+                ++calls;
+                for(unsigned k = 0; k < n; ++k){
+                    const size_t il = rowOffset + lx + k*step;
+                    latticeMat[il] = sampleMat[k];
+                    latticeBody[il] = sampleBody[k];
+                    latticeDistances[il] = sampleDistances[k];
+                    latticeState[il] = known;
+                }
+                lx = lxEnd + step;
+            }
+        }
+    };
+
+    auto requestPoint = [&](const unsigned lx, const unsigned ly){
+        unsigned char& state = latticeState[static_cast<size_t>(ly)*latticeWidth + lx];
+        if(state == unknown){
+            state = requested;
+            ++nRequested;
+        }
+    };
+
+    //Checks if the lattice point shares the labels and the hit of the reference one
+    auto samePoint = [&](const size_t il, const size_t iref){
+        return latticeBody[il] == latticeBody[iref] && latticeMat[il] == latticeMat[iref] &&
+               (latticeDistances[il] < 0.0f) == (latticeDistances[iref] < 0.0f);
+    };
+
+    //Fills the block region inside the tile interpolating the corner distances
+    auto fill = [&](const block& b, const size_t i00){
+        const unsigned char mat = latticeMat[i00];
+        const unsigned int body = latticeBody[i00];
+        const float d00 = latticeDistances[i00];
+        const bool hit = d00 >= 0.0f;
+        float d10 = d00, d01 = d00, d11 = d00;
+        if(hit && b.size > 1){
+            d10 = latticeDistances[i00 + b.size];
+            d01 = latticeDistances[i00 + b.size*latticeWidth];
+            d11 = latticeDistances[i00 + b.size*latticeWidth + b.size];
+        }
+        const float invSize = 1.0f/static_cast<float>(b.size);
+        const unsigned xEnd = std::min(b.x + b.size, ncols);
+        const unsigned yEnd = std::min(b.y + b.size, nrows);
+        for(unsigned ly = b.y; ly < yEnd; ++ly){
+            const size_t offset = static_cast<size_t>(row0 + ly)*width + col0;
+            std::fill(frame.matImage.begin() + offset + b.x, frame.matImage.begin() + offset + xEnd, mat);
+            frame.bodyImage.fill(offset + b.x, offset + xEnd, body);
+            if(!hit){
+                std::fill(frame.distances.begin() + offset + b.x,
+                          frame.distances.begin() + offset + xEnd, noHit);
+                continue;
+            }
+            const float fy = static_cast<float>(ly - b.y)*invSize;
+            const float left = d00 + (d01 - d00)*fy;
+            const float right = d10 + (d11 - d10)*fy;
+            for(unsigned lx = b.x; lx < xEnd; ++lx){
+                const float fx = static_cast<float>(lx - b.x)*invSize;
+                frame.distances[offset + lx] = left + (right - left)*fx;
+            }
+        }
+    };
+
+    blocks.clear();
+    for(unsigned ly = 0; ly < nrows; ly += B0)
+        for(unsigned lx = 0; lx < ncols; lx += B0)
+            blocks.push_back(block{lx, ly, B0});
+
+    //Requests the corners of the four children of a block
+    auto requestChildren = [&](const block& b){
+        const unsigned half = b.size/2;
+        requestPoint(b.x + half, b.y);
+        requestPoint(b.x, b.y + half);
+        requestPoint(b.x + half, b.y + half);
+        if(half > 1){
+            //Single pixel children only need its own pixel
+            requestPoint(b.x + b.size, b.y + half);
+            requestPoint(b.x + half, b.y + b.size);
+        }
+    };
+
+    thread_local std::vector<unsigned char> split;
+
+    while(!blocks.empty()){
+
+        const unsigned size = blocks.front().size;
+        const unsigned half = size/2;
+
+        if(size > 1){
+            //Blocks with uniform corners need their center to be checked,
+            //the rest are subdivided
+            split.resize(blocks.size());
+            for(size_t ib = 0; ib < blocks.size(); ++ib){
+                const block& b = blocks[ib];
+                const size_t i00 = static_cast<size_t>(b.y)*latticeWidth + b.x;
+                const size_t i01 = i00 + size*latticeWidth;
+                const bool uniform = samePoint(i00 + size, i00) && samePoint(i01, i00) &&
+                                     samePoint(i01 + size, i00);
+                split[ib] = uniform ? 0 : 1;
+                if(uniform)
+                    requestPoint(b.x + half, b.y + half);
+                else
+                    requestChildren(b);
+            }
+            sampleRequested(half);
+
+            //Subdivide the uniform blocks whose center differs or whose
+            //surface is not flat
+            for(size_t ib = 0; ib < blocks.size(); ++ib){
+                if(split[ib] != 0)
+                    continue;
+                const block& b = blocks[ib];
+                const size_t i00 = static_cast<size_t>(b.y)*latticeWidth + b.x;
+                const size_t i10 = i00 + size;
+                const size_t i01 = i00 + size*latticeWidth;
+                const size_t i11 = i01 + size;
+                const size_t ic = i00 + half*latticeWidth + half;
+                bool flat = samePoint(ic, i00);
+                if(flat && latticeDistances[i00] >= 0.0f){
+                    const double d00 = latticeDistances[i00];
+                    const double d10 = latticeDistances[i10];
+                    const double d01 = latticeDistances[i01];
+                    const double d11 = latticeDistances[i11];
+                    flat = std::fabs(d00 + d11 - d10 - d01) <= tolerance &&
+                           std::fabs(latticeDistances[ic] - 0.25*(d00 + d10 + d01 + d11)) <= tolerance;
+                }
+                if(!flat){
+                    split[ib] = 1;
+                    requestChildren(b);
+                }
+            }
+            sampleRequested(half);
+        }
+
+        children.clear();
+        for(size_t ib = 0; ib < blocks.size(); ++ib){
+            const block& b = blocks[ib];
+
+            //Single pixel blocks are the top left lattice point
+            if(size == 1 || split[ib] == 0){
+                fill(b, static_cast<size_t>(b.y)*latticeWidth + b.x);
+                continue;
+            }
+
+            children.push_back(block{b.x, b.y, half});
+            if(b.x + half < ncols)
+                children.push_back(block{b.x + half, b.y, half});
+            if(b.y + half < nrows){
+                children.push_back(block{b.x, b.y + half, half});
+                if(b.x + half < ncols)
+                    children.push_back(block{b.x + half, b.y + half, half});
+            }
+        }
+        std::swap(blocks, children);
+    }
+
+    if(stats != nullptr){
+        stats->queries += queries;
+        stats->calls += calls;
+    }
+}
+
+bool cameraRenderer::renderOrthoAdaptive(const renderRequest& request, renderFrame& frame,
+                                         const cancelToken& token, renderStats* stats,
+                                         tileScheduler& scheduler){
+
+    const unsigned width = request.width3D;
+    const unsigned height = request.height3D;
+    frame.width = width;
+    frame.height = height;
+    const size_t nPixels = frame.nPixels();
+    frame.matImage.resize(nPixels);
+    frame.bodyImage.resize(nPixels, request.labelBytes);
+    frame.distances.resize(nPixels);
+
+    double eh[3], ev[3], dir[3];
+    frame.phi3D = imageAxes(request, eh, ev, dir);
+    const unsigned nBodies = request.pPenRedViewer->getBodies();
+
+    const unsigned nTilesX = (width + tileSize - 1)/tileSize;
+    const unsigned nTilesY = (height + tileSize - 1)/tileSize;
+
+    std::atomic<bool> skipped(false);
+    scheduler.parallelFor(static_cast<size_t>(nTilesX)*nTilesY, [&](size_t itile){
+
+        if(token.cancelled()){
+            skipped = true;
+            return;
+        }
+
+        const unsigned col0 = static_cast<unsigned>(itile % nTilesX)*tileSize;
+        const unsigned row0 = static_cast<unsigned>(itile / nTilesX)*tileSize;
+        adaptiveOrthoTile(request, eh, ev, nBodies, request.pixelSize3D, col0, row0,
+                          std::min(tileSize, width - col0), std::min(tileSize, height - row0),
+                          frame, stats);
+    });
+
+    if(skipped)
+        return false;
+
+    finishDistances(frame, scheduler);
+    return true;
+}
+
+bool cameraRenderer::orthoShiftable(const renderRequest& request, const renderFrame& last,
+                                    int& dx, int& dy){
+
+    const renderRequest& lastRequest = last.request;
+    if(last.preview() ||
+       last.width != request.width3D || last.height != request.height3D ||
+       lastRequest.pixelSize3D != request.pixelSize3D ||
+       lastRequest.exactRender != request.exactRender)
+        return false;
+
+    double eh[3], ev[3], dir[3];
+    if(!sameAxes(request, lastRequest, eh, ev, dir))
+        return false;
+
+    double h, v, depth;
+    cameraOffset(request, lastRequest, eh, ev, dir, h, v, depth);
+
+    const double tolerance = 1.0e-3;
+    if(std::fabs(depth) > tolerance*request.pixelSize3D)
+        return false;
+
+    //Displacement in pixels
+    const double dh = h/request.pixelSize3D;
+    const double dv = v/request.pixelSize3D;
+    const double dhRound = std::round(dh);
+    const double dvRound = std::round(dv);
+    if(std::fabs(dh - dhRound) > tolerance || std::fabs(dv - dvRound) > tolerance)
+        return false;
+
+    //Nothing can be reused if the whole image has been moved out
+    if(std::fabs(dhRound) >= static_cast<double>(request.width3D) ||
+       std::fabs(dvRound) >= static_cast<double>(request.height3D))
+        return false;
+
+    //Image rows grow downwards, i.e. along -ev
+    dx = static_cast<int>(dhRound);
+    dy = -static_cast<int>(dvRound);
+    return true;
+}
+
+bool cameraRenderer::renderOrthoShift(const renderRequest& request, const renderFrame& last,
+                                      const int dx, const int dy, renderFrame& frame,
+                                      const cancelToken& token,
+                                      tileScheduler& scheduler){
+
+    const unsigned width = request.width3D;
+    const unsigned height = request.height3D;
+
+    frame.width = width;
+    frame.height = height;
+    const size_t nPixels = frame.nPixels();
+    frame.matImage.resize(nPixels);
+    frame.bodyImage.resize(nPixels, request.labelBytes);
+    frame.distances.resize(nPixels);
+
+    double eh[3], ev[3], dir[3];
+    frame.phi3D = imageAxes(request, eh, ev, dir);
+    const unsigned nBodies = request.pPenRedViewer->getBodies();
+
+    //Pixel (i,j) of the new frame is the pixel (i+dx, j+dy) of the
+    //previous one, with the same distance. Copy the overlapping region
+    const unsigned adx = static_cast<unsigned>(std::abs(dx));
+    const unsigned ady = static_cast<unsigned>(std::abs(dy));
+    const unsigned keptCols = width - adx;
+    const unsigned keptRows = height - ady;
+    const unsigned keptCol0 = dx < 0 ? adx : 0; //First kept column in the new frame
+    const unsigned keptRow0 = dy < 0 ? ady : 0; //First kept row in the new frame
+
+    for(unsigned j = 0; j < keptRows; ++j){
+        const size_t to = static_cast<size_t>(keptRow0 + j)*width + keptCol0;
+        const size_t from = static_cast<size_t>(static_cast<int>(keptRow0 + j) + dy)*width +
+                            static_cast<size_t>(static_cast<int>(keptCol0) + dx);
+        std::copy(last.matImage.begin() + from, last.matImage.begin() + from + keptCols,
+                  frame.matImage.begin() + to);
+        frame.bodyImage.copy(last.bodyImage, from, to, keptCols);
+        for(unsigned i = 0; i < keptCols; ++i){
+            const float distance = last.distances[from + i];
+            frame.distances[to + i] = last.bodyImage[from + i] >= nBodies && distance == last.maxD ?
+                                      noHit : distance;
+        }
+    }
+
+    //Trace the exposed L shaped region as a full width band of rows
+    //and a band of columns along the kept rows
+    const unsigned bandRow0 = dy > 0 ? keptRows : 0;
+    const unsigned bandCol0 = dx > 0 ? keptCols : 0;
+    if(!traceRectangle(request, eh, ev, request.pixelSize3D, nBodies, 0, bandRow0, width, ady,
+                       frame, token, scheduler) ||
+       !traceRectangle(request, eh, ev, request.pixelSize3D, nBodies, bandCol0, keptRow0, adx, keptRows,
+                       frame, token, scheduler))
+        return false;
+
+    finishDistances(frame, scheduler);
+    return true;
+}
+
+bool cameraRenderer::orthoZoomable(const renderRequest& request, const renderFrame& last){
+
+    const renderRequest& lastRequest = last.request;
+    if(last.preview() ||
+       last.width != lastRequest.width3D || last.height != lastRequest.height3D ||
+       lastRequest.exactRender != request.exactRender ||
+       lastRequest.pixelSize3D == request.pixelSize3D)
+        return false;
+
+    double eh[3], ev[3], dir[3];
+    if(!sameAxes(request, lastRequest, eh, ev, dir))
+        return false;
+
+    double h, v, depth;
+    cameraOffset(request, lastRequest, eh, ev, dir, h, v, depth);
+    if(std::fabs(depth) > 1.0e-3*std::min(request.pixelSize3D, lastRequest.pixelSize3D))
+        return false;
+
+    //Check if both images overlap
+    const double halfW = 0.5*static_cast<double>(request.width3D);
+    const double halfH = 0.5*static_cast<double>(request.height3D);
+    return std::fabs(h) < halfW*(request.pixelSize3D + lastRequest.pixelSize3D) &&
+           std::fabs(v) < halfH*(request.pixelSize3D + lastRequest.pixelSize3D);
+}
+
+void cameraRenderer::orthoResample(const renderRequest& request, const renderFrame& last,
+                                   renderFrame& frame, std::vector<unsigned char>& refine,
+                                   tileScheduler& scheduler){
+
+    const unsigned width = request.width3D;
+    const unsigned height = request.height3D;
+    const int lastWidth = static_cast<int>(last.width);
+    const int lastHeight = static_cast<int>(last.height);
+
+    frame.width = width;
+    frame.height = height;
+    const size_t nPixels = frame.nPixels();
+    frame.matImage.resize(nPixels);
+    frame.bodyImage.resize(nPixels, request.labelBytes);
+    frame.distances.resize(nPixels);
+
+    double eh[3], ev[3], dir[3];
+    frame.phi3D = imageAxes(request, eh, ev, dir);
+    const unsigned nBodies = request.pPenRedViewer->getBodies();
+
+    double h, v, depth;
+    cameraOffset(request, last.request, eh, ev, dir, h, v, depth);
+
+    //Source position of each pixel, in pixels of the previous frame
+    const double lastPixelSize = last.request.pixelSize3D;
+    const double ratio = request.pixelSize3D/lastPixelSize;
+    std::vector<double> sourceCol(width), sourceRow(height);
+    for(unsigned i = 0; i < width; ++i)
+        sourceCol[i] = h/lastPixelSize + static_cast<double>(lastWidth/2) +
+            static_cast<double>(static_cast<int>(i) - static_cast<int>(width/2))*ratio;
+    for(unsigned j = 0; j < height; ++j)
+        sourceRow[j] = -v/lastPixelSize + static_cast<double>(lastHeight/2) +
+            static_cast<double>(static_cast<int>(j) - static_cast<int>(height/2))*ratio;
+
+    refine.resize(nPixels);
+
+    auto lastNoHit = [&](const size_t index){
+        return last.bodyImage[index] >= nBodies && last.distances[index] == last.maxD;
+    };
+
+    //Checks if a source pixel is surrounded by pixels with the same values
+    //and a smooth surface, i.e. distances without steps or sharp bends.
+    //Pixels on the previous frame edges are never considered uniform
+    const float bend = static_cast<float>(lastPixelSize);
+    auto uniform = [&](const int is, const int js){
+        if(is == 0 || js == 0 || is == lastWidth-1 || js == lastHeight-1)
+            return false;
+        const size_t center = static_cast<size_t>(js)*lastWidth + is;
+        const unsigned char mat = last.matImage[center];
+        const unsigned int body = last.bodyImage[center];
+        for(int dj = -1; dj <= 1; ++dj){
+            const size_t rowOffset = static_cast<size_t>(js + dj)*lastWidth;
+            for(int di = -1; di <= 1; ++di){
+                const size_t index = rowOffset + (is + di);
+                if(last.matImage[index] != mat || last.bodyImage[index] != body)
+                    return false;
+            }
+        }
+        const float d = 2.0f*last.distances[center];
+        return std::fabs(last.distances[center - 1] + last.distances[center + 1] - d) <= bend &&
+               std::fabs(last.distances[center - lastWidth] + last.distances[center + lastWidth] - d) <= bend;
+    };
+
+    const unsigned rowsPerTask = 16;
+    const unsigned nTasks = (height + rowsPerTask - 1)/rowsPerTask;
+    scheduler.parallelFor(nTasks, [&](size_t itask){
+        const unsigned rowEnd = std::min(height, static_cast<unsigned>(itask + 1)*rowsPerTask);
+        for(unsigned j = static_cast<unsigned>(itask)*rowsPerTask; j < rowEnd; ++j){
+            const size_t rowOffset = static_cast<size_t>(j)*width;
+            const int js = static_cast<int>(std::lround(sourceRow[j]));
+            for(unsigned i = 0; i < width; ++i){
+                const size_t index = rowOffset + i;
+                const int is = static_cast<int>(std::lround(sourceCol[i]));
+                if(js < 0 || is < 0 || js >= lastHeight || is >= lastWidth){
+                    //Exposed region
+                    frame.matImage[index] = 0;
+                    frame.bodyImage.set(index, nBodies);
+                    frame.distances[index] = noHit;
+                    refine[index] = 1;
+                    continue;
+                }
+                const size_t source = static_cast<size_t>(js)*lastWidth + is;
+                frame.matImage[index] = last.matImage[source];
+                frame.bodyImage.set(index, last.bodyImage[source]);
+                if(lastNoHit(source)){
+                    frame.distances[index] = noHit;
+                    refine[index] = uniform(is, js) ? 0 : 1;
+                    continue;
+                }
+                if(!uniform(is, js)){
+                    frame.distances[index] = last.distances[source];
+                    refine[index] = 1;
+                    continue;
+                }
+
+                //Bilinear interpolation inside the uniform neighbourhood
+                const int i0 = static_cast<int>(std::floor(sourceCol[i]));
+                const int j0 = static_cast<int>(std::floor(sourceRow[j]));
+                const float tx = static_cast<float>(sourceCol[i] - i0);
+                const float ty = static_cast<float>(sourceRow[j] - j0);
+                const size_t s00 = static_cast<size_t>(j0)*lastWidth + i0;
+                const size_t s10 = s00 + lastWidth;
+                const float top = last.distances[s00] + tx*(last.distances[s00 + 1] - last.distances[s00]);
+                const float bottom = last.distances[s10] + tx*(last.distances[s10 + 1] - last.distances[s10]);
+                frame.distances[index] = top + ty*(bottom - top);
+                refine[index] = 0;
+            }
+        }
+    });
+}
+
+//Camera of a 3D view, following the layout and the camera model
+//described in 'camerarender.h'. Image coordinates are in pixels
+struct viewCamera{
+
+    double origin[3];
+    double eh[3], ev[3], dir[3];
+    double pixelSize;
+    double focal; //Distance to the image plane in pixels, zero on orthographic views
+    double halfW, halfH;
+    float phi;
+
+    viewCamera(const renderRequest& request, const float phiIn){
+        renderRequest axesRequest = request;
+        axesRequest.phi3D = phiIn;
+        phi = cameraRenderer::imageAxes(axesRequest, eh, ev, dir);
+        origin[0] = request.camera3DX;
+        origin[1] = request.camera3DY;
+        origin[2] = request.camera3DZ;
+        pixelSize = request.pixelSize3D;
+        halfW = static_cast<double>(request.width3D/2);
+        halfH = static_cast<double>(request.height3D/2);
+        focal = 0.0;
+        if(!request.ortho3D)
+            focal = 0.5*static_cast<double>(request.width3D)/std::tan(0.5*request.perspective3D);
+    }
+
+    //Point at distance 't' along the ray of the pixel (i,j)
+    inline void point(const double i, const double j, const double t, double p[3]) const{
+        const double a = i - halfW;
+        const double b = halfH - j;
+        if(focal <= 0.0){
+            for(unsigned k = 0; k < 3; ++k)
+                p[k] = origin[k] + pixelSize*(a*eh[k] + b*ev[k]) + t*dir[k];
+            return;
+        }
+        double d[3];
+        for(unsigned k = 0; k < 3; ++k)
+            d[k] = a*eh[k] + b*ev[k] + focal*dir[k];
+        const double scale = t/std::sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+        for(unsigned k = 0; k < 3; ++k)
+            p[k] = origin[k] + scale*d[k];
+    }
+
+    //Image position and distance of a point. Returns false for points
+    //behind the camera
+    inline bool project(const double p[3], double& fi, double& fj, double& distance) const{
+        double h = 0.0, v = 0.0, z = 0.0;
+        for(unsigned k = 0; k < 3; ++k){
+            const double rel = p[k] - origin[k];
+            h += rel*eh[k];
+            v += rel*ev[k];
+            z += rel*dir[k];
+        }
+        if(focal <= 0.0){
+            if(z < 0.0)
+                return false;
+            fi = halfW + h/pixelSize;
+            fj = halfH - v/pixelSize;
+            distance = z;
+            return true;
+        }
+        if(z <= 0.0)
+            return false;
+        fi = halfW + h/z*focal;
+        fj = halfH - v/z*focal;
+        distance = std::sqrt(h*h + v*v + z*z);
+        return true;
+    }
+
+    //Side of a pixel at distance 't', in cm
+    inline float footprint(const float t) const{
+        return focal <= 0.0 ? static_cast<float>(pixelSize) : static_cast<float>(t/focal);
+    }
+};
+
+bool cameraRenderer::reprojectable(const renderRequest& request, const renderFrame& last){
+
+    const renderRequest& lastRequest = last.request;
+    if(request.pPenRedViewer == nullptr || last.preview() ||
+       request.perspective != 3 || lastRequest.perspective != 3 ||
+       request.ortho3D != lastRequest.ortho3D ||
+       request.width3D != lastRequest.width3D || request.height3D != lastRequest.height3D ||
+       last.width != request.width3D || last.height != request.height3D ||
+       request.pixelSize3D != lastRequest.pixelSize3D ||
+       last.nPixels() == 0 || last.distances.size() != last.nPixels())
+        return false;
+
+    if(!request.ortho3D &&
+       (request.perspective3D != lastRequest.perspective3D ||
+        request.perspective3D <= 0.0 || request.perspective3D >= 3.141592653589793))
+        return false;
+
+    const viewCamera camera(request, request.phi3D);
+    const viewCamera lastCamera(lastRequest, last.phi3D);
+
+    double cosAngle = 0.0, displacement = 0.0;
+    for(unsigned k = 0; k < 3; ++k){
+        cosAngle += camera.dir[k]*lastCamera.dir[k];
+        const double offset = camera.origin[k] - lastCamera.origin[k];
+        displacement += offset*offset;
+    }
+    return cosAngle >= std::cos(maxReprojectionAngle) &&
+           std::sqrt(displacement) < 0.5*static_cast<double>(last.minD);
+}
+
+void cameraRenderer::reproject(const renderRequest& request, const renderFrame& last,
+                               renderFrame& frame, std::vector<unsigned char>& refine,
+                               tileScheduler& scheduler){
+
+    const unsigned width = request.width3D;
+    const unsigned height = request.height3D;
+    const unsigned lastWidth = last.width;
+    const unsigned lastHeight = last.height;
+
+    frame.width = width;
+    frame.height = height;
+    const size_t nPixels = frame.nPixels();
+    frame.matImage.resize(nPixels);
+    frame.bodyImage.resize(nPixels, request.labelBytes);
+    frame.distances.resize(nPixels);
+    refine.resize(nPixels);
+
+    const viewCamera camera(request, request.phi3D);
+    const viewCamera lastCamera(last.request, last.phi3D);
+    frame.phi3D = camera.phi;
+    const unsigned nBodies = request.pPenRedViewer->getBodies();
+
+    auto lastNoHit = [&](const size_t index){
+        return last.bodyImage[index] >= nBodies && last.distances[index] == last.maxD;
+    };
+
+    const unsigned rowsPerTask = 16;
+    auto forRows = [&](const unsigned nrows, const std::function<void(unsigned)>& rowFunc){
+        const unsigned nTasks = (nrows + rowsPerTask - 1)/rowsPerTask;
+        scheduler.parallelFor(nTasks, [&](size_t itask){
+            const unsigned rowEnd = std::min(nrows, static_cast<unsigned>(itask + 1)*rowsPerTask);
+            for(unsigned j = static_cast<unsigned>(itask)*rowsPerTask; j < rowEnd; ++j)
+                rowFunc(j);
+        });
+    };
+
+    //Nearest warped point of each pixel, as the distance bits over the
+    //source pixel index. Positive floats keep their order as integers
+    const unsigned long long empty = ~0ull;
+    std::unique_ptr<std::atomic<unsigned long long>[]> nearest(new std::atomic<unsigned long long>[nPixels]);
+    forRows(height, [&](const unsigned j){
+        const size_t rowOffset = static_cast<size_t>(j)*width;
+        for(unsigned i = 0; i < width; ++i)
+            nearest[rowOffset + i].store(empty, std::memory_order_relaxed);
+    });
+
+    //Warp the surface points of the previous frame
+    forRows(lastHeight, [&](const unsigned js){
+        const size_t rowOffset = static_cast<size_t>(js)*lastWidth;
+        for(unsigned is = 0; is < lastWidth; ++is){
+            const size_t source = rowOffset + is;
+            if(lastNoHit(source))
+                continue;
+            double p[3];
+            lastCamera.point(is, js, last.distances[source], p);
+            double fi, fj, distance;
+            if(!camera.project(p, fi, fj, distance))
+                continue;
+            const long i = std::lround(fi);
+            const long j = std::lround(fj);
+            if(i < 0 || j < 0 || i >= static_cast<long>(width) || j >= static_cast<long>(height))
+                continue;
+
+            const float d = static_cast<float>(distance);
+            uint32_t bits;
+            std::memcpy(&bits, &d, sizeof(bits));
+            const unsigned long long key = (static_cast<unsigned long long>(bits) << 32) | source;
+            std::atomic<unsigned long long>& slot = nearest[static_cast<size_t>(j)*width + i];
+            unsigned long long current = slot.load(std::memory_order_relaxed);
+            while(key < current && !slot.compare_exchange_weak(current, key, std::memory_order_relaxed)){}
+        }
+    });
+
+    //Copy the warped points
+    std::vector<unsigned char> covered(nPixels);
+    forRows(height, [&](const unsigned j){
+        const size_t rowOffset = static_cast<size_t>(j)*width;
+        for(unsigned i = 0; i < width; ++i){
+            const size_t index = rowOffset + i;
+            const unsigned long long key = nearest[index].load(std::memory_order_relaxed);
+            if(key == empty){
+                covered[index] = 0;
+                continue;
+            }
+            const size_t source = static_cast<size_t>(key & 0xffffffffull);
+            const uint32_t bits = static_cast<uint32_t>(key >> 32);
+            float d;
+            std::memcpy(&d, &bits, sizeof(d));
+            frame.matImage[index] = last.matImage[source];
+            frame.bodyImage.set(index, last.bodyImage[source]);
+            frame.distances[index] = d;
+            covered[index] = 1;
+        }
+    });
+    nearest.reset();
+
+    //Pixel states after filling the pixels without point
+    const unsigned char hole = 0, warped = 1, filled = 2, background = 3;
+    std::vector<unsigned char> state(nPixels);
+
+    //Checks if two warped pixels belong to the same surface
+    auto sameSurface = [&](const size_t a, const size_t b){
+        const float da = frame.distances[a];
+        const float db = frame.distances[b];
+        return frame.matImage[a] == frame.matImage[b] &&
+               frame.bodyImage[a] == frame.bodyImage[b] &&
+               std::fabs(da - db) <= 2.0f*camera.footprint(std::max(da, db));
+    };
+
+    const double tMid = 0.5*(static_cast<double>(last.minD) + static_cast<double>(last.maxD));
+    forRows(height, [&](const unsigned j){
+        const size_t rowOffset = static_cast<size_t>(j)*width;
+        for(unsigned i = 0; i < width; ++i){
+            const size_t index = rowOffset + i;
+            if(covered[index] != 0){
+                state[index] = warped;
+                continue;
+            }
+
+            //Cracks between the points of a surface
+            size_t a = index, b = index;
+            if(i > 0 && i + 1 < width && covered[index - 1] != 0 && covered[index + 1] != 0 &&
+               sameSurface(index - 1, index + 1)){
+                a = index - 1;
+                b = index + 1;
+            }else if(j > 0 && j + 1 < height && covered[index - width] != 0 &&
+                     covered[index + width] != 0 && sameSurface(index - width, index + width)){
+                a = index - width;
+                b = index + width;
+            }
+            if(a != index){
+                frame.matImage[index] = frame.matImage[a];
+                frame.bodyImage.set(index, frame.bodyImage[a]);
+                frame.distances[index] = 0.5f*(frame.distances[a] + frame.distances[b]);
+                state[index] = filled;
+                continue;
+            }
+
+            //Directions with no hit in the previous frame, checked at the
+            //middle of its distance range
+            state[index] = hole;
+            frame.matImage[index] = 0;
+            frame.bodyImage.set(index, nBodies);
+            frame.distances[index] = noHit;
+
+            double p[3];
+            camera.point(i, j, tMid, p);
+            double fi, fj, distance;
+            if(!lastCamera.project(p, fi, fj, distance))
+                continue;
+            const long is = std::lround(fi);
+            const long js = std::lround(fj);
+            if(is < 1 || js < 1 || is + 1 >= static_cast<long>(lastWidth) || js + 1 >= static_cast<long>(lastHeight))
+                continue;
+            bool empty3x3 = true;
+            for(long dj = -1; dj <= 1 && empty3x3; ++dj){
+                const size_t sourceRow = static_cast<size_t>(js + dj)*lastWidth;
+                for(long di = -1; di <= 1; ++di){
+                    if(!lastNoHit(sourceRow + (is + di))){
+                        empty3x3 = false;
+                        break;
+                    }
+                }
+            }
+            if(empty3x3){
+                const size_t source = static_cast<size_t>(js)*lastWidth + is;
+                frame.matImage[index] = last.matImage[source];
+                frame.bodyImage.set(index, last.bodyImage[source]);
+                state[index] = background;
+            }
+        }
+    });
+
+    //Flag holes, silhouettes and material, body and depth edges
+    forRows(height, [&](const unsigned j){
+        const size_t rowOffset = static_cast<size_t>(j)*width;
+        for(unsigned i = 0; i < width; ++i){
+            const size_t index = rowOffset + i;
+            const unsigned char current = state[index];
+            if(current == hole){
+                refine[index] = 1;
+                continue;
+            }
+
+            const bool surface = current != background;
+            size_t neighbours[4];
+            unsigned nNeighbours = 0;
+            if(i > 0) neighbours[nNeighbours++] = index - 1;
+            if(i + 1 < width) neighbours[nNeighbours++] = index + 1;
+            if(j > 0) neighbours[nNeighbours++] = index - width;
+            if(j + 1 < height) neighbours[nNeighbours++] = index + width;
+
+            bool edge = false;
+            for(unsigned k = 0; k < nNeighbours && !edge; ++k){
+                const size_t neighbour = neighbours[k];
+                const unsigned char neighbourState = state[neighbour];
+                if(neighbourState == hole)
+                    edge = true;
+                else if((neighbourState == background) == surface)
+                    edge = true;
+                else if(surface && (frame.matImage[neighbour] != frame.matImage[index] ||
+                                    frame.bodyImage[neighbour] != frame.bodyImage[index]))
+                    edge = true;
+            }
+
+            //Depth steps and sharp bends inside a surface
+            if(!edge && surface){
+                const float bend = 2.0f*camera.footprint(frame.distances[index]);
+                const float d = 2.0f*frame.distances[index];
+                if(i > 0 && i + 1 < width &&
+                   std::fabs(frame.distances[index - 1] + frame.distances[index + 1] - d) > bend)
+                    edge = true;
+                else if(j > 0 && j + 1 < height &&
+                        std::fabs(frame.distances[index - width] + frame.distances[index + width] - d) > bend)
+                    edge = true;
+            }
+            refine[index] = edge ? 1 : 0;
+        }
+    });
+}
+
+bool cameraRenderer::renderOrthoMasked(const renderRequest& request, renderFrame& frame,
+                                       const std::vector<unsigned char>& mask,
+                                       const cancelToken& token,
+                                       tileScheduler& scheduler){
+
+    const unsigned width = frame.width;
+    const unsigned height = frame.height;
+
+    double eh[3], ev[3], dir[3];
+    imageAxes(request, eh, ev, dir);
+    const unsigned nBodies = request.pPenRedViewer->getBodies();
+
+    //Many short runs cost more calls than tracing the whole view in tiles
+    const size_t flagged = static_cast<size_t>(std::count(mask.begin(), mask.end(), 1));
+    if(flagged > frame.nPixels()/maxMaskedFraction){
+        if(!traceRectangle(request, eh, ev, request.pixelSize3D, nBodies, 0, 0, width, height,
+                           frame, token, scheduler))
+            return false;
+        finishDistances(frame, scheduler);
+        return true;
+    }
+
+    const unsigned rowsPerTask = 8;
+    const unsigned nTasks = (height + rowsPerTask - 1)/rowsPerTask;
+    const unsigned maxGap = 16;
+
+    std::atomic<bool> skipped(false);
+    scheduler.parallelFor(nTasks, [&](size_t itask){
+
+        if(token.cancelled()){
+            skipped = true;
+            return;
+        }
+
+        const unsigned rowEnd = std::min(height, static_cast<unsigned>(itask + 1)*rowsPerTask);
+        for(unsigned j = static_cast<unsigned>(itask)*rowsPerTask; j < rowEnd; ++j){
+            const size_t rowOffset = static_cast<size_t>(j)*width;
+            unsigned i = 0;
+            while(i < width){
+                if(mask[rowOffset + i] == 0){
+                    ++i;
+                    continue;
+                }
+                //Find the flagged pixels up to the next gap of 'maxGap'
+                //pixels. Tracing a few more rays is cheaper than a call
+                unsigned iEnd = i + 1;
+                unsigned gap = 0;
+                for(unsigned k = iEnd; k < width && gap < maxGap; ++k){
+                    if(mask[rowOffset + k] != 0){
+                        iEnd = k + 1;
+                        gap = 0;
+                    }else{
+                        ++gap;
+                    }
+                }
+
+                traceRegion(request, eh, ev, request.pixelSize3D, nBodies, i, j, iEnd - i, 1, frame);
+                i = iEnd;
+            }
+        }
+    });
+
+    if(skipped)
+        return false;
+
+    finishDistances(frame, scheduler);
+    return true;
+}
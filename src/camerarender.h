@@ -0,0 +1,158 @@
+#ifndef CAMERARENDER_H
+#define CAMERARENDER_H
+
+#include <vector>
+#include <string>
+
+#include "pen_geoViewInterface.hh"
+#include "renderframe.h"
+#include "slicerender.h"
+#include "tilescheduler.h"
+
+//Host side helpers to render 3D views through the geometry library.
+//
+//Perspective views are traced by 'render3D', which renders the whole
+//camera grid set by 'set3DResolution' in a single blocking call. The grid
+//is a global state of the library and there is no call to trace a part of
+//it, so perspective views can't be split among threads by the host.
+//
+//Orthographic views are traced by the 'render3Dortho' overload which takes
+//the grid explicitly. Rays are parallel, so a screen tile is an independent
+//orthographic view centered at the tile center, and tiles are traced in
+//parallel with the tile scheduler. The tile pixel (i,j) of a view with
+//nx x ny pixels of size (dx,dy) is placed at
+//
+//   camera + (i - nx/2)*dx*eh - (j - ny/2)*dy*ev
+//
+//using integer divisions, with eh and ev the horizontal and vertical image
+//axes, i.e. the first two columns of the 'z2dir' rotation matrix. This
+//follows the 2D slices layout described in 'slicerender.h'.
+//
+//As on 2D slices, moving the camera along the image axes shifts the
+//orthographic image, and changing the pixel size scales it around the
+//camera, while the distance of each surface point to the image plane is
+//kept. So pans and zooms reuse the previous frame like the slice ones.
+//
+//Small camera movements reproject the previous frame, warping its surface
+//points, given by the distances, to the new camera. This requires the
+//camera model of the library. Perspective views are pinhole cameras at the
+//camera position with a horizontal aperture given by the perspective
+//angle, so the ray of the pixel (i,j) has direction
+//
+//   (i - nx/2)*dx*eh - (j - ny/2)*dy*ev + f*dir,  f = nx*dx/(2*tan(angle/2))
+//
+//with dir the third column of the rotation matrix, and distances are
+//measured along the rays. Orthographic distances are measured from the
+//image plane. As perspective views can't be traced partially, reprojected
+//perspective frames are only displayed while the whole view is traced.
+//
+//The functions which trace only a part of the frame mark the pixels with
+//no hit with a negative distance until the whole frame is known, see
+//'finishDistances'.
+class cameraRenderer{
+
+public:
+
+    //Tile side, in pixels, used to split orthographic views among threads
+    static constexpr unsigned tileSize = 64;
+    //Side, in pixels, of the coarse blocks traced by adaptive renders. Must
+    //be a power of two
+    static constexpr unsigned adaptiveBlock = 8;
+    //Masked renders flagging more than 1/maxMaskedFraction of the pixels
+    //trace the whole view instead
+    static constexpr size_t maxMaskedFraction = 4;
+    //Largest change of the view direction, in radians, rendered
+    //reprojecting the previous frame
+    static constexpr double maxReprojectionAngle = 0.25;
+
+    //Calculates the image axes and the view direction of the request
+    //camera. Returns the phi angle used by 'z2dir'
+    static float imageAxes(const renderRequest& request,
+                           double eh[3], double ev[3], double dir[3]);
+
+    //Traces the orthographic view of the request with 'width' x 'height'
+    //pixels of side 'pixelSize' in tiles. The frame 'minD' and 'maxD' are
+    //the distance range of the whole view, and pixels with no hit, which
+    //the library sets to the maximum distance of their tile, are set to the
+    //frame maximum. Returns false if the render has been cancelled
+    static bool renderOrthoTiles(const renderRequest& request,
+                                 const unsigned width, const unsigned height,
+                                 const double pixelSize, renderFrame& frame,
+                                 const cancelToken& token,
+                                 tileScheduler& scheduler = tileScheduler::instance());
+
+    //Traces the orthographic view of the request in tiles like
+    //'renderOrthoTiles', but each tile is first traced on a coarse grid of
+    //'adaptiveBlock' pixels. Blocks whose corners and center hit the same
+    //material and body on a surface flat up to the pixel size are filled
+    //interpolating the distances, and the rest are subdivided until single
+    //pixels are reached. Traced rays are added to the 'queries' of 'stats'.
+    //As on adaptive slices, features which touch no traced ray can be missed
+    static bool renderOrthoAdaptive(const renderRequest& request, renderFrame& frame,
+                                    const cancelToken& token,
+                                    renderStats* stats = nullptr,
+                                    tileScheduler& scheduler = tileScheduler::instance());
+
+    //Sets the frame distance range from the pixels with a hit, and moves
+    //the pixels with no hit, marked with negative distances, to its maximum
+    static void finishDistances(renderFrame& frame,
+                                tileScheduler& scheduler = tileScheduler::instance());
+
+    //Checks if the orthographic request can be rendered shifting the
+    //previous frame, i.e. if both share the view axes, the resolution, the
+    //pixel size and the exact render flag, the cameras differ in an integer number of pixels
+    //along the image axes and both images overlap. On success, the
+    //displacement in image columns and rows (rows grow downwards) is returned
+    static bool orthoShiftable(const renderRequest& request, const renderFrame& last,
+                               int& dx, int& dy);
+
+    //Renders the orthographic request moving the previous frame by (dx,dy)
+    //pixels and tracing only the exposed region. Returns false if the
+    //render has been cancelled
+    static bool renderOrthoShift(const renderRequest& request, const renderFrame& last,
+                                 const int dx, const int dy, renderFrame& frame,
+                                 const cancelToken& token,
+                                 tileScheduler& scheduler = tileScheduler::instance());
+
+    //Checks if the orthographic request can be rendered resampling the
+    //previous frame, i.e. if both share the view axes, the resolution and
+    //the exact render flag, the pixel size differs and the images overlap
+    static bool orthoZoomable(const renderRequest& request, const renderFrame& last);
+
+    //Fills the frame with the previous one, which has a different pixel
+    //size, like 'sliceRenderer::resample'. The distances of pixels inside
+    //smooth regions of a single material and body are interpolated, and
+    //the rest of pixels are flagged in 'refine' to be traced again.
+    //Distances of pixels with no hit are left negative
+    static void orthoResample(const renderRequest& request, const renderFrame& last,
+                              renderFrame& frame, std::vector<unsigned char>& refine,
+                              tileScheduler& scheduler = tileScheduler::instance());
+
+    //Checks if the 3D request can be rendered reprojecting the previous
+    //frame, i.e. if both share the projection, the resolution and the pixel
+    //size, and the camera has moved slightly: the view direction up to
+    //'maxReprojectionAngle' and the position less than half the nearest
+    //distance of the previous frame
+    static bool reprojectable(const renderRequest& request, const renderFrame& last);
+
+    //Warps the surface points of the previous frame to the camera of the
+    //request, keeping the nearest one on each pixel. Cracks between warped
+    //points of a surface are interpolated, and pixels with no point whose
+    //direction had no hit in the previous frame are set to no hit. The rest
+    //of pixels without point, i.e. disoccluded regions, and the material,
+    //body and depth edges and silhouettes are flagged in 'refine' to be
+    //traced again. Distances of pixels with no hit are left negative
+    static void reproject(const renderRequest& request, const renderFrame& last,
+                          renderFrame& frame, std::vector<unsigned char>& refine,
+                          tileScheduler& scheduler = tileScheduler::instance());
+
+    //Traces the pixels of the orthographic view flagged in 'mask', grouping
+    //close pixels of each row in a single call, and finishes the frame
+    //distances. Returns false if the render has been cancelled
+    static bool renderOrthoMasked(const renderRequest& request, renderFrame& frame,
+                                  const std::vector<unsigned char>& mask,
+                                  const cancelToken& token,
+                                  tileScheduler& scheduler = tileScheduler::instance());
+};
+
+#endif // CAMERARENDER_H
@@ -0,0 +1,423 @@
+//
+//  Headless geometry renderer
+//
+//  Renders the slices and 3D views listed in a job file with no display,
+//  writing PNG or TIFF images, or raw label images. Jobs are rendered in
+//  parallel and the time spent on each one is printed.
+//
+//  Usage:
+//
+//    GeometryViewerCLI [--threads n] jobfile
+//
+//  Job files contain one keyword per line, '#' starts a comment. Settings
+//  apply to the jobs listed after them:
+//
+//    geometry   (config|quadric|mesh) file   Geometry to load, as in the main window
+//    palette    file                 Color palette, in the viewer "colors.conf" format
+//    output-dir dir                  Directory for the output files (default ".")
+//    resolution width height         Image resolution in pixels (default 1000 1000),
+//                                    with no limit for 2D slices
+//    pixel-size size                 Pixel size in cm (default 0.1)
+//    view       (mat|body)           Label to draw (default mat)
+//    format     (png|tiff|raw)       Output format (default png)
+//    fov        angle                3D perspective angle in rad (default 0.349)
+//    roll       angle                3D camera roll angle in rad (default -pi/2)
+//    projection (perspective|ortho)  3D projection (default perspective)
+//
+//    slice  (x|y|z) cx cy cz name            2D slice centered at (cx,cy,cz)
+//    camera px py pz lx ly lz name           3D view from (px,py,pz) looking at (lx,ly,lz)
+//
+//  2D slices written as images are rendered in bands of rows which are
+//  streamed to the file (see 'posterRenderer'), so large posters, e.g.
+//  20000x20000 pixels, require a bounded amount of memory. TIFF images are
+//  uncompressed and limited to 4 GB.
+//
+//  Orthographic 3D views are traced in parallel tiles, perspective ones are
+//  traced by a single library call and serialized (see 'cameraRenderer').
+//
+//  Raw outputs are written as 'name.mat.raw', with a byte per pixel, and
+//  'name.body.raw', with a native endian 32 bit unsigned integer per pixel,
+//  both row by row starting at the top row.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <QCoreApplication>
+#include <QLibrary>
+
+#include "pen_geoViewInterface.hh"
+#include "renderframe.h"
+#include "colormap.h"
+#include "slicerender.h"
+#include "camerarender.h"
+#include "tilescheduler.h"
+#include "posterrender.h"
+#include "posterwriter.h"
+#include "geometryconfig.h"
+
+typedef pen_geoViewInterface* (*viewerConstructor)();
+typedef void (*viewerDestructor)(pen_geoViewInterface*);
+
+struct cliJob{
+    std::string name;
+    std::string outputDir;
+    bool matView;
+    std::string format;
+    renderRequest request;
+
+    //Results
+    bool ok = false;
+    double renderTime = 0.0;
+    double colorTime = 0.0;
+    double writeTime = 0.0;
+};
+
+struct cliSettings{
+    std::string geometryType;
+    std::string geometryFile;
+    std::string paletteFile;
+    std::vector<cliJob> jobs;
+};
+
+static bool readJobFile(const char* file, cliSettings& settings){
+
+    FILE* f = fopen(file, "r");
+    if(f == nullptr){
+        printf("Unable to open job file '%s'\n", file);
+        return false;
+    }
+
+    //Current settings
+    std::string outputDir(".");
+    unsigned width = 1000, height = 1000;
+    double pixelSize = 0.1;
+    bool matView = true;
+    std::string format("png");
+    double fov = 0.3490658503988659;
+    double roll = -1.5707963267948966;
+    bool ortho = false;
+
+    char line[1024];
+    unsigned nline = 0;
+    bool ok = true;
+    while(fgets(line, sizeof(line), f) != nullptr){
+        ++nline;
+
+        //Remove comments
+        char* comment = strchr(line, '#');
+        if(comment != nullptr)
+            *comment = '\0';
+
+        char key[64], s1[512], s2[512];
+        double v[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        if(sscanf(line, " %63s", key) != 1)
+            continue; //Empty line
+
+        const std::string keyword(key);
+        bool valid = true;
+        if(keyword == "geometry"){
+            valid = sscanf(line, " %*s %511s %511s", s1, s2) == 2;
+            if(valid){
+                settings.geometryType = s1;
+                settings.geometryFile = s2;
+                valid = settings.geometryType == "config" ||
+                        settings.geometryType == "quadric" ||
+                        settings.geometryType == "mesh";
+            }
+        }else if(keyword == "palette"){
+            valid = sscanf(line, " %*s %511s", s1) == 1;
+            if(valid)
+                settings.paletteFile = s1;
+        }else if(keyword == "output-dir"){
+            valid = sscanf(line, " %*s %511s", s1) == 1;
+            if(valid)
+                outputDir = s1;
+        }else if(keyword == "resolution"){
+            unsigned w, h;
+            valid = sscanf(line, " %*s %u %u", &w, &h) == 2 && w > 0 && h > 0;
+            if(valid){
+                width = w;
+                height = h;
+            }
+        }else if(keyword == "pixel-size"){
+            valid = sscanf(line, " %*s %lf", &v[0]) == 1 && v[0] > 0.0;
+            if(valid)
+                pixelSize = v[0];
+        }else if(keyword == "view"){
+            valid = sscanf(line, " %*s %511s", s1) == 1 &&
+                    (strcmp(s1, "mat") == 0 || strcmp(s1, "body") == 0);
+            if(valid)
+                matView = strcmp(s1, "mat") == 0;
+        }else if(keyword == "format"){
+            valid = sscanf(line, " %*s %511s", s1) == 1 &&
+                    (strcmp(s1, "png") == 0 || strcmp(s1, "tiff") == 0 || strcmp(s1, "raw") == 0);
+            if(valid)
+                format = s1;
+        }else if(keyword == "fov"){
+            valid = sscanf(line, " %*s %lf", &v[0]) == 1;
+            if(valid)
+                fov = v[0];
+        }else if(keyword == "roll"){
+            valid = sscanf(line, " %*s %lf", &v[0]) == 1;
+            if(valid)
+                roll = v[0];
+        }else if(keyword == "projection"){
+            valid = sscanf(line, " %*s %511s", s1) == 1 &&
+                    (strcmp(s1, "perspective") == 0 || strcmp(s1, "ortho") == 0);
+            if(valid)
+                ortho = strcmp(s1, "ortho") == 0;
+        }else if(keyword == "slice"){
+            valid = sscanf(line, " %*s %511s %lf %lf %lf %511s", s1, &v[0], &v[1], &v[2], s2) == 5 &&
+                    strlen(s1) == 1 && strchr("xyzXYZ", s1[0]) != nullptr;
+            if(valid){
+                cliJob job;
+                job.name = s2;
+                job.outputDir = outputDir;
+                job.matView = matView;
+                job.format = format;
+                job.request.perspective = static_cast<unsigned>(tolower(s1[0]) - 'x');
+                job.request.x = v[0];
+                job.request.y = v[1];
+                job.request.z = v[2];
+                job.request.pixelSize = pixelSize;
+                job.request.width = width;
+                job.request.height = height;
+                settings.jobs.push_back(job);
+            }
+        }else if(keyword == "camera"){
+            valid = sscanf(line, " %*s %lf %lf %lf %lf %lf %lf %511s",
+                           &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], s2) == 7;
+            const double u = v[3] - v[0];
+            const double vv = v[4] - v[1];
+            const double w = v[5] - v[2];
+            const double norm = std::sqrt(u*u + vv*vv + w*w);
+            valid = valid && norm > 0.0;
+            if(valid){
+                cliJob job;
+                job.name = s2;
+                job.outputDir = outputDir;
+                job.matView = matView;
+                job.format = format;
+                job.request.perspective = 3;
+                job.request.camera3DX = v[0];
+                job.request.camera3DY = v[1];
+                job.request.camera3DZ = v[2];
+                job.request.u = u/norm;
+                job.request.v = vv/norm;
+                job.request.w = w/norm;
+                job.request.omega = roll;
+                job.request.width3D = width;
+                job.request.height3D = height;
+                job.request.pixelSize3D = pixelSize;
+                job.request.perspective3D = fov;
+                job.request.ortho3D = ortho;
+                settings.jobs.push_back(job);
+            }
+        }else{
+            valid = false;
+        }
+
+        if(!valid){
+            printf("%s:%u: invalid line: %s", file, nline, line);
+            ok = false;
+        }
+    }
+    fclose(f);
+
+    if(settings.geometryFile.empty()){
+        printf("%s: no geometry specified\n", file);
+        ok = false;
+    }
+    return ok;
+}
+
+static bool writeRaw(const std::string& file, const void* data, const size_t size){
+    FILE* fout = fopen(file.c_str(), "wb");
+    if(fout == nullptr)
+        return false;
+    const bool ok = fwrite(data, 1, size, fout) == size;
+    fclose(fout);
+    return ok;
+}
+
+static double elapsed(const std::chrono::steady_clock::time_point& start){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    int nthreads = -1;
+    const char* jobFile = nullptr;
+    for(int i = 1; i < argc; ++i){
+        if(strcmp(argv[i], "--threads") == 0 && i+1 < argc){
+            nthreads = std::max(1, std::atoi(argv[++i]));
+        }else if(jobFile == nullptr && argv[i][0] != '-'){
+            jobFile = argv[i];
+        }else{
+            printf("Unknown or incomplete argument '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(jobFile == nullptr){
+        printf("usage: %s [--threads n] jobfile\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    cliSettings settings;
+    if(!readJobFile(jobFile, settings))
+        return EXIT_FAILURE;
+
+    colorMap::palette colors = colorMap::defaultColors();
+    if(!settings.paletteFile.empty() && !colorMap::readColors(settings.paletteFile.c_str(), colors))
+        return EXIT_FAILURE;
+
+    //Load the geometry library as the main window does
+    QLibrary viewerLib(QCoreApplication::applicationDirPath() + "/libgeoView_C");
+    if(!viewerLib.load()){
+        printf("Unable to load geometry library: %s\n", viewerLib.errorString().toStdString().c_str());
+        return EXIT_FAILURE;
+    }
+    viewerConstructor constructViewer = (viewerConstructor) viewerLib.resolve("pen_geoView_new");
+    viewerDestructor destroyViewer = (viewerDestructor) viewerLib.resolve("pen_geoView_delete");
+    if(!constructViewer || !destroyViewer){
+        printf("Unable to load the viewer constructor and destructor functions\n");
+        return EXIT_FAILURE;
+    }
+
+    pen_geoViewInterface* penRedViewer = constructViewer();
+    const auto loadStart = std::chrono::steady_clock::now();
+    const std::string configFile = geometryConfig::prepare(settings.geometryType, settings.geometryFile, "CLI");
+    if(configFile.empty() || penRedViewer->init(configFile.c_str(), 0) != 0){
+        printf("Error loading geometry '%s'\n", settings.geometryFile.c_str());
+        destroyViewer(penRedViewer);
+        return EXIT_FAILURE;
+    }
+    printf("Geometry '%s' loaded in %.2f ms\n", settings.geometryFile.c_str(), elapsed(loadStart));
+    const unsigned nBodies = penRedViewer->getBodies();
+
+    //Use the shared pool or a dedicated one with the requested threads
+    std::unique_ptr<tileScheduler> ownScheduler;
+    if(nthreads > 0)
+        ownScheduler = std::make_unique<tileScheduler>(static_cast<unsigned>(nthreads - 1));
+    tileScheduler& scheduler = ownScheduler ? *ownScheduler : tileScheduler::instance();
+
+    //The 3D resolution is a global state of the library, perspective 3D jobs are serialized
+    std::mutex render3DMutex;
+
+    const auto totalStart = std::chrono::steady_clock::now();
+    scheduler.parallelFor(settings.jobs.size(), [&](size_t ijob){
+
+        cliJob& job = settings.jobs[ijob];
+        renderRequest& request = job.request;
+        request.pPenRedViewer = penRedViewer;
+        const bool raw = job.format == "raw";
+        //Raw outputs keep 32 bit body labels
+        request.labelBytes = raw ? 4 : labelImage::bytesFor(nBodies);
+
+        const std::string base = job.outputDir + "/" + job.name;
+        const std::string imageFile = base + (job.format == "tiff" ? ".tif" : ".png");
+        if(request.perspective != 3 && !raw){
+            //Render, colorize and write in bands
+            posterStats stats;
+            job.ok = posterRenderer::render(request, job.matView, colors, imageFile,
+                                            cancelToken(), &stats, scheduler);
+            job.renderTime = stats.renderTime;
+            job.colorTime = stats.colorTime;
+            job.writeTime = stats.writeTime;
+            return;
+        }
+
+        //Render
+        auto start = std::chrono::steady_clock::now();
+        renderFrame frame;
+        frame.request = request;
+        if(request.perspective == 3 && request.ortho3D){
+            cameraRenderer::renderOrthoTiles(request, request.width3D, request.height3D,
+                                             request.pixelSize3D, frame, cancelToken(), scheduler);
+        }else if(request.perspective == 3){
+            frame.width = request.width3D;
+            frame.height = request.height3D;
+            frame.matImage.resize(frame.nPixels());
+            frame.bodyImage.resize(frame.nPixels(), request.labelBytes);
+            frame.distances.resize(frame.nPixels());
+            std::vector<unsigned int> body3D(frame.nPixels());
+
+            std::lock_guard<std::mutex> lock(render3DMutex);
+            penRedViewer->set3DResolution(request.width3D, request.height3D,
+                                          request.pixelSize3D, request.pixelSize3D,
+                                          request.perspective3D);
+            penRedViewer->render3D(frame.matImage.data(), body3D.data(),
+                                   request.camera3DX, request.camera3DY, request.camera3DZ,
+                                   request.u, request.v, request.w, request.omega, frame.phi3D,
+                                   frame.distances.data(), frame.minD, frame.maxD);
+            frame.bodyImage.store(0, body3D.data(), body3D.size());
+        }else{
+            frame.width = request.width;
+            frame.height = request.height;
+            frame.matImage.resize(frame.nPixels());
+            frame.bodyImage.resize(frame.nPixels(), request.labelBytes);
+            sliceRenderer::renderTiles(request, frame, cancelToken(), nullptr, scheduler);
+        }
+        job.renderTime = elapsed(start);
+
+        if(raw){
+            //Write labels
+            start = std::chrono::steady_clock::now();
+            job.ok = writeRaw(base + ".mat.raw", frame.matImage.data(), frame.matImage.size()) &&
+                     writeRaw(base + ".body.raw", frame.bodyImage.data<uint32_t>(),
+                              frame.bodyImage.size()*sizeof(uint32_t));
+            job.writeTime = elapsed(start);
+        }else{
+            //Colorize
+            start = std::chrono::steady_clock::now();
+            std::vector<uint32_t> argb(frame.nPixels());
+            colorMap::colorize(frame, job.matView, colors, argb.data(), nullptr, &scheduler);
+            job.colorTime = elapsed(start);
+
+            //Write image
+            start = std::chrono::steady_clock::now();
+            posterWriter writer;
+            job.ok = writer.open(imageFile, frame.width, frame.height) &&
+                     writer.writeRows(argb.data(), frame.height) &&
+                     writer.close();
+            job.writeTime = elapsed(start);
+        }
+    });
+    const double totalTime = elapsed(totalStart);
+
+    //Print timings
+    const char* perspectiveNames[4] = {"X", "Y", "Z", "3D"};
+    printf("# %-30s %4s %11s %10s %10s %10s %s\n",
+           "job", "view", "resolution", "render(ms)", "color(ms)", "write(ms)", "status");
+    bool allOk = true;
+    for(const cliJob& job : settings.jobs){
+        const renderRequest& request = job.request;
+        const bool is3D = request.perspective == 3;
+        char resolution[32];
+        snprintf(resolution, sizeof(resolution), "%ux%u",
+                 is3D ? request.width3D : request.width,
+                 is3D ? request.height3D : request.height);
+        printf("  %-30s %4s %11s %10.2f %10.2f %10.2f %s\n",
+               job.name.c_str(), perspectiveNames[request.perspective], resolution,
+               job.renderTime, job.colorTime, job.writeTime,
+               job.ok ? "ok" : "write error");
+        allOk = allOk && job.ok;
+    }
+    printf("%lu jobs in %.2f ms using %u threads\n",
+           static_cast<unsigned long>(settings.jobs.size()), totalTime, scheduler.readThreads());
+
+    destroyViewer(penRedViewer);
+    return allOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,421 @@
+#include "colormap.h"
+
+#include <bitset>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+colorMap::palette colorMap::defaultColors(){
+
+    const unsigned int baseIncrementPerRow = 300;
+    const unsigned int baseSteps = 2;
+    const unsigned int stepIncrement = baseIncrementPerRow/baseSteps;
+    const unsigned int colorsPerRow = 7*baseSteps;
+    const unsigned int nRows = 1 + nColors / colorsPerRow;
+    const unsigned int maxIntensity = baseIncrementPerRow*nRows + stepIncrement*baseSteps;
+
+    palette a{};
+
+    //Define first color as black
+    a[0] = 0;
+    a[1] = 0;
+    a[2] = 0;
+    //Set color counter
+    size_t icolor = 1;
+    for(size_t irow = 0; irow < nRows ; ++irow){
+        //Init RGB
+        unsigned int R = maxIntensity - baseIncrementPerRow*irow;
+        unsigned int G = maxIntensity - baseIncrementPerRow*irow;
+        unsigned int B = maxIntensity - baseIncrementPerRow*irow;
+
+        size_t colorIndex = 3*icolor++;
+        a[colorIndex  ] = R;
+        a[colorIndex+1] = G;
+        a[colorIndex+2] = B;
+
+        //R increase
+        for(size_t istep = 0; istep < baseSteps; ++istep){
+            R += stepIncrement;
+            colorIndex = 3*icolor++;
+            if(icolor < nColors){
+                a[colorIndex  ] = R;
+                a[colorIndex+1] = G;
+                a[colorIndex+2] = B;
+            }
+        }
+
+        //G increase
+        for(size_t istep = 0; istep < baseSteps; ++istep){
+            G += stepIncrement;
+            colorIndex = 3*icolor++;
+            if(icolor < nColors){
+                a[colorIndex  ] = R;
+                a[colorIndex+1] = G;
+                a[colorIndex+2] = B;
+            }
+        }
+
+        //R decrease
+        for(size_t istep = 0; istep < baseSteps; ++istep){
+            R -= stepIncrement;
+            colorIndex = 3*icolor++;
+            if(icolor < nColors){
+                a[colorIndex  ] = R;
+                a[colorIndex+1] = G;
+                a[colorIndex+2] = B;
+            }
+        }
+
+        //B increase
+        for(size_t istep = 0; istep < baseSteps; ++istep){
+            B += stepIncrement;
+            colorIndex = 3*icolor++;
+            if(icolor < nColors){
+                a[colorIndex  ] = R;
+                a[colorIndex+1] = G;
+                a[colorIndex+2] = B;
+            }
+        }
+
+        //G decrease
+        for(size_t istep = 0; istep < baseSteps; ++istep){
+            G -= stepIncrement;
+            colorIndex = 3*icolor++;
+            if(icolor < nColors){
+                a[colorIndex  ] = R;
+                a[colorIndex+1] = G;
+                a[colorIndex+2] = B;
+            }
+        }
+
+        //R increase
+        for(size_t istep = 0; istep < baseSteps; ++istep){
+            R += stepIncrement;
+            colorIndex = 3*icolor++;
+            if(icolor < nColors){
+                a[colorIndex  ] = R;
+                a[colorIndex+1] = G;
+                a[colorIndex+2] = B;
+            }
+        }
+
+        //B partial decrease
+        for(size_t istep = 0; istep < baseSteps-1; ++istep){
+            B -= stepIncrement;
+            colorIndex = 3*icolor++;
+            if(icolor < nColors){
+                a[colorIndex  ] = R;
+                a[colorIndex+1] = G;
+                a[colorIndex+2] = B;
+            }
+        }
+    }
+
+    return a;
+}
+
+bool colorMap::readColors(const char* file, palette& colors){
+
+    FILE* f = nullptr;
+    f = fopen(file, "r");
+    if(f == nullptr){
+        printf("Warning: Color palette file '%s' not found\n",file);
+        return false;
+    }
+
+    //Read all colors line by line
+    char line[400];
+    while(fgets(line,400,f) != nullptr){
+        // Try to read the next color
+        unsigned ic, r, g, b;
+        int nread = sscanf(line, " %u %u %u %u ",&ic,&r,&g,&b);
+        if(nread != 4){
+            //Corrupted line, skip it
+            printf("Warning: Invalid color line, skip: '%s'\n",line);
+        }else if(ic < nColors){
+            colors[3*ic  ] = static_cast<unsigned char>(std::clamp(r, 0u, 255u));
+            colors[3*ic+1] = static_cast<unsigned char>(std::clamp(g, 0u, 255u));
+            colors[3*ic+2] = static_cast<unsigned char>(std::clamp(b, 0u, 255u));
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+void labelSet::merge(const labelSet& other){
+    if(other.words.size() > words.size())
+        words.resize(other.words.size(), 0);
+    for(size_t i = 0; i < other.words.size(); ++i)
+        words[i] |= other.words[i];
+}
+
+size_t labelSet::size() const{
+    size_t count = 0;
+    for(const uint64_t word : words)
+        count += std::bitset<64>(word).count();
+    return count;
+}
+
+bool labelSet::operator==(const labelSet& other) const{
+    //Trailing empty words don't change the set
+    const std::vector<uint64_t>& shorter = words.size() < other.words.size() ? words : other.words;
+    const std::vector<uint64_t>& longer = words.size() < other.words.size() ? other.words : words;
+    if(!std::equal(shorter.begin(), shorter.end(), longer.begin()))
+        return false;
+    return std::all_of(longer.begin() + shorter.size(), longer.end(),
+                       [](const uint64_t word){return word == 0;});
+}
+
+colorMap::lookupTable colorMap::createLookupTable(const palette& colors){
+    lookupTable table;
+    for(size_t i = 0; i < nLookupColors; ++i)
+        table[i] = labelColor(static_cast<unsigned>(i), colors);
+    return table;
+}
+
+namespace{
+
+//Color of a label. Material labels are always in the lookup table
+inline uint32_t labelColor(const colorMap::lookupTable& table, const uint8_t ilabel){
+    return table[ilabel];
+}
+inline uint32_t labelColor(const colorMap::lookupTable& table, const uint16_t ilabel){
+    return ilabel < colorMap::nLookupColors ? table[ilabel] : colorMap::hashColor(ilabel);
+}
+inline uint32_t labelColor(const colorMap::lookupTable& table, const uint32_t ilabel){
+    return ilabel < colorMap::nLookupColors ? table[ilabel] : colorMap::hashColor(ilabel);
+}
+
+//Scales the channels of 'color' by 'correction', saturating at 255
+inline uint32_t shade(const uint32_t color, const float correction){
+    //Written so NaN distances give black pixels
+    const float factor = std::min(correction > 0.0f ? correction : 0.0f, 255.0f);
+    const int red   = static_cast<int>(static_cast<float>((color >> 16) & 0xff)*factor);
+    const int green = static_cast<int>(static_cast<float>((color >> 8) & 0xff)*factor);
+    const int blue  = static_cast<int>(static_cast<float>(color & 0xff)*factor);
+    return 0xff000000u |
+           static_cast<uint32_t>(std::min(red, 255)) << 16 |
+           static_cast<uint32_t>(std::min(green, 255)) << 8 |
+           static_cast<uint32_t>(std::min(blue, 255));
+}
+
+#if defined(__AVX2__)
+
+//8 consecutive labels
+inline __m256i loadLabels8(const uint8_t* labels){
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(labels)));
+}
+inline __m256i loadLabels8(const uint16_t* labels){
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(labels)));
+}
+inline __m256i loadLabels8(const uint32_t* labels){
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(labels));
+}
+
+//Same as 'colorMap::hashColor' for 8 labels
+inline __m256i hashColor8(const __m256i labels){
+    __m256i hash = _mm256_mullo_epi32(labels, _mm256_set1_epi32(static_cast<int>(0x9E3779B1u)));
+    hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 16));
+    hash = _mm256_mullo_epi32(hash, _mm256_set1_epi32(static_cast<int>(0x85EBCA6Bu)));
+    hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 13));
+    hash = _mm256_and_si256(hash, _mm256_set1_epi32(0x00ffffff));
+    return _mm256_or_si256(hash, _mm256_set1_epi32(static_cast<int>(0xff404040u)));
+}
+
+//Colors of 8 labels. Labels out of the lookup table are hashed
+//only when the block contains any
+template<class labelType>
+inline __m256i labelColor8(const int* table, const __m256i labels){
+    if constexpr(sizeof(labelType) == 1){
+        return _mm256_i32gather_epi32(table, labels, 4);
+    }else{
+        const __m256i lastIndex = _mm256_set1_epi32(colorMap::nLookupColors - 1);
+        const __m256i indexes = _mm256_min_epu32(labels, lastIndex);
+        const __m256i inTable = _mm256_cmpeq_epi32(indexes, labels);
+        const __m256i colors = _mm256_i32gather_epi32(table, indexes, 4);
+        if(_mm256_movemask_epi8(inTable) == -1)
+            return colors;
+        return _mm256_blendv_epi8(hashColor8(labels), colors, inTable);
+    }
+}
+
+//Adds 8 labels to the set. Most blocks lie inside a
+//single body, so uniform blocks add a single label
+inline void insertLabels8(const __m256i labels, labelSet& seen){
+    const __m256i first = _mm256_broadcastd_epi32(_mm256_castsi256_si128(labels));
+    if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(labels, first)) == -1){
+        seen.insert(static_cast<unsigned>(_mm256_cvtsi256_si32(labels)));
+    }else{
+        alignas(32) uint32_t values[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(values), labels);
+        seen.insert(values[0]);
+        for(unsigned i = 1; i < 8; ++i){
+            if(values[i] != values[i-1])
+                seen.insert(values[i]);
+        }
+    }
+}
+
+//Scales the channels of 8 colors by 'correction', saturating at 255
+inline __m256i shade8(const __m256i colors, const __m256 correction){
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i maxValue = _mm256_set1_epi32(255);
+    //NaN corrections are replaced by zero
+    const __m256 factor = _mm256_min_ps(_mm256_max_ps(correction, _mm256_setzero_ps()),
+                                        _mm256_set1_ps(255.0f));
+    __m256i result = _mm256_set1_epi32(static_cast<int>(0xff000000u));
+    for(int shift = 0; shift <= 16; shift += 8){
+        const __m128i count = _mm_cvtsi32_si128(shift);
+        __m256i channel = _mm256_and_si256(_mm256_srl_epi32(colors, count), mask);
+        channel = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(channel), factor));
+        channel = _mm256_min_epi32(channel, maxValue);
+        result = _mm256_or_si256(result, _mm256_sll_epi32(channel, count));
+    }
+    return result;
+}
+
+#endif
+
+//Colorizes the pixels [begin,end) of a 2D frame
+template<class labelType>
+void colorizeFlat(const labelType* labels, const colorMap::lookupTable& table,
+                  uint32_t* argb, const size_t begin, const size_t end,
+                  labelSet& seen){
+    size_t i = begin;
+#if defined(__AVX2__)
+    const int* tableData = reinterpret_cast<const int*>(table.data());
+    for(; i + 8 <= end; i += 8){
+        const __m256i ilabels = loadLabels8(labels + i);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(argb + i),
+                            labelColor8<labelType>(tableData, ilabels));
+        insertLabels8(ilabels, seen);
+    }
+#endif
+    if(i >= end)
+        return;
+    labelType lastLabel = labels[i];
+    seen.insert(lastLabel);
+    for(; i < end; ++i){
+        const labelType ilabel = labels[i];
+        argb[i] = labelColor(table, ilabel);
+        if(ilabel != lastLabel){
+            seen.insert(ilabel);
+            lastLabel = ilabel;
+        }
+    }
+}
+
+//Colorizes the pixels [begin,end) of a 3D frame, darkening far pixels
+//by 'scale'/(1 + 'slope'*f), with f the relative distance in [0,1]
+template<class labelType>
+void colorizeShaded(const labelType* labels, const float* distances,
+                    const colorMap::lookupTable& table,
+                    const float minD, const float invInterval,
+                    const float scale, const float slope,
+                    uint32_t* argb, const size_t begin, const size_t end,
+                    labelSet& seen){
+    size_t i = begin;
+#if defined(__AVX2__)
+    const int* tableData = reinterpret_cast<const int*>(table.data());
+    const __m256 minD8 = _mm256_set1_ps(minD);
+    const __m256 invInterval8 = _mm256_set1_ps(invInterval);
+    const __m256 scale8 = _mm256_set1_ps(scale);
+    const __m256 slope8 = _mm256_set1_ps(slope);
+    const __m256 one8 = _mm256_set1_ps(1.0f);
+    for(; i + 8 <= end; i += 8){
+        const __m256i ilabels = loadLabels8(labels + i);
+        const __m256 beyondFact = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(distances + i), minD8), invInterval8);
+        const __m256 correction = _mm256_div_ps(scale8, _mm256_add_ps(one8, _mm256_mul_ps(slope8, beyondFact)));
+        const __m256i colors = labelColor8<labelType>(tableData, ilabels);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(argb + i), shade8(colors, correction));
+        insertLabels8(ilabels, seen);
+    }
+#endif
+    if(i >= end)
+        return;
+    //Corrections are computed in chunks, so the compiler can vectorize the divisions
+    float correction[256];
+    labelType lastLabel = labels[i];
+    seen.insert(lastLabel);
+    while(i < end){
+        const size_t chunk = std::min(end - i, sizeof(correction)/sizeof(float));
+        for(size_t j = 0; j < chunk; ++j){
+            const float beyondFact = (distances[i+j] - minD)*invInterval;
+            correction[j] = scale/(1.0f + slope*beyondFact);
+        }
+        for(size_t j = 0; j < chunk; ++j, ++i){
+            const labelType ilabel = labels[i];
+            argb[i] = shade(labelColor(table, ilabel), correction[j]);
+            if(ilabel != lastLabel){
+                seen.insert(ilabel);
+                lastLabel = ilabel;
+            }
+        }
+    }
+}
+
+}
+
+void colorMap::colorize(const renderFrame& frame, const bool matView,
+                        const palette& colors, uint32_t* argb, labelSet* visible,
+                        tileScheduler* scheduler){
+    const size_t nRenderPixels = frame.nPixels();
+    if(nRenderPixels == 0)
+        return;
+
+    const lookupTable table = createLookupTable(colors);
+    const unsigned char* matImage = frame.matImage.data();
+
+    //3D frames are darkened with the distance
+    const bool shaded = frame.request.perspective == 3;
+    const float* distances = frame.distances.data();
+    const float minD = frame.minD;
+    const float distInterval = frame.maxD - frame.minD;
+    const float invInterval = distInterval > 0.0f ? 1.0f/distInterval : 0.0f;
+    const float scale = matView ? 1.0f : 1.2f;
+    const float slope = matView ? 1.1f : 2.0f;
+
+    //Split the image in blocks of whole rows, a few per pool thread
+    tileScheduler& pool = scheduler != nullptr ? *scheduler : tileScheduler::instance();
+    const size_t rowPixels = frame.width > 0 ? frame.width : 1;
+    const size_t nRows = nRenderPixels/rowPixels;
+    const size_t maxBlocks = 4*static_cast<size_t>(pool.readThreads());
+    const size_t nBlocks = nRows < maxBlocks ? nRows : maxBlocks;
+    const size_t blockRows = (nRows + nBlocks - 1)/nBlocks;
+
+    //Viewers colorize on the GUI thread, which must not run the render
+    //tiles of other calls while it waits for the blocks
+    std::vector<labelSet> seen(nBlocks);
+    pool.parallelFor(nBlocks, [&](size_t iblock){
+        const size_t begin = iblock*blockRows*rowPixels;
+        const size_t end = std::min(nRenderPixels, begin + blockRows*rowPixels);
+        labelSet& blockSeen = seen[iblock];
+        if(begin >= end)
+            return;
+        if(shaded){
+            if(matView)
+                colorizeShaded(matImage, distances, table, minD, invInterval, scale, slope,
+                               argb, begin, end, blockSeen);
+            else
+                frame.bodyImage.visit([&](const auto* bodyImage){
+                    colorizeShaded(bodyImage, distances, table, minD, invInterval, scale, slope,
+                                   argb, begin, end, blockSeen);
+                });
+        }else{
+            if(matView)
+                colorizeFlat(matImage, table, argb, begin, end, blockSeen);
+            else
+                frame.bodyImage.visit([&](const auto* bodyImage){
+                    colorizeFlat(bodyImage, table, argb, begin, end, blockSeen);
+                });
+        }
+    }, false, true);
+
+    //Merge the labels seen by each block
+    if(visible != nullptr){
+        for(const labelSet& blockSeen : seen)
+            visible->merge(blockSeen);
+    }
+}
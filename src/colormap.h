@@ -0,0 +1,127 @@
+#ifndef COLORMAP_H
+#define COLORMAP_H
+
+#include <cstdio>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+#include "renderframe.h"
+#include "tilescheduler.h"
+
+//Set of labels, stored as a bitmap which grows with the greatest label
+class labelSet
+{
+
+private:
+
+    std::vector<uint64_t> words;
+
+public:
+
+    inline void insert(const unsigned label){
+        const size_t iword = label >> 6;
+        if(iword >= words.size())
+            words.resize(iword + 1, 0);
+        words[iword] |= uint64_t(1) << (label & 63);
+    }
+
+    inline bool contains(const unsigned label) const{
+        const size_t iword = label >> 6;
+        return iword < words.size() && (words[iword] >> (label & 63) & 1) != 0;
+    }
+
+    inline void clear(){words.clear();}
+
+    //Adds the labels of 'other'
+    void merge(const labelSet& other);
+
+    //Number of labels in the set
+    size_t size() const;
+
+    bool operator==(const labelSet& other) const;
+    inline bool operator!=(const labelSet& other) const {return !(*this == other);}
+
+    //Calls 'f(label)' for the labels of the set in increasing order,
+    //skipping the 'first' ones and stopping after 'count' calls
+    template<class F>
+    void forEach(F f, size_t first = 0, size_t count = SIZE_MAX) const{
+        for(size_t iword = 0; iword < words.size() && count > 0; ++iword){
+            uint64_t word = words[iword];
+            for(unsigned bit = 0; word != 0 && count > 0; ++bit, word >>= 1){
+                if((word & 1) == 0)
+                    continue;
+                if(first > 0){
+                    --first;
+                }else{
+                    f(static_cast<unsigned>(64*iword + bit));
+                    --count;
+                }
+            }
+        }
+    }
+};
+
+//Color palette and colorization of rendered frames. It depends on no
+//widget, so it is shared by the viewer and the command line tools.
+class colorMap
+{
+
+public:
+
+    static const size_t nColors = 200;
+    static const size_t nColorsPos = nColors*3;
+
+    typedef std::array<unsigned char, nColorsPos> palette;
+
+    //Colors of the first labels as 32 bit pixels (0xffRRGGBB), including
+    //the generated ones after the palette. Covers any material label
+    static const size_t nLookupColors = 256;
+    typedef std::array<uint32_t, nLookupColors> lookupTable;
+
+    static palette defaultColors();
+
+    //Reads a palette file with a "index R G B" line per color.
+    //Returns false if the file can't be opened
+    static bool readColors(const char* file, palette& colors);
+
+    static lookupTable createLookupTable(const palette& colors);
+
+    //Color of labels out of the palette, generated from a hash of the label
+    //so any number of bodies can be told apart. Channels are kept away
+    //from the black used by the void
+    static inline uint32_t hashColor(const unsigned label){
+        uint32_t hash = label*0x9E3779B1u;
+        hash ^= hash >> 16;
+        hash *= 0x85EBCA6Bu;
+        hash ^= hash >> 13;
+        return 0xff000000u | (hash & 0x00ffffffu) | 0x00404040u;
+    }
+
+    //Color of any label, as a 32 bit pixel
+    static inline uint32_t labelColor(const unsigned label, const palette& colors){
+        if(label < nColors){
+            return 0xff000000u |
+                   static_cast<uint32_t>(colors[3*label  ]) << 16 |
+                   static_cast<uint32_t>(colors[3*label+1]) << 8 |
+                   static_cast<uint32_t>(colors[3*label+2]);
+        }
+        return hashColor(label);
+    }
+
+    //Writes the RGB32 image (QImage::Format_RGB32) of the frame material or
+    //body labels. Labels out of the palette are drawn with generated colors.
+    //3D frames are darkened with the distance. If 'visible' is not null, the
+    //labels found in the frame are added to it.
+    //
+    //Rows are colorized in parallel by 'scheduler', the shared pool if null.
+    //The caller only runs colorization blocks, never other queued tasks.
+    //Builds with AVX2 enabled (BUILD_VIEW_NATIVE) process 8 pixels per step
+    static void colorize(const renderFrame& frame, const bool matView,
+                         const palette& colors, uint32_t* argb,
+                         labelSet* visible = nullptr,
+                         tileScheduler* scheduler = nullptr);
+};
+
+#endif // COLORMAP_H
@@ -0,0 +1,135 @@
+#include "framecache.h"
+
+frameCache::frameCache() : bytes(0), budget(defaultBudgetMB*1024*1024), epoch(0),
+                           hits(0), misses(0), evictions(0) {}
+
+frameCache& frameCache::instance(){
+    static frameCache cache;
+    return cache;
+}
+
+size_t frameCache::frameBytes(const renderFrame& frame){
+    return frame.matImage.capacity()*sizeof(unsigned char) +
+           frame.bodyImage.capacityBytes() +
+           frame.distances.capacity()*sizeof(float);
+}
+
+bool frameCache::matches(const renderRequest& request, const renderRequest& rendered){
+
+    if(request.pPenRedViewer != rendered.pPenRedViewer ||
+       request.perspective != rendered.perspective)
+        return false;
+
+    if(request.perspective == 3){
+        //Cameras must be the same
+        return request.width3D == rendered.width3D &&
+               request.height3D == rendered.height3D &&
+               request.pixelSize3D == rendered.pixelSize3D &&
+               request.perspective3D == rendered.perspective3D &&
+               request.ortho3D == rendered.ortho3D &&
+               (!request.ortho3D || request.exactRender == rendered.exactRender) &&
+               request.camera3DX == rendered.camera3DX &&
+               request.camera3DY == rendered.camera3DY &&
+               request.camera3DZ == rendered.camera3DZ &&
+               request.u == rendered.u &&
+               request.v == rendered.v &&
+               request.w == rendered.w &&
+               request.omega == rendered.omega &&
+               request.phi3D == rendered.phi3D;
+    }
+
+    //Adaptive renders can differ from exact ones
+    if(request.width != rendered.width ||
+       request.height != rendered.height ||
+       request.pixelSize != rendered.pixelSize ||
+       request.exactRender != rendered.exactRender)
+        return false;
+
+    //Plane positions reached by different key sequences can differ
+    //in rounding errors, compare them with a fraction of the pixel size
+    const double tolerance = 1.0e-3*request.pixelSize;
+    return std::fabs(request.x - rendered.x) < tolerance &&
+           std::fabs(request.y - rendered.y) < tolerance &&
+           std::fabs(request.z - rendered.z) < tolerance;
+}
+
+renderFramePtr frameCache::find(const renderRequest& request){
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for(auto it = frames.begin(); it != frames.end(); ++it){
+        if(matches(request, (*it)->request)){
+            //Move it to the front of the list
+            frames.splice(frames.begin(), frames, it);
+            ++hits;
+            return frames.front();
+        }
+    }
+    ++misses;
+    return renderFramePtr();
+}
+
+bool frameCache::contains(const renderRequest& request){
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for(const renderFramePtr& cached : frames){
+        if(matches(request, cached->request))
+            return true;
+    }
+    return false;
+}
+
+void frameCache::insert(const renderFramePtr& frame, const unsigned long long renderEpoch){
+
+    if(!frame || frame->preview())
+        return;
+
+    const size_t size = frameBytes(*frame);
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if(size > budget || renderEpoch != epoch.load())
+        return;
+
+    //Replace the previous result of the same request, if any
+    for(auto it = frames.begin(); it != frames.end(); ++it){
+        if(matches(frame->request, (*it)->request)){
+            bytes -= frameBytes(**it);
+            frames.erase(it);
+            break;
+        }
+    }
+
+    frames.push_front(frame);
+    bytes += size;
+    evict();
+}
+
+void frameCache::evict(){
+    while(bytes > budget && !frames.empty()){
+        bytes -= frameBytes(*frames.back());
+        frames.pop_back();
+        ++evictions;
+    }
+}
+
+void frameCache::clear(){
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    frames.clear();
+    bytes = 0;
+    ++epoch;
+}
+
+void frameCache::setBudget(const size_t newBudget){
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    budget = newBudget;
+    evict();
+}
+
+size_t frameCache::readBytes(){
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return bytes;
+}
+
+size_t frameCache::readFrames(){
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return frames.size();
+}
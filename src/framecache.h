@@ -0,0 +1,88 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <cstddef>
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <list>
+
+#include "renderframe.h"
+
+//Least recently used cache of rendered frames shared by all viewers.
+//
+//Frames are matched by perspective, plane position, pixel size and
+//resolution (camera and resolution for 3D frames), so returning to a
+//previously rendered plane skips the geometry library. The cache stores
+//shared pointers to immutable frames, thus a hit costs no copy. The least
+//recently used frames are evicted when the memory budget is exceeded.
+class frameCache
+{
+
+public:
+
+    //Default memory budget, in MB
+    static const size_t defaultBudgetMB = 256;
+
+private:
+
+    std::mutex cacheMutex;
+    std::list<renderFramePtr> frames; //Most recently used first
+    size_t bytes;
+    size_t budget;
+
+    //Incremented on each clear. Frames rendered before a clear are rejected
+    std::atomic<unsigned long long> epoch;
+
+    //Profiling counters
+    std::atomic<unsigned long long> hits;
+    std::atomic<unsigned long long> misses;
+    std::atomic<unsigned long long> evictions;
+
+    void evict();
+
+public:
+
+    frameCache();
+
+    frameCache(const frameCache&) = delete;
+    frameCache& operator=(const frameCache&) = delete;
+
+    //Cache shared by all viewers
+    static frameCache& instance();
+
+    //Memory used by the frame buffers
+    static size_t frameBytes(const renderFrame& frame);
+
+    //Checks if 'frame', rendered for 'rendered', is a valid result for 'request'
+    static bool matches(const renderRequest& request, const renderRequest& rendered);
+
+    //Returns the cached frame for the request, or a null pointer on miss
+    renderFramePtr find(const renderRequest& request);
+
+    //Checks if the request is cached without updating the counters
+    //nor the frame usage order
+    bool contains(const renderRequest& request);
+
+    //Stores a complete frame rendered during the specified epoch. Previews,
+    //frames larger than the whole budget and frames rendered before the
+    //last clear are not stored
+    void insert(const renderFramePtr& frame, const unsigned long long renderEpoch);
+
+    //Removes all frames, e.g. when a new geometry is loaded
+    void clear();
+
+    //Sets the memory budget in bytes. Zero disables the cache
+    void setBudget(const size_t newBudget);
+
+    //Getter functions
+    size_t readBytes();
+    size_t readFrames();
+    inline size_t readBudget() const {return budget;}
+    inline unsigned long long readEpoch() const {return epoch.load();}
+    inline unsigned long long readHits() const {return hits.load();}
+    inline unsigned long long readMisses() const {return misses.load();}
+    inline unsigned long long readEvictions() const {return evictions.load();}
+};
+
+#endif // FRAMECACHE_H
@@ -0,0 +1,159 @@
+#include "frameprofiler.h"
+
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+const char* frameTiming::stageName(const unsigned istage){
+    static const char* names[nStages] = {"query", "colorize", "legend", "image", "scale", "repaint"};
+    return istage < nStages ? names[istage] : "unknown";
+}
+
+double frameTiming::total() const{
+    long long sum = 0;
+    for(unsigned i = 0; i < nStages; ++i){
+        if(measured(i))
+            sum += duration[i];
+    }
+    return static_cast<double>(sum)/1000.0;
+}
+
+frameProfiler::frameProfiler() : recordedFrames(0) {}
+
+frameProfiler& frameProfiler::instance(){
+    static frameProfiler profiler;
+    return profiler;
+}
+
+long long frameProfiler::now(){
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void frameProfiler::record(const unsigned source, const frameTiming& timing){
+    std::lock_guard<std::mutex> lock(profilerMutex);
+    records.push_back(frameRecord{source, recordedFrames++, timing});
+    if(records.size() > maxFrames)
+        records.pop_front();
+}
+
+void frameProfiler::clear(){
+    std::lock_guard<std::mutex> lock(profilerMutex);
+    records.clear();
+}
+
+unsigned long long frameProfiler::readRecordedFrames() const{
+    std::lock_guard<std::mutex> lock(profilerMutex);
+    return recordedFrames;
+}
+
+std::array<frameProfiler::stageStats, frameTiming::nStages>
+frameProfiler::stats(const unsigned source, const size_t window) const{
+
+    //Collect the durations of the last frames, newest first
+    std::array<std::vector<double>, frameTiming::nStages> times;
+    {
+        std::lock_guard<std::mutex> lock(profilerMutex);
+        size_t nFrames = 0;
+        for(auto it = records.rbegin(); it != records.rend() && nFrames < window; ++it){
+            if(it->source != source)
+                continue;
+            ++nFrames;
+            for(unsigned i = 0; i < frameTiming::nStages; ++i){
+                if(it->timing.measured(i))
+                    times[i].push_back(static_cast<double>(it->timing.duration[i])/1000.0);
+            }
+        }
+    }
+
+    std::array<stageStats, frameTiming::nStages> result;
+    for(unsigned i = 0; i < frameTiming::nStages; ++i){
+        std::vector<double>& t = times[i];
+        if(t.empty())
+            continue;
+        std::sort(t.begin(), t.end());
+        stageStats& s = result[i];
+        s.count = t.size();
+        for(const double d : t)
+            s.mean += d;
+        s.mean /= t.size();
+        s.p50 = t[(t.size() - 1)/2];
+        s.p95 = t[std::min(t.size() - 1, (t.size()*95)/100)];
+        s.max = t.back();
+    }
+    return result;
+}
+
+bool frameProfiler::writeTrace(const std::string& file) const{
+
+    FILE* fout = fopen(file.c_str(), "w");
+    if(fout == nullptr)
+        return false;
+
+    const char* perspectiveNames[4] = {"X", "Y", "Z", "3D"};
+
+    std::lock_guard<std::mutex> lock(profilerMutex);
+
+    //Each viewer gets two tracks, the GUI stages and the render thread
+    std::vector<unsigned> sources;
+    for(const frameRecord& r : records){
+        if(std::find(sources.begin(), sources.end(), r.source) == sources.end())
+            sources.push_back(r.source);
+    }
+
+    fprintf(fout, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    for(const unsigned source : sources){
+        fprintf(fout, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                      "\"args\": {\"name\": \"Viewer %u display\"}},\n",
+                first ? "" : ",\n", 2*source + 1, source);
+        fprintf(fout, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                      "\"args\": {\"name\": \"Viewer %u render\"}}",
+                2*source + 2, source);
+        first = false;
+    }
+
+    for(const frameRecord& r : records){
+        const frameTiming& t = r.timing;
+
+        //Frame span in the display track, from the first to the last
+        //measured stage. Queries overlap the display of the previous frame
+        long long begin = -1, end = -1;
+        for(unsigned i = 0; i < frameTiming::nStages; ++i){
+            if(!t.measured(i) || i == frameTiming::QUERY)
+                continue;
+            if(begin < 0 || t.start[i] < begin)
+                begin = t.start[i];
+            end = std::max(end, t.start[i] + t.duration[i]);
+        }
+        if(begin < 0)
+            continue;
+
+        char args[256];
+        snprintf(args, sizeof(args),
+                 "{\"frame\": %llu, \"view\": \"%s\", \"width\": %u, \"height\": %u, "
+                 "\"preview\": %s, \"cached\": %s}",
+                 r.index, perspectiveNames[std::min(t.perspective, 3u)], t.width, t.height,
+                 t.preview ? "true" : "false", t.cached ? "true" : "false");
+
+        fprintf(fout, "%s{\"name\": \"frame\", \"cat\": \"frame\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+                      "\"ts\": %lld, \"dur\": %lld, \"args\": %s}",
+                first ? "" : ",\n", 2*r.source + 1, begin, end - begin, args);
+        first = false;
+
+        for(unsigned i = 0; i < frameTiming::nStages; ++i){
+            if(!t.measured(i))
+                continue;
+            const unsigned tid = i == frameTiming::QUERY ? 2*r.source + 2 : 2*r.source + 1;
+            fprintf(fout, ",\n{\"name\": \"%s\", \"cat\": \"stage\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+                          "\"ts\": %lld, \"dur\": %lld, \"args\": %s}",
+                    frameTiming::stageName(i), tid, t.start[i], t.duration[i], args);
+        }
+    }
+    fprintf(fout, "\n]}\n");
+
+    const bool ok = ferror(fout) == 0;
+    fclose(fout);
+    return ok;
+}
@@ -0,0 +1,106 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <cstddef>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <string>
+
+//Time spent by a displayed frame on each stage of the pipeline. Times
+//are taken with the profiler clock, in microseconds, and stages not
+//executed by the frame have a negative start.
+struct frameTiming{
+
+    enum stage{
+        QUERY,    //Geometry queries, in the render thread
+        COLORIZE, //Label to color conversion
+        LEGEND,   //Key HTML generation
+        IMAGE,    //Image setup over the color buffer
+        SCALE,    //Display update, scaling is done on repaint
+        REPAINT,  //Scaled image and axes painting
+        nStages
+    };
+
+    static const char* stageName(const unsigned istage);
+
+    std::array<long long, nStages> start;
+    std::array<long long, nStages> duration;
+
+    unsigned perspective = 0;
+    unsigned width = 0, height = 0;
+    bool preview = false;
+    bool cached = false; //Taken from the frame cache, no queries
+    unsigned long long rays = 0; //Rays traced by adaptive 3D renders
+
+    frameTiming(){
+        start.fill(-1);
+        duration.fill(0);
+    }
+
+    inline void set(const stage istage, const long long begin, const long long end){
+        start[istage] = begin;
+        duration[istage] = end - begin;
+    }
+
+    inline bool measured(const unsigned istage) const {return start[istage] >= 0;}
+
+    //Sum of all stages, in ms
+    double total() const;
+};
+
+//Keeps the timings of the last displayed frames of all viewers, providing
+//rolling statistics and the export to the Chrome trace event format,
+//which can be opened with chrome://tracing or Perfetto.
+class frameProfiler
+{
+
+public:
+
+    //Frames kept for the trace
+    static const size_t maxFrames = 4096;
+
+    //Statistics of a stage over the last frames, in ms
+    struct stageStats{
+        size_t count = 0;
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double max = 0.0;
+    };
+
+private:
+
+    struct frameRecord{
+        unsigned source; //Viewer identifier
+        unsigned long long index;
+        frameTiming timing;
+    };
+
+    mutable std::mutex profilerMutex;
+    std::deque<frameRecord> records;
+    unsigned long long recordedFrames;
+
+    frameProfiler();
+
+public:
+
+    static frameProfiler& instance();
+
+    //Microseconds since the program start
+    static long long now();
+
+    void record(const unsigned source, const frameTiming& timing);
+    void clear();
+
+    //Statistics of each stage over the last 'window' frames of 'source'
+    std::array<stageStats, frameTiming::nStages> stats(const unsigned source,
+                                                       const size_t window) const;
+
+    //Writes the kept frames as trace events. Returns false on error
+    bool writeTrace(const std::string& file) const;
+
+    unsigned long long readRecordedFrames() const;
+};
+
+#endif // FRAMEPROFILER_H
@@ -0,0 +1,35 @@
+#include "geometryconfig.h"
+
+#include <cstdio>
+
+bool geometryConfig::write(const std::string& type, const std::string& geometryFile,
+                           const std::string& configFile){
+
+    if(type != "quadric" && type != "mesh")
+        return false;
+
+    FILE* fout = fopen(configFile.c_str(), "w");
+    if(fout == nullptr)
+        return false;
+    if(type == "quadric"){
+        fprintf(fout,"type \"PEN_QUADRIC\"\n");
+        fprintf(fout,"input-file \"%s\"\n", geometryFile.c_str());
+        fprintf(fout,"processed-geo-file \"report.geo\"\n");
+    }else{
+        fprintf(fout,"type \"MESH_BODY\"\n");
+        fprintf(fout,"input-file \"%s\"\n", geometryFile.c_str());
+    }
+    return fclose(fout) == 0;
+}
+
+std::string geometryConfig::prepare(const std::string& type, const std::string& geometryFile,
+                                    const std::string& suffix){
+
+    if(type == "config")
+        return geometryFile;
+
+    const std::string configFile = (type == "quadric" ? "quadConf" : "triMeshConf") + suffix + ".txt";
+    if(!write(type, geometryFile, configFile))
+        return std::string();
+    return configFile;
+}
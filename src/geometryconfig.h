@@ -0,0 +1,27 @@
+#ifndef GEOMETRYCONFIG_H
+#define GEOMETRYCONFIG_H
+
+#include <string>
+
+//Configuration files used to load quadric and triangular mesh geometry
+//files through the geometry library. The main window, the command line
+//renderer and the benchmarks write the same default configuration.
+class geometryConfig{
+
+public:
+
+    //Writes the default configuration of the geometry file to 'configFile'.
+    //The type is "quadric" or "mesh". Returns false if the file can't be written
+    static bool write(const std::string& type, const std::string& geometryFile,
+                      const std::string& configFile);
+
+    //Returns the configuration file to load a geometry of the specified type,
+    //"config", "quadric" or "mesh". Configuration files are returned as they
+    //are, and the default configuration of the rest of files is written to
+    //"quadConf<suffix>.txt" or "triMeshConf<suffix>.txt". Returns an empty
+    //string on errors
+    static std::string prepare(const std::string& type, const std::string& geometryFile,
+                               const std::string& suffix = std::string());
+};
+
+#endif // GEOMETRYCONFIG_H
@@ -7,7 +7,11 @@ MainWindow::MainWindow(QWidget *parent)
       penRedViewer(nullptr),
       constructViewer(nullptr),
       destroyViewer(nullptr),
-      width3D(400), height3D(400), pixelSize3D(0.1)
+      shownKeyVersion(0),
+      posterProgress(nullptr),
+      posterRequest(0),
+      posterRows(0),
+      posterHeight(0)
 {
     //Init viewer colors
     viewer::resetColors();
@@ -23,6 +27,18 @@ MainWindow::MainWindow(QWidget *parent)
     ui->perspectiveSelector->addItem("Y");   //1
     ui->perspectiveSelector->addItem("Z");   //2
     ui->perspectiveSelector->addItem("3D");  //3
+    ui->perspectiveSelector->addItem("3D ortho");  //4
+
+    //Set the frame cache budget
+    ui->cacheBudgetEdit->setValue(frameCache::defaultBudgetMB);
+
+    //Refresh the frame timing statistics periodically
+    connect(&timingTimer, &QTimer::timeout, this, &MainWindow::updateTimings);
+    timingTimer.start(500);
+
+    //Poster exports run in another thread while the window is responsive
+    connect(&posterTimer, &QTimer::timeout, this, &MainWindow::updatePosterProgress);
+    connect(&posterWatcher, &QFutureWatcher<bool>::finished, this, &MainWindow::finishPoster);
 
     //Configure save dialog
     QList<QUrl> urls;
@@ -52,16 +68,6 @@ MainWindow::MainWindow(QWidget *parent)
     loadMeshDialog.setAcceptMode(QFileDialog::AcceptOpen);
     connect(&loadMeshDialog, &QFileDialog::fileSelected, this, &MainWindow::on_loadMesh);
 
-    //Initialize buffers
-    for(auto& buffer : buffers)
-        buffer.resize(viewer::maxPixels*3);
-    for(auto& matImage : matImages)
-        matImage.resize(viewer::maxPixels);
-    for(auto& bodyImage : bodyImages)
-        bodyImage.resize(viewer::maxPixels);
-    for(auto& distance : distances)
-        distance.resize(viewer::maxPixels);
-
     //** Try to create a penRed viewer **//
 
     QString libPath = QCoreApplication::applicationDirPath() + "/libgeoView_C";
@@ -79,8 +85,7 @@ MainWindow::MainWindow(QWidget *parent)
             //Instance a viewer
             penRedViewer = constructViewer() ;
 
-            //Set resolution 3D
-            penRedViewer->set3DResolution(width3D, height3D, pixelSize3D, pixelSize3D, 0.3490658503988659);
+            //The 3D resolution of each viewer is set by its render thread
         }else{
             printf("Unable to load the viewer constructor function 'pen_geoView_new'\n");
         }
@@ -341,6 +346,10 @@ void MainWindow::changeViewerColors(){
 
 MainWindow::~MainWindow()
 {
+    //Stop the poster export in progress, which uses the geometry library
+    posterRequest = 1;
+    posterWatcher.waitForFinished();
+
     //Delete viewers
     for(auto& viewer : viewersArray)
         delete viewer;
@@ -363,6 +372,9 @@ void MainWindow::on_saveImage(const QString &file){
 void MainWindow::on_loadConfig(const QString &file){
     printf("Loading geometry from configuration '%s'", file.toStdString().c_str());
 
+    //Renders must not use the library while it is initialized
+    stopViewers();
+
     //Initialize the viewer in another thread
     QFuture<int> future = QtConcurrent::run([this, file]{
 
@@ -414,6 +426,7 @@ void MainWindow::on_loadConfig(const QString &file){
     }
 
     //Emit load signal
+    viewer::loadBodyNames(penRedViewer);
     emit geometryLoad();
 }
 
@@ -421,12 +434,13 @@ void MainWindow::on_loadQuadric(const QString &file){
     printf("Loading quadric geometry from file '%s'", file.toStdString().c_str());
 
     //Write a default configuration file
-    FILE* fout = nullptr;
-    fout = fopen("quadConf.txt","w");
-    fprintf(fout,"type \"PEN_QUADRIC\"\n");
-    fprintf(fout,"input-file \"%s\"\n", file.toStdString().c_str());
-    fprintf(fout,"processed-geo-file \"report.geo\"\n");
-    fclose(fout);
+    if(!geometryConfig::write("quadric", file.toStdString(), "quadConf.txt")){
+        printf("\nUnable to write the configuration file 'quadConf.txt'\n");
+        return;
+    }
+
+    //Renders must not use the library while it is initialized
+    stopViewers();
 
     //Initialize the viewer
     QFuture<int> future = QtConcurrent::run([this]{
@@ -478,6 +492,7 @@ void MainWindow::on_loadQuadric(const QString &file){
     }
 
     //Emit load signal
+    viewer::loadBodyNames(penRedViewer);
     emit geometryLoad();
 }
 
@@ -485,12 +500,13 @@ void MainWindow::on_loadMesh(const QString &file){
     printf("Loading triangular mesh geometry from file '%s'", file.toStdString().c_str());
 
     //Write a default configuration file
-    FILE* fout = nullptr;
-    fout = fopen("triMeshConf.txt","w");
-    fprintf(fout,"type \"MESH_BODY\"\n");
-    fprintf(fout,"input-file \"%s\"\n", file.toStdString().c_str());
-    //fprintf(fout,"report-file \"report.geo\"\n");
-    fclose(fout);
+    if(!geometryConfig::write("mesh", file.toStdString(), "triMeshConf.txt")){
+        printf("\nUnable to write the configuration file 'triMeshConf.txt'\n");
+        return;
+    }
+
+    //Renders must not use the library while it is initialized
+    stopViewers();
 
     //Initialize the viewer
     QFuture<int> future = QtConcurrent::run([this]{
@@ -542,6 +558,7 @@ void MainWindow::on_loadMesh(const QString &file){
     }
 
     //Emit load signal
+    viewer::loadBodyNames(penRedViewer);
     emit geometryLoad();
 }
 
@@ -571,13 +588,25 @@ void MainWindow::updateViewerInfo(){
         ui->matBodyViewButton->setChecked(false);
     }
 
-    ui->perspectiveSelector->setCurrentIndex(pviewer->readPerspective());
+    ui->exactRenderBox->setChecked(pviewer->readExactRender());
+    ui->progressiveRenderBox->setChecked(pviewer->readProgressiveRender());
+    ui->prefetchEdit->setValue(pviewer->readPrefetchPlanes());
+    ui->timingOverlayBox->setChecked(pviewer->readShowTimings());
+
+    if(pviewer->readPerspective() == 3 && pviewer->readOrtho3D())
+        ui->perspectiveSelector->setCurrentIndex(4);
+    else
+        ui->perspectiveSelector->setCurrentIndex(pviewer->readPerspective());
 
     ui->resolutionEditX->setValue(pviewer->readImageWidth());
     ui->resolutionEditY->setValue(pviewer->readImageHeight());
 
     ui->pixelSizeEdit->setValue(pviewer->readPixelSize());
 
+    ui->resolutionH3D->setValue(pviewer->readImage3DWidth());
+    ui->resolutionV3D->setValue(pviewer->readImage3DHeight());
+    ui->pixelSize3D->setValue(pviewer->readPixelSize3D());
+
     ui->rhoEdit->setText(QString::number(pviewer->readRho(), 'e', 4));
     ui->thetaEdit->setText(QString::number(pviewer->readTheta(), 'f', 5));
     ui->phiEdit->setText(QString::number(pviewer->readPhi(), 'f', 5));
@@ -590,14 +619,44 @@ void MainWindow::updateViewerInfo(){
 }
 
 void MainWindow::updateKey(){
-    ui->keyText->setHtml(viewersArray[activeViewer]->readKeyText());
+    //Parse the key only when it has changed
+    const unsigned long long version = viewersArray[activeViewer]->readKeyVersion();
+    if(version == shownKeyVersion)
+        return;
+    const viewer* pviewer = viewersArray[activeViewer];
+    ui->keyText->setHtml(pviewer->readKeyText());
+    shownKeyVersion = version;
+
+    //Geometries with many labels are shown in pages
+    const unsigned page = pviewer->readKeyPage();
+    const unsigned nPages = pviewer->readKeyPages();
+    ui->keyPageLabel->setText(QString("Page %1/%2 (%3 labels)").arg(page + 1).arg(nPages)
+                              .arg(static_cast<qulonglong>(pviewer->readVisibleLabels())));
+    ui->keyPrevButton->setEnabled(page > 0);
+    ui->keyNextButton->setEnabled(page + 1 < nPages);
+}
+
+void MainWindow::on_keyPrevButton_released(){
+    viewer* pviewer = viewersArray[activeViewer];
+    if(pviewer != nullptr && pviewer->readKeyPage() > 0){
+        pviewer->setKeyPage(pviewer->readKeyPage() - 1);
+        updateKey();
+    }
+}
+
+void MainWindow::on_keyNextButton_released(){
+    viewer* pviewer = viewersArray[activeViewer];
+    if(pviewer != nullptr && pviewer->readKeyPage() + 1 < pviewer->readKeyPages()){
+        pviewer->setKeyPage(pviewer->readKeyPage() + 1);
+        updateKey();
+    }
 }
 
 void MainWindow::createViewer(const size_t index){
 
     if(index < maxViewers){
         //Create a new viewer
-        viewer* newViewer = new viewer(buffers[index], matImages[index], bodyImages[index], distances[index]);
+        viewer* newViewer = new viewer;
         if(viewersArray[index] != nullptr)
             delete viewersArray[index];
         viewersArray[index] = newViewer;
@@ -614,16 +673,23 @@ void MainWindow::createViewer(const size_t index){
         connect(this, &MainWindow::geometryLoad, newViewer, &viewer::geometryLoad);
         //Connect viewer changed signal
         connect(newViewer, &viewer::changed, this, &MainWindow::on_viewerChanged);
-        //Connect viewer zoom in 3D signal
-        connect(newViewer, &viewer::zoomIn3D, this, &MainWindow::on_zoomIn3D);
-        //Connect viewer zoom out 3D signal
-        connect(newViewer, &viewer::zoomOut3D, this, &MainWindow::on_zoomOut3D);
+        //Connect viewer rendered signal
+        connect(newViewer, &viewer::rendered, this, &MainWindow::on_viewerRendered);
 
         //Hide viewer
         newViewer->hide();
     }
 }
 
+void MainWindow::stopViewers(){
+    //Cancel the renders and prefetches of all viewers, and wait
+    //until they finish. Viewers render again on the geometry load
+    for(viewer* v : viewersArray){
+        if(v != nullptr)
+            v->geometryUnload();
+    }
+}
+
 void MainWindow::on_Xedit_editingFinished()
 {
     double value = ui->Xedit->text().toDouble();
@@ -670,10 +736,37 @@ void MainWindow::on_matBodyViewButton_released()
     }
 }
 
+void MainWindow::on_exactRenderBox_toggled(bool checked)
+{
+    if(viewersArray[activeViewer] != nullptr &&
+       viewersArray[activeViewer]->readExactRender() != checked){
+        viewersArray[activeViewer]->setExactRender(checked);
+    }
+}
+
+void MainWindow::on_progressiveRenderBox_toggled(bool checked)
+{
+    if(viewersArray[activeViewer] != nullptr)
+        viewersArray[activeViewer]->setProgressiveRender(checked);
+}
+
+void MainWindow::on_prefetchEdit_valueChanged(int arg1)
+{
+    if(viewersArray[activeViewer] != nullptr &&
+       viewersArray[activeViewer]->readPrefetchPlanes() != static_cast<unsigned>(arg1)){
+        viewersArray[activeViewer]->setPrefetchPlanes(arg1);
+    }
+}
+
+void MainWindow::on_cacheBudgetEdit_valueChanged(int arg1)
+{
+    //The cache is shared by all viewers
+    frameCache::instance().setBudget(static_cast<size_t>(arg1)*1024*1024);
+}
 
 void MainWindow::on_perspectiveSelector_currentIndexChanged(int index)
 {
-    if(index >= 0 && index < 4){
+    if(index >= 0 && index < 5){
         if(viewersArray[activeViewer] != nullptr){
             viewersArray[activeViewer]->setPerspective(index);
             updateKey();
@@ -698,19 +791,35 @@ void MainWindow::on_viewerChanged(viewer* pviewer){
         updateViewerInfo();
 }
 
-void MainWindow::on_zoomIn3D(){
-    pixelSize3D *= 0.9;
-    if(pixelSize3D < 0.00001)
-        pixelSize3D = 0.00001;
+void MainWindow::on_viewerRendered(viewer* pviewer){
+    //Renders finish asynchronously, update the key of the new frame
+    if(pviewer == viewersArray[activeViewer]){
+        updateKey();
 
-    ui->pixelSize3D->setValue(pixelSize3D);
-    update3Dresolution();
-}
+        //Memory allocated by all viewers
+        size_t viewersBytes = 0;
+        for(const viewer* v : viewersArray){
+            if(v != nullptr)
+                viewersBytes += v->readMemoryUsage();
+        }
 
-void MainWindow::on_zoomOut3D(){
-    pixelSize3D *= 1.1;
-    ui->pixelSize3D->setValue(pixelSize3D);
-    update3Dresolution();
+        //Show render profiling counters
+        frameCache& cache = frameCache::instance();
+        ui->statusbar->showMessage(QString("Frames: %1 rendered, %2 dropped, %3 cancelled, %4 prefetched | "
+                                           "Cache: %5 hits, %6 misses, %7 evictions, %8 frames, %9/%10 MB | "
+                                           "Viewers: %11 MB")
+                                   .arg(pviewer->readRenderedFrames())
+                                   .arg(pviewer->readDroppedFrames())
+                                   .arg(pviewer->readCancelledFrames())
+                                   .arg(pviewer->readPrefetchedFrames())
+                                   .arg(cache.readHits())
+                                   .arg(cache.readMisses())
+                                   .arg(cache.readEvictions())
+                                   .arg(static_cast<qulonglong>(cache.readFrames()))
+                                   .arg(static_cast<qulonglong>(cache.readBytes()/(1024*1024)))
+                                   .arg(static_cast<qulonglong>(cache.readBudget()/(1024*1024)))
+                                   .arg(static_cast<qulonglong>(viewersBytes/(1024*1024))));
+    }
 }
 
 void MainWindow::on_resolutionEditY_valueChanged(int arg1)
@@ -740,6 +849,54 @@ void MainWindow::on_pixelSizeEdit_valueChanged(double arg1)
 }
 
 
+void MainWindow::on_timingOverlayBox_toggled(bool checked)
+{
+    if(viewersArray[activeViewer] != nullptr)
+        viewersArray[activeViewer]->setShowTimings(checked);
+}
+
+void MainWindow::on_saveTraceButton_released()
+{
+    QString file = QFileDialog::getSaveFileName(this, "Save frame trace", "frames.json",
+                                                "Trace files (*.json)");
+    if(file.isEmpty())
+        return;
+
+    if(frameProfiler::instance().writeTrace(file.toStdString()))
+        ui->statusbar->showMessage(QString("Frame trace saved to '%1'").arg(file));
+    else
+        ui->statusbar->showMessage(QString("Unable to write frame trace '%1'").arg(file));
+}
+
+void MainWindow::updateTimings(){
+
+    //Refresh only when the panel is visible
+    if(viewersArray[activeViewer] == nullptr ||
+       ui->tabWidget->currentWidget() != ui->timingTab)
+        return;
+
+    //Statistics of the last frames of the active viewer
+    const unsigned window = 120;
+    const auto stats = frameProfiler::instance().stats(viewersArray[activeViewer]->readProfileId(), window);
+
+    QString text = QString("<p>Last %1 frames, times in ms</p>\n<table>\n"
+                           " <tr><th align=\"left\">Stage</th><th>Frames</th><th>Mean</th>"
+                           "<th>p50</th><th>p95</th><th>Max</th></tr>\n").arg(window);
+    for(unsigned i = 0; i < frameTiming::nStages; ++i){
+        const frameProfiler::stageStats& s = stats[i];
+        text.append(QString(" <tr><td>%1</td><td align=\"right\">%2</td><td align=\"right\">%3</td>"
+                            "<td align=\"right\">%4</td><td align=\"right\">%5</td><td align=\"right\">%6</td></tr>\n")
+                    .arg(frameTiming::stageName(i))
+                    .arg(static_cast<qulonglong>(s.count))
+                    .arg(s.mean, 0, 'f', 2)
+                    .arg(s.p50, 0, 'f', 2)
+                    .arg(s.p95, 0, 'f', 2)
+                    .arg(s.max, 0, 'f', 2));
+    }
+    text.append("</table>");
+    ui->timingOutput->setHtml(text);
+}
+
 void MainWindow::on_testButton_released()
 {
     ui->testOutput->setText("");
@@ -806,33 +963,30 @@ void MainWindow::on_lookZ_editingFinished()
     }
 }
 
-void MainWindow::update3Dresolution(){
-
-    if(penRedViewer != nullptr){
-        penRedViewer->set3DResolution(width3D, height3D, pixelSize3D, pixelSize3D, 0.3490658503988659);
-        for(auto& viewer : viewersArray)
-            viewer->update3D(width3D,height3D,pixelSize3D);
-    }
-}
-
 void MainWindow::on_pixelSize3D_valueChanged(double arg1)
 {
-    pixelSize3D = arg1;
-    update3Dresolution();
+    if(viewersArray[activeViewer] != nullptr){
+        viewersArray[activeViewer]->setPixelSize3D(arg1);
+        updateKey();
+    }
 }
 
 
 void MainWindow::on_resolutionH3D_valueChanged(int arg1)
 {
-    width3D = arg1;
-    update3Dresolution();
+    if(viewersArray[activeViewer] != nullptr){
+        viewersArray[activeViewer]->setImage3DWidth(arg1);
+        updateKey();
+    }
 }
 
 
 void MainWindow::on_resolutionV3D_valueChanged(int arg1)
 {
-    height3D = arg1;
-    update3Dresolution();
+    if(viewersArray[activeViewer] != nullptr){
+        viewersArray[activeViewer]->setImage3DHeight(arg1);
+        updateKey();
+    }
 }
 
 void MainWindow::on_rhoEdit_editingFinished()
@@ -895,6 +1049,81 @@ void MainWindow::on_actionSave_triggered()
     saveDialog.exec();
 }
 
+void MainWindow::on_actionPoster_triggered()
+{
+    //One poster is exported at a time
+    if(posterWatcher.isRunning())
+        return;
+
+    viewer* active = viewersArray[activeViewer];
+    if(active == nullptr)
+        return;
+    if(active->readPerspective() == 3){
+        QMessageBox::information(this, "Export poster", "Posters can only be exported from 2D views");
+        return;
+    }
+
+    //The poster covers the displayed region with a finer pixel size
+    bool ok;
+    const int scale = QInputDialog::getInt(this, "Export poster",
+                                           QString("Resolution scale of the displayed %1x%2 image")
+                                               .arg(active->readImageWidth())
+                                               .arg(active->readImageHeight()),
+                                           4, 1, 100, 1, &ok);
+    if(!ok)
+        return;
+    const QString file = QFileDialog::getSaveFileName(this, "Export poster", QString(),
+                                                      "Images (*.png *.tif *.tiff)");
+    if(file.isEmpty())
+        return;
+
+    const renderRequest request = active->createPosterRequest(static_cast<unsigned>(scale));
+    const bool matView = active->readMatView();
+    const colorMap::palette colors = viewer::colors;
+    printf("Exporting %ux%u poster to: %s\n", request.width, request.height, file.toStdString().c_str());
+    fflush(stdout);
+
+    //Render in another thread. Cancelling changes the latest request
+    //identifier, which stops the render at the next tile
+    posterRequest = 0;
+    posterRows = 0;
+    posterHeight = request.height;
+    posterWatcher.setFuture(QtConcurrent::run([this, request, matView, colors, file]{
+        return posterRenderer::render(request, matView, colors, file.toStdString(),
+                                      cancelToken(posterRequest, 0), nullptr,
+                                      sliceRenderer::requestScheduler(request), &posterRows);
+    }));
+
+    posterProgress = new QProgressDialog("Exporting poster", "Cancel", 0, static_cast<int>(request.height), this);
+    posterProgress->setWindowModality(Qt::WindowModal);
+    posterProgress->setMinimumDuration(0);
+    connect(posterProgress, &QProgressDialog::canceled, this, [this]{ posterRequest = 1; });
+    posterTimer.start(100);
+}
+
+void MainWindow::updatePosterProgress(){
+    //The dialog closes itself when the maximum is reached
+    if(posterProgress != nullptr && posterHeight > 0)
+        posterProgress->setValue(static_cast<int>(std::min(posterRows.load(), posterHeight - 1)));
+}
+
+void MainWindow::finishPoster(){
+    posterTimer.stop();
+
+    //Closing the dialog emits 'canceled', check the state before
+    const bool cancelled = posterRequest.load() != 0;
+    if(posterProgress != nullptr){
+        posterProgress->close();
+        posterProgress->deleteLater();
+        posterProgress = nullptr;
+    }
+
+    if(!posterWatcher.result() && !cancelled){
+        QMessageBox::warning(this, "Export poster", "Unable to export the poster",
+                             QMessageBox::Ok);
+    }
+}
+
 
 void MainWindow::on_actionAdd_triggered()
 {
@@ -906,9 +1135,11 @@ void MainWindow::on_actionAdd_triggered()
             if(!viewersArray[i]->isVisible()){
                 //Show it
                 viewersArray[i]->show();
-                //Try to copy from selected viewer
+                //Try to copy from selected viewer, and render it again,
+                //as its buffers were released when it was deleted
                 if(viewersArray[activeViewer] != nullptr){
                     viewersArray[i]->copy(*(viewersArray[activeViewer]));
+                    viewersArray[i]->render();
                 }
                 break;
             }
@@ -924,8 +1155,9 @@ void MainWindow::on_actionDelete_triggered()
 {
     if(nViewers > 1){
 
-        //Hide viewer
+        //Hide viewer and free its frames
         viewersArray[activeViewer]->hide();
+        viewersArray[activeViewer]->releaseBuffers();
         //Reset active viewer to first non hide viewer
         for(size_t i = 0; i < maxViewers; ++i)
             if(viewersArray[i]->isVisible())
@@ -16,11 +16,16 @@
 #include <QDialogButtonBox>
 #include <QColorDialog>
 #include <QFuture>
+#include <QFutureWatcher>
 #include <QtConcurrent>
 #include <QMessageBox>
 #include <QProgressBar>
 #include <QProgressDialog>
+#include <QInputDialog>
+#include <QTimer>
 #include "viewer.h"
+#include "posterrender.h"
+#include "geometryconfig.h"
 #include "pen_geoViewInterface.hh"
 
 QT_BEGIN_NAMESPACE
@@ -45,6 +50,8 @@ private slots:
 
     void on_viewerChanged(viewer*);
 
+    void on_viewerRendered(viewer*);
+
     void on_saveImage(const QString &file);
 
     void on_loadConfig(const QString &file);
@@ -53,10 +60,6 @@ private slots:
 
     void on_loadMesh(const QString &file);
 
-    void on_zoomIn3D();
-
-    void on_zoomOut3D();
-
     void on_Xedit_editingFinished();
 
     void on_Yedit_editingFinished();
@@ -65,6 +68,14 @@ private slots:
 
     void on_matBodyViewButton_released();
 
+    void on_exactRenderBox_toggled(bool checked);
+
+    void on_progressiveRenderBox_toggled(bool checked);
+
+    void on_prefetchEdit_valueChanged(int arg1);
+
+    void on_cacheBudgetEdit_valueChanged(int arg1);
+
     void on_perspectiveSelector_currentIndexChanged(int index);
 
     void on_resolutionEditY_valueChanged(int arg1);
@@ -75,6 +86,13 @@ private slots:
 
     void on_testButton_released();
 
+    void on_timingOverlayBox_toggled(bool checked);
+
+    void on_saveTraceButton_released();
+
+    void on_keyPrevButton_released();
+    void on_keyNextButton_released();
+
     void on_lookX_editingFinished();
 
     void on_lookY_editingFinished();
@@ -101,6 +119,8 @@ private slots:
 
     void on_actionSave_triggered();
 
+    void on_actionPoster_triggered();
+
     void on_actionAdd_triggered();
 
     void on_actionDelete_triggered();
@@ -115,11 +135,6 @@ signals:
 
 private:
 
-    std::array<std::vector<uchar>,maxViewers> buffers;
-    std::array<std::vector<unsigned char>,maxViewers> matImages;
-    std::array<std::vector<unsigned int>,maxViewers> bodyImages;
-    std::array<std::vector<float>,maxViewers> distances;
-
     pen_geoViewInterface* penRedViewer;
     QLibrary viewerLib;
 
@@ -139,9 +154,19 @@ private:
 
     unsigned nViewers;
     unsigned activeViewer;
+    unsigned long long shownKeyVersion; //Key displayed in 'keyText'
+
+    //Refreshes the frame timing statistics
+    QTimer timingTimer;
 
-    unsigned width3D, height3D;
-    double pixelSize3D;
+    //Poster export running in another thread, with its progress dialog.
+    //Changing 'posterRequest' cancels it at the next tile
+    QFutureWatcher<bool> posterWatcher;
+    QProgressDialog* posterProgress;
+    QTimer posterTimer; //Refreshes the export progress
+    std::atomic<unsigned long long> posterRequest;
+    std::atomic<unsigned> posterRows; //Rows written
+    unsigned posterHeight;
 
     Ui::MainWindow *ui;
 
@@ -149,7 +174,10 @@ private:
     void updateViewerInfo();
     void updateKey();
     void createViewer(const size_t index);
-    void update3Dresolution();
+    void stopViewers();
+    void updateTimings();
+    void updatePosterProgress();
+    void finishPoster();
     void changeViewerColors();
 
     inline void resetViewerColors(){
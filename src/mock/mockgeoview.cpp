@@ -0,0 +1,676 @@
+#include "mockgeoview.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+//Runs 'func(row0,row1)' over 'nrows' rows split among 'nthreads' threads
+static void parallelRows(const unsigned nthreads, const unsigned nrows,
+                         const std::function<void(unsigned,unsigned)>& func){
+
+    const unsigned nt = std::max(1u, std::min(nthreads, nrows));
+    if(nt == 1){
+        func(0, nrows);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(nt-1);
+    const unsigned rowsPerThread = (nrows + nt - 1)/nt;
+    for(unsigned it = 1; it < nt; ++it){
+        const unsigned row0 = std::min(nrows, it*rowsPerThread);
+        const unsigned row1 = std::min(nrows, row0 + rowsPerThread);
+        threads.emplace_back(func, row0, row1);
+    }
+    func(0, std::min(nrows, rowsPerThread));
+    for(std::thread& t : threads)
+        t.join();
+}
+
+//Converts plane coordinates of the plane 'iplane' to space coordinates
+static inline void planeToSpace(const unsigned iplane, const double h, const double v,
+                                const double x, const double y, const double z,
+                                double p[3]){
+    p[0] = x;
+    p[1] = y;
+    p[2] = z;
+    switch(iplane){
+    case 0: p[1] += h; p[2] += v; break; //X plane, (y,z)
+    case 1: p[0] += h; p[2] += v; break; //Y plane, (x,z)
+    default: p[0] += h; p[1] += v; break; //Z plane, (x,y)
+    }
+}
+
+mockGeoView::mockGeoView(){
+    setDefaults();
+    updateScene();
+    nx3D = ny3D = 500;
+    dx3D = dy3D = 0.1f;
+    perspective3D = 0.3490658503988659f;
+}
+
+void mockGeoView::setDefaults(){
+    scene = SPHERES;
+    nSpheres = 5;
+    sphereRadius = 10.0;
+    latticeN[0] = latticeN[1] = latticeN[2] = 16;
+    latticePitch = 2.0;
+    latticeRadius = 0.8;
+    nMaterials = 8;
+    pointLatency = 0.0;
+    callLatency = 0.0;
+}
+
+unsigned mockGeoView::getBodies() const{
+    if(scene == SPHERES)
+        return 1 + nSpheres;
+    return 1 + latticeN[0]*latticeN[1]*latticeN[2];
+}
+
+std::string mockGeoView::getBodyName(const unsigned ibody) const{
+    if(ibody == 0)
+        return "enclosure";
+    if(ibody >= getBodies())
+        return "void";
+    if(scene == SPHERES)
+        return "sphere_" + std::to_string(ibody);
+
+    const unsigned index = ibody - 1;
+    const unsigned ix = index % latticeN[0];
+    const unsigned iy = (index / latticeN[0]) % latticeN[1];
+    const unsigned iz = index / (latticeN[0]*latticeN[1]);
+    return "cell_" + std::to_string(ix) + "_" + std::to_string(iy) + "_" + std::to_string(iz);
+}
+
+unsigned mockGeoView::bodyMaterial(const unsigned ibody) const{
+    if(ibody == 0 || ibody >= getBodies())
+        return 0;
+    return 1 + (ibody - 1) % nMaterials;
+}
+
+unsigned mockGeoView::locate(const double x, const double y, const double z) const{
+
+    if(std::fabs(x) > enclosure || std::fabs(y) > enclosure || std::fabs(z) > enclosure)
+        return getBodies();
+
+    if(scene == SPHERES){
+        //Sphere k, from 1 to n, has radius R*(n-k+1)/n. The body is
+        //the number of spheres containing the point
+        const double r = std::sqrt(x*x + y*y + z*z);
+        const double s = static_cast<double>(nSpheres) + 1.0 - r*nSpheres/sphereRadius;
+        if(s <= 1.0)
+            return 0;
+        return std::min(nSpheres, static_cast<unsigned>(std::ceil(s)) - 1);
+    }
+
+    const double p[3] = {x, y, z};
+    long index[3];
+    double dist2 = 0.0;
+    for(unsigned a = 0; a < 3; ++a){
+        index[a] = std::lround((p[a] - latticeOrigin[a])/latticePitch);
+        if(index[a] < 0 || index[a] >= static_cast<long>(latticeN[a]))
+            return 0;
+        const double d = p[a] - (latticeOrigin[a] + index[a]*latticePitch);
+        dist2 += d*d;
+    }
+    if(dist2 >= latticeRadius*latticeRadius)
+        return 0;
+    return 1 + static_cast<unsigned>(index[0] + latticeN[0]*(index[1] + latticeN[1]*index[2]));
+}
+
+void mockGeoView::updateScene(){
+
+    //Spheres must fit in their lattice cell
+    latticeRadius = std::min(latticeRadius, 0.5*latticePitch);
+    for(unsigned a = 0; a < 3; ++a)
+        latticeOrigin[a] = -0.5*(latticeN[a] - 1)*latticePitch;
+
+    if(scene == SPHERES){
+        enclosure = 1.2*sphereRadius;
+    }else{
+        const unsigned nMax = std::max(latticeN[0], std::max(latticeN[1], latticeN[2]));
+        enclosure = 0.5*(nMax + 1)*latticePitch;
+    }
+}
+
+void mockGeoView::wait(const double ns) const{
+
+    if(ns <= 0.0)
+        return;
+
+    const auto end = std::chrono::steady_clock::now() +
+            std::chrono::nanoseconds(static_cast<long long>(ns));
+    while(std::chrono::steady_clock::now() < end){}
+}
+
+int mockGeoView::init(const char* filename, const unsigned verbose){
+
+    FILE* f = fopen(filename, "r");
+    if(f == nullptr){
+        printf("mockGeoView: Unable to open '%s'\n", filename);
+        return -1;
+    }
+
+    setDefaults();
+
+    char line[1024];
+    unsigned nline = 0;
+    int err = 0;
+    while(fgets(line, sizeof(line), f) != nullptr){
+        ++nline;
+
+        //Remove comments
+        char* comment = strchr(line, '#');
+        if(comment != nullptr)
+            *comment = '\0';
+
+        char key[64], s1[64];
+        if(sscanf(line, " %63s", key) != 1)
+            continue; //Empty line
+
+        bool valid = true;
+        if(strcmp(key, "scene") == 0){
+            valid = sscanf(line, " %*s %63s", s1) == 1 &&
+                    (strcmp(s1, "spheres") == 0 || strcmp(s1, "lattice") == 0);
+            if(valid)
+                scene = strcmp(s1, "spheres") == 0 ? SPHERES : LATTICE;
+        }else if(strcmp(key, "spheres") == 0){
+            valid = sscanf(line, " %*s %u %lf", &nSpheres, &sphereRadius) == 2 &&
+                    nSpheres > 0 && sphereRadius > 0.0;
+        }else if(strcmp(key, "lattice") == 0){
+            valid = sscanf(line, " %*s %u %u %u %lf %lf", &latticeN[0], &latticeN[1], &latticeN[2],
+                           &latticePitch, &latticeRadius) == 5 &&
+                    latticeN[0] > 0 && latticeN[1] > 0 && latticeN[2] > 0 &&
+                    latticePitch > 0.0 && latticeRadius > 0.0;
+        }else if(strcmp(key, "materials") == 0){
+            valid = sscanf(line, " %*s %u", &nMaterials) == 1 &&
+                    nMaterials > 0 && nMaterials < 256;
+        }else if(strcmp(key, "point-latency") == 0){
+            valid = sscanf(line, " %*s %lf", &pointLatency) == 1 && pointLatency >= 0.0;
+        }else if(strcmp(key, "call-latency") == 0){
+            valid = sscanf(line, " %*s %lf", &callLatency) == 1 && callLatency >= 0.0;
+        }else if(verbose > 1){
+            printf("mockGeoView: %s:%u: ignoring keyword '%s'\n", filename, nline, key);
+        }
+
+        if(!valid){
+            printf("mockGeoView: %s:%u: invalid line: %s", filename, nline, line);
+            err = -2;
+        }
+    }
+    fclose(f);
+
+    if(err != 0)
+        setDefaults();
+    updateScene();
+
+    if(verbose > 1 && err == 0){
+        printf("mockGeoView: %s scene with %u bodies and %u materials\n",
+               scene == SPHERES ? "spheres" : "lattice", getBodies(), nMaterials);
+    }
+    return err;
+}
+
+double mockGeoView::z2dir(const double u,
+                          const double v,
+                          const double w,
+                          const double omega,
+                          double rotation[9],
+                          const double phiAux,
+                          const double threshold) const{
+
+    //Rotation R = Rz(phi)*Ry(theta)*Rz(omega), which moves the z axis to (u,v,w).
+    //When the direction is close to the z axis, phi is undefined and 'phiAux' is used
+    const double theta = std::acos(std::clamp(w, -1.0, 1.0));
+    const double phi = std::sqrt(u*u + v*v) > threshold ? std::atan2(v, u) : phiAux;
+
+    const double cp = std::cos(phi), sp = std::sin(phi);
+    const double ct = std::cos(theta), st = std::sin(theta);
+    const double co = std::cos(omega), so = std::sin(omega);
+
+    rotation[0] = cp*ct*co - sp*so;
+    rotation[1] = -cp*ct*so - sp*co;
+    rotation[2] = cp*st;
+    rotation[3] = sp*ct*co + cp*so;
+    rotation[4] = -sp*ct*so + cp*co;
+    rotation[5] = sp*st;
+    rotation[6] = -st*co;
+    rotation[7] = st*so;
+    rotation[8] = ct;
+    return phi;
+}
+
+float mockGeoView::z2dirf(const float u,
+                          const float v,
+                          const float w,
+                          const float omega,
+                          float rotation[9],
+                          const float phiAux,
+                          const float threshold) const{
+    double rot[9];
+    const double phi = z2dir(u, v, w, omega, rot, phiAux, threshold);
+    for(unsigned i = 0; i < 9; ++i)
+        rotation[i] = static_cast<float>(rot[i]);
+    return static_cast<float>(phi);
+}
+
+//** 2D renders **//
+
+void mockGeoView::renderRows(unsigned char* renderMat, unsigned int* renderBody,
+                             const unsigned iplane,
+                             const double x, const double y, const double z,
+                             const double dh, const double dv,
+                             const unsigned nh, const unsigned nv,
+                             const unsigned row0, const unsigned row1) const{
+
+    const double halfH = static_cast<double>(nh/2);
+    const double halfV = static_cast<double>(nv/2);
+    for(unsigned j = row0; j < row1; ++j){
+        const double v = -(static_cast<double>(j) - halfV)*dv;
+        for(unsigned i = 0; i < nh; ++i){
+            const double h = (static_cast<double>(i) - halfH)*dh;
+            double p[3];
+            planeToSpace(iplane, h, v, x, y, z, p);
+            const unsigned ibody = locate(p[0], p[1], p[2]);
+            const size_t index = static_cast<size_t>(j)*nh + i;
+            renderBody[index] = ibody;
+            renderMat[index] = static_cast<unsigned char>(bodyMaterial(ibody));
+        }
+    }
+    wait(static_cast<double>(row1 - row0)*nh*pointLatency);
+}
+
+void mockGeoView::renderPlane(unsigned char* renderMat, unsigned int* renderBody,
+                              const unsigned iplane,
+                              const double x, const double y, const double z,
+                              const double dh, const double dv,
+                              const unsigned nh, const unsigned nv,
+                              const unsigned nthreads) const{
+
+    wait(callLatency*1000.0);
+    parallelRows(nthreads, nv, [&](unsigned row0, unsigned row1){
+        renderRows(renderMat, renderBody, iplane, x, y, z, dh, dv, nh, nv, row0, row1);
+    });
+}
+
+void mockGeoView::renderShift(unsigned char* renderMat, unsigned int* renderBody,
+                              const unsigned iplane, const int shiftH, const int shiftV,
+                              const double x, const double y, const double z,
+                              const double dh, const double dv,
+                              const unsigned nh, const unsigned nv) const{
+
+    const int w = static_cast<int>(nh);
+    const int h = static_cast<int>(nv);
+    wait(callLatency*1000.0);
+    if(std::abs(shiftH) >= w || std::abs(shiftV) >= h){
+        renderPlane(renderMat, renderBody, iplane, x, y, z, dh, dv, nh, nv, 1);
+        return;
+    }
+
+    //Move the image content, new pixel (i,j) is the old (i-shiftH,j-shiftV)
+    const std::vector<unsigned char> oldMat(renderMat, renderMat + static_cast<size_t>(nh)*nv);
+    const std::vector<unsigned int> oldBody(renderBody, renderBody + static_cast<size_t>(nh)*nv);
+    for(int j = std::max(0, shiftV); j < std::min(h, h + shiftV); ++j){
+        const size_t to = static_cast<size_t>(j)*nh + std::max(0, shiftH);
+        const size_t from = static_cast<size_t>(j - shiftV)*nh + std::max(0, -shiftH);
+        const size_t n = static_cast<size_t>(w - std::abs(shiftH));
+        std::copy_n(oldMat.data() + from, n, renderMat + to);
+        std::copy_n(oldBody.data() + from, n, renderBody + to);
+    }
+
+    //Render the uncovered pixels
+    const double halfH = static_cast<double>(nh/2);
+    const double halfV = static_cast<double>(nv/2);
+    size_t nRendered = 0;
+    for(int j = 0; j < h; ++j){
+        const bool rowUncovered = j < shiftV || j >= h + shiftV;
+        const double v = -(static_cast<double>(j) - halfV)*dv;
+        for(int i = 0; i < w; ++i){
+            if(!rowUncovered && i >= shiftH && i < w + shiftH)
+                continue;
+            const double hc = (static_cast<double>(i) - halfH)*dh;
+            double p[3];
+            planeToSpace(iplane, hc, v, x, y, z, p);
+            const unsigned ibody = locate(p[0], p[1], p[2]);
+            const size_t index = static_cast<size_t>(j)*nh + i;
+            renderBody[index] = ibody;
+            renderMat[index] = static_cast<unsigned char>(bodyMaterial(ibody));
+            ++nRendered;
+        }
+    }
+    wait(nRendered*pointLatency);
+}
+
+void mockGeoView::testX(std::vector<geoError>&,
+                        const float, const float, const float,
+                        const float, const float,
+                        const unsigned, const unsigned) const{
+    //Analytic scenes are consistent, no errors to report
+}
+
+void mockGeoView::testY(std::vector<geoError>&,
+                        const float, const float, const float,
+                        const float, const float,
+                        const unsigned, const unsigned) const{
+}
+
+void mockGeoView::testZ(std::vector<geoError>&,
+                        const float, const float, const float,
+                        const float, const float,
+                        const unsigned, const unsigned) const{
+}
+
+void mockGeoView::renderX(unsigned char* renderMat, unsigned int* renderBody,
+                          const float x, const float y, const float z,
+                          const float dy, const float dz,
+                          const unsigned ny, const unsigned nz,
+                          const unsigned nthreads) const{
+    renderPlane(renderMat, renderBody, 0, x, y, z, dy, dz, ny, nz, nthreads);
+}
+
+void mockGeoView::renderY(unsigned char* renderMat, unsigned int* renderBody,
+                          const float x, const float y, const float z,
+                          const float dx, const float dz,
+                          const unsigned nx, const unsigned nz,
+                          const unsigned nthreads) const{
+    renderPlane(renderMat, renderBody, 1, x, y, z, dx, dz, nx, nz, nthreads);
+}
+
+void mockGeoView::renderZ(unsigned char* renderMat, unsigned int* renderBody,
+                          const float x, const float y, const float z,
+                          const float dx, const float dy,
+                          const unsigned nx, const unsigned ny,
+                          const unsigned nthreads) const{
+    renderPlane(renderMat, renderBody, 2, x, y, z, dx, dy, nx, ny, nthreads);
+}
+
+//Moving the view to the left moves the content to the right, and so on
+#define MOCK_SHIFT_RENDER(name, iplane, shiftH, shiftV)                          \
+void mockGeoView::name(unsigned char* renderMat, unsigned int* renderBody,      \
+                       const unsigned nPixels,                                  \
+                       const float x, const float y, const float z,             \
+                       const float dh, const float dv,                          \
+                       const unsigned nh, const unsigned nv) const{             \
+    const int n = static_cast<int>(nPixels);                                    \
+    renderShift(renderMat, renderBody, iplane, shiftH, shiftV,                  \
+                x, y, z, dh, dv, nh, nv);                                       \
+}
+
+MOCK_SHIFT_RENDER(renderXtoLeft,  0,  n,  0)
+MOCK_SHIFT_RENDER(renderXtoRight, 0, -n,  0)
+MOCK_SHIFT_RENDER(renderXtoUp,    0,  0,  n)
+MOCK_SHIFT_RENDER(renderXtoDown,  0,  0, -n)
+MOCK_SHIFT_RENDER(renderYtoLeft,  1,  n,  0)
+MOCK_SHIFT_RENDER(renderYtoRight, 1, -n,  0)
+MOCK_SHIFT_RENDER(renderYtoUp,    1,  0,  n)
+MOCK_SHIFT_RENDER(renderYtoDown,  1,  0, -n)
+MOCK_SHIFT_RENDER(renderZtoLeft,  2,  n,  0)
+MOCK_SHIFT_RENDER(renderZtoRight, 2, -n,  0)
+MOCK_SHIFT_RENDER(renderZtoUp,    2,  0,  n)
+MOCK_SHIFT_RENDER(renderZtoDown,  2,  0, -n)
+
+#undef MOCK_SHIFT_RENDER
+
+//** 3D renders **//
+
+double mockGeoView::traceSpheres(const double p[3], const double d[3], unsigned& ibody) const{
+
+    //Outside the outer sphere, the first hit is the outer sphere surface
+    const double b = p[0]*d[0] + p[1]*d[1] + p[2]*d[2];
+    const double c = p[0]*p[0] + p[1]*p[1] + p[2]*p[2] - sphereRadius*sphereRadius;
+    const double disc = b*b - c;
+    if(disc < 0.0)
+        return -1.0;
+    const double t = -b - std::sqrt(disc);
+    if(t < 0.0)
+        return -1.0;
+    ibody = 1;
+    return t;
+}
+
+double mockGeoView::traceLattice(const double p[3], const double d[3], unsigned& ibody) const{
+
+    //Intersect the lattice box
+    double boxMin[3], tEnter = 0.0, tExit = std::numeric_limits<double>::max();
+    for(unsigned a = 0; a < 3; ++a){
+        boxMin[a] = latticeOrigin[a] - 0.5*latticePitch;
+        const double boxMax = boxMin[a] + latticeN[a]*latticePitch;
+        if(d[a] == 0.0){
+            if(p[a] < boxMin[a] || p[a] > boxMax)
+                return -1.0;
+            continue;
+        }
+        double t0 = (boxMin[a] - p[a])/d[a];
+        double t1 = (boxMax - p[a])/d[a];
+        if(t0 > t1)
+            std::swap(t0, t1);
+        tEnter = std::max(tEnter, t0);
+        tExit = std::min(tExit, t1);
+    }
+    if(tEnter > tExit)
+        return -1.0;
+
+    //Walk the cells crossed by the ray. Spheres are contained in their
+    //cell, so the first cell with a hit contains the nearest one
+    long index[3], step[3];
+    double tMax[3], tDelta[3];
+    for(unsigned a = 0; a < 3; ++a){
+        const double q = p[a] + tEnter*d[a];
+        index[a] = std::clamp(static_cast<long>(std::floor((q - boxMin[a])/latticePitch)),
+                              0L, static_cast<long>(latticeN[a]) - 1);
+        if(d[a] > 0.0){
+            step[a] = 1;
+            tMax[a] = (boxMin[a] + (index[a] + 1)*latticePitch - p[a])/d[a];
+            tDelta[a] = latticePitch/d[a];
+        }else if(d[a] < 0.0){
+            step[a] = -1;
+            tMax[a] = (boxMin[a] + index[a]*latticePitch - p[a])/d[a];
+            tDelta[a] = -latticePitch/d[a];
+        }else{
+            step[a] = 0;
+            tMax[a] = std::numeric_limits<double>::max();
+            tDelta[a] = std::numeric_limits<double>::max();
+        }
+    }
+
+    const double r2 = latticeRadius*latticeRadius;
+    for(;;){
+        double oc[3];
+        for(unsigned a = 0; a < 3; ++a)
+            oc[a] = p[a] - (latticeOrigin[a] + index[a]*latticePitch);
+        const double b = oc[0]*d[0] + oc[1]*d[1] + oc[2]*d[2];
+        const double c = oc[0]*oc[0] + oc[1]*oc[1] + oc[2]*oc[2] - r2;
+        const double disc = b*b - c;
+        if(disc >= 0.0){
+            const double t = -b - std::sqrt(disc);
+            if(t >= 0.0){
+                ibody = 1 + static_cast<unsigned>(index[0] + latticeN[0]*(index[1] + latticeN[1]*index[2]));
+                return t;
+            }
+        }
+
+        //Next cell
+        const unsigned a = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+        if(tMax[a] > tExit)
+            return -1.0;
+        index[a] += step[a];
+        if(index[a] < 0 || index[a] >= static_cast<long>(latticeN[a]))
+            return -1.0;
+        tMax[a] += tDelta[a];
+    }
+}
+
+double mockGeoView::trace(const double p[3], const double d[3], unsigned& ibody) const{
+
+    //Starting inside a body
+    const unsigned startBody = locate(p[0], p[1], p[2]);
+    if(bodyMaterial(startBody) != 0){
+        ibody = startBody;
+        return 0.0;
+    }
+    if(scene == SPHERES)
+        return traceSpheres(p, d, ibody);
+    return traceLattice(p, d, ibody);
+}
+
+int mockGeoView::renderCamera(unsigned char* renderMat, unsigned int* renderBody,
+                              const float x, const float y, const float z,
+                              const float u, const float v, const float w,
+                              const float roll, float& phi,
+                              const float dx, const float dy,
+                              const unsigned nx, const unsigned ny,
+                              const bool ortho,
+                              float* distances,
+                              float& minDistance, float& maxDistance,
+                              const float threshold) const{
+
+    const double norm = std::sqrt(static_cast<double>(u)*u + static_cast<double>(v)*v + static_cast<double>(w)*w);
+    if(norm <= 0.0)
+        return -1;
+
+    wait(callLatency*1000.0);
+
+    double rot[9];
+    phi = static_cast<float>(z2dir(u/norm, v/norm, w/norm, roll, rot, phi, threshold));
+
+    //Camera axes, image horizontal, vertical and view direction
+    const double ex[3] = {rot[0], rot[3], rot[6]};
+    const double ey[3] = {rot[1], rot[4], rot[7]};
+    const double ez[3] = {rot[2], rot[5], rot[8]};
+
+    //Distance to the image plane which gives the perspective angle
+    const double angle = std::clamp(static_cast<double>(perspective3D), 1.0e-3, 3.1);
+    const double focal = 0.5*nx*dx/std::tan(0.5*angle);
+
+    const double halfH = static_cast<double>(nx/2);
+    const double halfV = static_cast<double>(ny/2);
+    const double camera[3] = {x, y, z};
+
+    parallelRows(std::max(1u, std::thread::hardware_concurrency()), ny,
+                 [&](unsigned row0, unsigned row1){
+        for(unsigned j = row0; j < row1; ++j){
+            const double b = -(static_cast<double>(j) - halfV)*dy;
+            for(unsigned i = 0; i < nx; ++i){
+                const double a = (static_cast<double>(i) - halfH)*dx;
+                double p[3], d[3];
+                if(ortho){
+                    for(unsigned k = 0; k < 3; ++k){
+                        p[k] = camera[k] + a*ex[k] + b*ey[k];
+                        d[k] = ez[k];
+                    }
+                }else{
+                    double dnorm = 0.0;
+                    for(unsigned k = 0; k < 3; ++k){
+                        p[k] = camera[k];
+                        d[k] = a*ex[k] + b*ey[k] + focal*ez[k];
+                        dnorm += d[k]*d[k];
+                    }
+                    dnorm = std::sqrt(dnorm);
+                    for(unsigned k = 0; k < 3; ++k)
+                        d[k] /= dnorm;
+                }
+
+                unsigned ibody = getBodies();
+                const double t = trace(p, d, ibody);
+                const size_t index = static_cast<size_t>(j)*nx + i;
+                if(t >= 0.0){
+                    renderBody[index] = ibody;
+                    renderMat[index] = static_cast<unsigned char>(bodyMaterial(ibody));
+                    distances[index] = static_cast<float>(t);
+                }else{
+                    renderBody[index] = getBodies();
+                    renderMat[index] = 0;
+                    distances[index] = -1.0f;
+                }
+            }
+        }
+        wait(static_cast<double>(row1 - row0)*nx*pointLatency);
+    });
+
+    //Distance range of the hits, pixels with no hit are set to the maximum
+    const size_t nPixels = static_cast<size_t>(nx)*ny;
+    minDistance = std::numeric_limits<float>::max();
+    maxDistance = 0.0f;
+    for(size_t i = 0; i < nPixels; ++i){
+        if(distances[i] >= 0.0f){
+            minDistance = std::min(minDistance, distances[i]);
+            maxDistance = std::max(maxDistance, distances[i]);
+        }
+    }
+    if(minDistance > maxDistance){
+        minDistance = 0.0f;
+        maxDistance = 1.0f;
+    }
+    for(size_t i = 0; i < nPixels; ++i){
+        if(distances[i] < 0.0f)
+            distances[i] = maxDistance;
+    }
+    return 0;
+}
+
+int mockGeoView::render3Dortho(unsigned char* renderMat, unsigned int* renderBody,
+                               const float x, const float y, const float z,
+                               const float u, const float v, const float w,
+                               const float roll, float& phi,
+                               float* distances,
+                               float& minDistance, float& maxDistance,
+                               const float threshold) const{
+    return renderCamera(renderMat, renderBody, x, y, z, u, v, w, roll, phi,
+                        dx3D, dy3D, nx3D, ny3D, true,
+                        distances, minDistance, maxDistance, threshold);
+}
+
+int mockGeoView::render3Dortho(unsigned char* renderMat, unsigned int* renderBody,
+                               const float x, const float y, const float z,
+                               const float u, const float v, const float w,
+                               const float roll, float& phi,
+                               const float dx, const float dy,
+                               const unsigned nx, const unsigned ny,
+                               float* distances,
+                               float& minDistance, float& maxDistance,
+                               const float threshold) const{
+    return renderCamera(renderMat, renderBody, x, y, z, u, v, w, roll, phi,
+                        dx, dy, nx, ny, true,
+                        distances, minDistance, maxDistance, threshold);
+}
+
+void mockGeoView::set3DResolution(const unsigned nx, const unsigned ny,
+                                  const float dx, const float dy,
+                                  const float perspective){
+    nx3D = nx;
+    ny3D = ny;
+    dx3D = dx;
+    dy3D = dy;
+    perspective3D = perspective;
+}
+
+int mockGeoView::render3D(unsigned char* renderMat, unsigned int* renderBody,
+                          const float x, const float y, const float z,
+                          const float u, const float v, const float w,
+                          const float roll, float& phi,
+                          float* distances,
+                          float& minDistance, float& maxDistance,
+                          const float threshold) const{
+    return renderCamera(renderMat, renderBody, x, y, z, u, v, w, roll, phi,
+                        dx3D, dy3D, nx3D, ny3D, false,
+                        distances, minDistance, maxDistance, threshold);
+}
+
+//** Library entry points **//
+
+extern "C" {
+
+pen_geoViewInterface* pen_geoView_new(){
+    return new mockGeoView;
+}
+
+void pen_geoView_delete(pen_geoViewInterface* view){
+    delete view;
+}
+
+}
@@ -0,0 +1,289 @@
+#ifndef MOCKGEOVIEW_H
+#define MOCKGEOVIEW_H
+
+#include <string>
+#include <vector>
+
+#include "pen_geoViewInterface.hh"
+
+#if defined(_WIN32)
+#define MOCK_GEOVIEW_EXPORT __declspec(dllexport)
+#else
+#define MOCK_GEOVIEW_EXPORT __attribute__((visibility("default")))
+#endif
+
+//Procedural geometry implementing the PenRed viewer interface.
+//
+//Built as a stand-in for the PenRed 'libgeoView_C' library, so the viewer
+//render, colorization and scheduling paths can be run and benchmarked
+//without PenRed. Scenes are analytic, so renders are deterministic and
+//independent of the number of threads.
+//
+//The scene is read by 'init' from a text file with one keyword per line,
+//'#' starts a comment:
+//
+//  scene         (spheres|lattice)          Scene type (default spheres)
+//  spheres       n radius                   Nested spheres, the outer one with the given radius (default 5 10)
+//  lattice       nx ny nz pitch radius      Grid of spheres centered at the origin (default 16 16 16 2 0.8)
+//  materials     n                          Materials assigned cyclically to bodies, 1 to 255 (default 8)
+//  point-latency ns                         Busy wait per located point
+//  call-latency  us                         Busy wait per library call
+//
+//Any other keyword, as the ones written by the viewer for quadric and mesh
+//geometries, is ignored. Both scenes are enclosed by a void box (body 0),
+//points outside it belong to the body 'getBodies()', with material 0.
+class mockGeoView : public pen_geoViewInterface
+{
+
+public:
+
+    enum sceneType{SPHERES, LATTICE};
+
+private:
+
+    sceneType scene;
+
+    //Nested spheres
+    unsigned nSpheres;
+    double sphereRadius;
+
+    //Lattice of spheres
+    unsigned latticeN[3];
+    double latticePitch;
+    double latticeRadius;
+    double latticeOrigin[3]; //Center of the first sphere
+
+    double enclosure; //Half side of the enclosure box
+
+    unsigned nMaterials;
+    double pointLatency; //ns
+    double callLatency;  //us
+
+    //3D resolution
+    unsigned nx3D, ny3D;
+    float dx3D, dy3D;
+    float perspective3D;
+
+    //Returns the body of the point (x,y,z)
+    unsigned locate(const double x, const double y, const double z) const;
+
+    unsigned bodyMaterial(const unsigned ibody) const;
+
+    //Returns the distance along the unitary direction 'd' from 'p' to the
+    //first non void body, or a negative value if none is found
+    double trace(const double p[3], const double d[3], unsigned& ibody) const;
+    double traceSpheres(const double p[3], const double d[3], unsigned& ibody) const;
+    double traceLattice(const double p[3], const double d[3], unsigned& ibody) const;
+
+    //Renders the plane 'iplane' (0=X, 1=Y, 2=Z) rows [row0,row1) of a
+    //nh x nv image centered at (x,y,z)
+    void renderRows(unsigned char* renderMat, unsigned int* renderBody,
+                    const unsigned iplane,
+                    const double x, const double y, const double z,
+                    const double dh, const double dv,
+                    const unsigned nh, const unsigned nv,
+                    const unsigned row0, const unsigned row1) const;
+
+    void renderPlane(unsigned char* renderMat, unsigned int* renderBody,
+                     const unsigned iplane,
+                     const double x, const double y, const double z,
+                     const double dh, const double dv,
+                     const unsigned nh, const unsigned nv,
+                     const unsigned nthreads) const;
+
+    //Moves the image content 'nPixels' columns (horizontal) or rows and
+    //renders the uncovered band. (x,y,z) is the new image center
+    void renderShift(unsigned char* renderMat, unsigned int* renderBody,
+                     const unsigned iplane, const int shiftH, const int shiftV,
+                     const double x, const double y, const double z,
+                     const double dh, const double dv,
+                     const unsigned nh, const unsigned nv) const;
+
+    int renderCamera(unsigned char* renderMat, unsigned int* renderBody,
+                     const float x, const float y, const float z,
+                     const float u, const float v, const float w,
+                     const float roll, float& phi,
+                     const float dx, const float dy,
+                     const unsigned nx, const unsigned ny,
+                     const bool ortho,
+                     float* distances,
+                     float& minDistance, float& maxDistance,
+                     const float threshold) const;
+
+    //Busy waits 'ns' nanoseconds, as a real geometry would keep the thread busy
+    void wait(const double ns) const;
+
+    void setDefaults();
+
+    //Computes the scene values derived from the configuration
+    void updateScene();
+
+public:
+
+    mockGeoView();
+
+    unsigned getBodies() const override;
+
+    std::string getBodyName(const unsigned ibody) const override;
+
+    double z2dir(const double u,
+                 const double v,
+                 const double w,
+                 const double omega,
+                 double rotation[9],
+                 const double phiAux,
+                 const double threshold) const override;
+
+    float z2dirf(const float u,
+                 const float v,
+                 const float w,
+                 const float omega,
+                 float rotation[9],
+                 const float phiAux,
+                 const float threshold) const override;
+
+    int init(const char* filename,
+             const unsigned verbose = 5) override;
+
+    void testX(std::vector<geoError>& errors,
+               const float x, const float y, const float z,
+               const float dy, const float dz,
+               const unsigned ny, const unsigned nz) const override;
+
+    void renderX(unsigned char* renderMat, unsigned int* renderBody,
+                 const float x, const float y, const float z,
+                 const float dy, const float dz,
+                 const unsigned ny, const unsigned nz,
+                 const unsigned nthreads = 1) const override;
+
+    void renderXtoLeft(unsigned char* renderMat, unsigned int* renderBody,
+                       const unsigned nPixels,
+                       const float x, const float y, const float z,
+                       const float dy, const float dz,
+                       const unsigned ny, const unsigned nz) const override;
+
+    void renderXtoRight(unsigned char* renderMat, unsigned int* renderBody,
+                        const unsigned nPixels,
+                        const float x, const float y, const float z,
+                        const float dy, const float dz,
+                        const unsigned ny, const unsigned nz) const override;
+
+    void renderXtoUp(unsigned char* renderMat, unsigned int* renderBody,
+                     const unsigned nPixels,
+                     const float x, const float y, const float z,
+                     const float dy, const float dz,
+                     const unsigned ny, const unsigned nz) const override;
+
+    void renderXtoDown(unsigned char* renderMat, unsigned int* renderBody,
+                       const unsigned nPixels,
+                       const float x, const float y, const float z,
+                       const float dy, const float dz,
+                       const unsigned ny, const unsigned nz) const override;
+
+    void testY(std::vector<geoError>& errors,
+               const float x, const float y, const float z,
+               const float dx, const float dz,
+               const unsigned nx, const unsigned nz) const override;
+
+    void renderY(unsigned char* renderMat, unsigned int* renderBody,
+                 const float x, const float y, const float z,
+                 const float dx, const float dz,
+                 const unsigned nx, const unsigned nz,
+                 const unsigned nthreads = 1) const override;
+
+    void renderYtoLeft(unsigned char* renderMat, unsigned int* renderBody,
+                       const unsigned nPixels,
+                       const float x, const float y, const float z,
+                       const float dx, const float dz,
+                       const unsigned nx, const unsigned nz) const override;
+
+    void renderYtoRight(unsigned char* renderMat, unsigned int* renderBody,
+                        const unsigned nPixels,
+                        const float x, const float y, const float z,
+                        const float dx, const float dz,
+                        const unsigned nx, const unsigned nz) const override;
+
+    void renderYtoUp(unsigned char* renderMat, unsigned int* renderBody,
+                     const unsigned nPixels,
+                     const float x, const float y, const float z,
+                     const float dx, const float dz,
+                     const unsigned nx, const unsigned nz) const override;
+
+    void renderYtoDown(unsigned char* renderMat, unsigned int* renderBody,
+                       const unsigned nPixels,
+                       const float x, const float y, const float z,
+                       const float dx, const float dz,
+                       const unsigned nx, const unsigned nz) const override;
+
+    void testZ(std::vector<geoError>& errors,
+               const float x, const float y, const float z,
+               const float dx, const float dy,
+               const unsigned nx, const unsigned ny) const override;
+
+    void renderZ(unsigned char* renderMat, unsigned int* renderBody,
+                 const float x, const float y, const float z,
+                 const float dx, const float dy,
+                 const unsigned nx, const unsigned ny,
+                 const unsigned nthreads = 1) const override;
+
+    void renderZtoLeft(unsigned char* renderMat, unsigned int* renderBody,
+                       const unsigned nPixels,
+                       const float x, const float y, const float z,
+                       const float dx, const float dy,
+                       const unsigned nx, const unsigned ny) const override;
+
+    void renderZtoRight(unsigned char* renderMat, unsigned int* renderBody,
+                        const unsigned nPixels,
+                        const float x, const float y, const float z,
+                        const float dx, const float dy,
+                        const unsigned nx, const unsigned ny) const override;
+
+    void renderZtoUp(unsigned char* renderMat, unsigned int* renderBody,
+                     const unsigned nPixels,
+                     const float x, const float y, const float z,
+                     const float dx, const float dy,
+                     const unsigned nx, const unsigned ny) const override;
+
+    void renderZtoDown(unsigned char* renderMat, unsigned int* renderBody,
+                       const unsigned nPixels,
+                       const float x, const float y, const float z,
+                       const float dx, const float dy,
+                       const unsigned nx, const unsigned ny) const override;
+
+    int render3Dortho(unsigned char* renderMat, unsigned int* renderBody,
+                      const float x, const float y, const float z,
+                      const float u, const float v, const float w,
+                      const float roll, float& phi,
+                      float* distances,
+                      float& minDistance, float& maxDistance,
+                      const float threshold = 1.0e-4) const override;
+
+    int render3Dortho(unsigned char* renderMat, unsigned int* renderBody,
+                      const float x, const float y, const float z,
+                      const float u, const float v, const float w,
+                      const float roll, float& phi,
+                      const float dx, const float dy,
+                      const unsigned nx, const unsigned ny,
+                      float* distances,
+                      float& minDistance, float& maxDistance,
+                      const float threshold = 1.0e-4) const override;
+
+    void set3DResolution(const unsigned nx, const unsigned ny,
+                         const float dx, const float dy,
+                         const float perspective) override;
+
+    int render3D(unsigned char* renderMat, unsigned int* renderBody,
+                 const float x, const float y, const float z,
+                 const float u, const float v, const float w,
+                 const float roll, float& phi,
+                 float* distances,
+                 float& minDistance, float& maxDistance,
+                 const float threshold = 1.0e-4) const override;
+};
+
+extern "C" {
+MOCK_GEOVIEW_EXPORT pen_geoViewInterface* pen_geoView_new();
+MOCK_GEOVIEW_EXPORT void pen_geoView_delete(pen_geoViewInterface* view);
+}
+
+#endif // MOCKGEOVIEW_H
@@ -0,0 +1,124 @@
+#include "posterrender.h"
+
+#include <cstdio>
+#include <chrono>
+#include <future>
+#include <vector>
+
+static double elapsed(const std::chrono::steady_clock::time_point& start){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool posterRenderer::render(const renderRequest& request, const bool matView,
+                            const colorMap::palette& colors, const std::string& file,
+                            const cancelToken& token, posterStats* stats,
+                            tileScheduler& scheduler, std::atomic<unsigned>* rowsDone){
+
+    const unsigned width = request.width;
+    const unsigned height = request.height;
+    if(request.pPenRedViewer == nullptr || request.perspective > 2 ||
+       width == 0 || height == 0)
+        return false;
+
+    posterWriter writer;
+    if(!writer.open(file, width, height)){
+        printf("posterRenderer: Unable to create '%s'\n", file.c_str());
+        return false;
+    }
+
+    const unsigned bandRows = static_cast<unsigned>(std::min<size_t>(height,
+                                                    std::max<size_t>(1, bandPixels/width)));
+
+    //A band is rendered while the previous one is encoded
+    struct band{
+        renderFrame frame;
+        std::vector<uint32_t> argb;
+    };
+    band bands[2];
+    std::future<double> encoding;
+    bool ok = true;
+
+    posterStats localStats;
+    localStats.bandRows = bandRows;
+
+    auto waitEncoding = [&](){
+        if(!encoding.valid())
+            return;
+        const double writeTime = encoding.get();
+        if(writeTime < 0.0)
+            ok = false;
+        else
+            localStats.writeTime += writeTime;
+    };
+
+    unsigned iband = 0;
+    for(unsigned row0 = 0; row0 < height && ok; row0 += bandRows, ++iband){
+
+        const unsigned nrows = std::min(bandRows, height - row0);
+        band& b = bands[iband % 2];
+
+        //The band is a slice of 'nrows' rows centered at the band center.
+        //Its pixels match the ones of the complete slice
+        renderRequest bandRequest = request;
+        bandRequest.height = nrows;
+        bandRequest.moveOnPlane = false;
+        bandRequest.progressive = false;
+        bandRequest.exactRender = true;
+        bandRequest.prefetchPlanes = 0;
+        sliceRenderer::regionCenter(request, 0, row0, width, nrows,
+                                    bandRequest.x, bandRequest.y, bandRequest.z);
+
+        renderFrame& frame = b.frame;
+        frame.request = bandRequest;
+        frame.width = width;
+        frame.height = nrows;
+        frame.phi3D = request.phi3D;
+        frame.matImage.resize(frame.nPixels());
+        frame.bodyImage.resize(frame.nPixels(), request.labelBytes);
+        b.argb.resize(frame.nPixels());
+
+        auto start = std::chrono::steady_clock::now();
+        if(!sliceRenderer::renderTiles(bandRequest, frame, token, nullptr, scheduler)){
+            ok = false;
+            break;
+        }
+        localStats.renderTime += elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        colorMap::colorize(frame, matView, colors, b.argb.data(), nullptr, &scheduler);
+        localStats.colorTime += elapsed(start);
+
+        //Rows must be written in order, wait the previous band
+        waitEncoding();
+        if(!ok)
+            break;
+        if(rowsDone != nullptr)
+            *rowsDone = row0;
+
+        encoding = std::async(std::launch::async, [&writer, &b, nrows](){
+            const auto writeStart = std::chrono::steady_clock::now();
+            if(!writer.writeRows(b.argb.data(), nrows))
+                return -1.0;
+            return elapsed(writeStart);
+        });
+    }
+    waitEncoding();
+
+    for(const band& b : bands){
+        localStats.bandBytes += b.frame.matImage.capacity() + b.frame.bodyImage.capacityBytes() +
+                                b.argb.capacity()*sizeof(uint32_t);
+    }
+
+    if(!writer.close())
+        ok = false;
+    if(!ok){
+        remove(file.c_str());
+        return false;
+    }
+
+    if(rowsDone != nullptr)
+        *rowsDone = height;
+    if(stats != nullptr)
+        *stats = localStats;
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef POSTERRENDER_H
+#define POSTERRENDER_H
+
+#include <atomic>
+#include <string>
+
+#include "renderframe.h"
+#include "colormap.h"
+#include "slicerender.h"
+#include "tilescheduler.h"
+#include "posterwriter.h"
+
+//Times and memory of a poster render
+struct posterStats{
+    double renderTime = 0.0; //Geometry queries, in ms
+    double colorTime = 0.0;  //Colorization, in ms
+    double writeTime = 0.0;  //Encoding, in ms, overlapped with the renders
+    unsigned bandRows = 0;   //Rows per band
+    size_t bandBytes = 0;    //Bytes allocated by the bands
+};
+
+//Renders 2D slices of any resolution, beyond the viewer limits, streaming
+//the image to a PNG or TIFF file (see 'posterWriter'). The slice is split
+//in bands of complete rows, each one rendered in parallel tiles through
+//'sliceRenderer', colorized and handed to the encoder, which runs while the
+//next band is rendered. Only two bands are allocated, so the memory is
+//bounded by 'bandPixels' regardless of the image size.
+class posterRenderer{
+
+public:
+
+    //Pixels per band. Bands have at least one row
+    static constexpr size_t bandPixels = 4*1024*1024;
+
+    //Renders the slice described by the request, which must be a 2D one,
+    //to 'file'. Rows already written are stored in 'rowsDone', if provided.
+    //Returns false on errors or cancellation, removing the incomplete file
+    static bool render(const renderRequest& request, const bool matView,
+                       const colorMap::palette& colors, const std::string& file,
+                       const cancelToken& token = cancelToken(),
+                       posterStats* stats = nullptr,
+                       tileScheduler& scheduler = tileScheduler::instance(),
+                       std::atomic<unsigned>* rowsDone = nullptr);
+};
+
+#endif // POSTERRENDER_H
@@ -0,0 +1,374 @@
+#include "posterwriter.h"
+
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+#ifdef VIEW_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+//Bytes per IDAT chunk. Stored deflate blocks can't exceed 65535 bytes
+static const size_t idatSize = 65535;
+//Bytes per TIFF strip
+static const size_t tiffStripSize = 65536;
+
+static uint32_t crc32Update(uint32_t crc, const unsigned char* data, const size_t size){
+    static uint32_t table[256];
+    static const bool tableInit = [](){
+        for(uint32_t n = 0; n < 256; ++n){
+            uint32_t c = n;
+            for(unsigned k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return true;
+    }();
+    (void)tableInit;
+
+    crc = ~crc;
+    for(size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t adler32Update(uint32_t adler, const unsigned char* data, size_t size){
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while(size > 0){
+        //Largest block whose sums can't overflow before the modulo
+        const size_t n = std::min<size_t>(size, 5552);
+        for(size_t i = 0; i < n; ++i){
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += n;
+        size -= n;
+    }
+    return (b << 16) | a;
+}
+
+static void putBE32(std::vector<unsigned char>& out, const uint32_t value){
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+static void putLE16(std::vector<unsigned char>& out, const uint16_t value){
+    out.push_back(static_cast<unsigned char>(value));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+}
+
+static void putLE32(std::vector<unsigned char>& out, const uint32_t value){
+    putLE16(out, static_cast<uint16_t>(value));
+    putLE16(out, static_cast<uint16_t>(value >> 16));
+}
+
+//Writes a PNG chunk with its length and CRC
+static bool writeChunk(FILE* fout, const char* type, const unsigned char* data, const size_t size){
+    std::vector<unsigned char> header;
+    putBE32(header, static_cast<uint32_t>(size));
+    header.insert(header.end(), type, type + 4);
+    uint32_t crc = crc32Update(0, header.data() + 4, 4);
+    crc = crc32Update(crc, data, size);
+    std::vector<unsigned char> trailer;
+    putBE32(trailer, crc);
+    return fwrite(header.data(), 1, header.size(), fout) == header.size() &&
+           (size == 0 || fwrite(data, 1, size, fout) == size) &&
+           fwrite(trailer.data(), 1, trailer.size(), fout) == trailer.size();
+}
+
+posterWriter::posterWriter() : fout(nullptr), format(PNG), width(0), height(0),
+                               writtenRows(0), failed(false), adler(1), blockOffset(0),
+                               stream(nullptr) {}
+
+posterWriter::~posterWriter(){
+#ifdef VIEW_WITH_ZLIB
+    if(stream != nullptr){
+        deflateEnd(static_cast<z_stream*>(stream));
+        delete static_cast<z_stream*>(stream);
+    }
+#endif
+    if(fout != nullptr)
+        fclose(fout);
+}
+
+posterWriter::imageFormat posterWriter::formatFromName(const std::string& file){
+    std::string extension;
+    const size_t dot = file.find_last_of('.');
+    if(dot != std::string::npos)
+        extension = file.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c){ return static_cast<char>(tolower(c)); });
+    return extension == "tif" || extension == "tiff" ? TIFF : PNG;
+}
+
+void posterWriter::put(const void* data, const size_t size){
+    if(!failed && size > 0 && fwrite(data, 1, size, fout) != size)
+        failed = true;
+}
+
+bool posterWriter::open(const std::string& file, const unsigned widthIn, const unsigned heightIn){
+
+    if(fout != nullptr || widthIn == 0 || heightIn == 0)
+        return false;
+
+    format = formatFromName(file);
+    width = widthIn;
+    height = heightIn;
+    writtenRows = 0;
+    failed = false;
+
+    fout = fopen(file.c_str(), "wb");
+    if(fout == nullptr)
+        return false;
+
+    if(!writeHeader()){
+        fclose(fout);
+        fout = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool posterWriter::writeHeader(){
+
+    const size_t rowBytes = static_cast<size_t>(width)*3;
+
+    if(format == PNG){
+        row.resize(rowBytes + 1);
+        row[0] = 0; //No filter
+
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        put(signature, sizeof(signature));
+
+        std::vector<unsigned char> ihdr;
+        putBE32(ihdr, width);
+        putBE32(ihdr, height);
+        ihdr.push_back(8); //Bit depth
+        ihdr.push_back(2); //RGB
+        ihdr.push_back(0); //Deflate
+        ihdr.push_back(0); //Adaptive filtering
+        ihdr.push_back(0); //No interlace
+        if(!failed && !writeChunk(fout, "IHDR", ihdr.data(), ihdr.size()))
+            failed = true;
+
+#ifdef VIEW_WITH_ZLIB
+        //Posters are dominated by flat regions, which compress
+        //well even with the fastest level
+        z_stream* z = new z_stream;
+        memset(z, 0, sizeof(z_stream));
+        if(deflateInit(z, Z_BEST_SPEED) != Z_OK){
+            delete z;
+            return false;
+        }
+        stream = z;
+        pending.resize(idatSize);
+        pending.clear();
+#else
+        //Zlib header of an uncompressed stream
+        adler = 1;
+        pending.reserve(idatSize);
+        pending.assign({0x78, 0x01});
+        blockOffset = 2;
+#endif
+        return !failed;
+    }
+
+    //TIFF
+    const uint64_t imageBytes = static_cast<uint64_t>(rowBytes)*height;
+    const uint32_t rowsPerStrip = static_cast<uint32_t>(std::max<size_t>(1, tiffStripSize/rowBytes));
+    const uint32_t nStrips = (height + rowsPerStrip - 1)/rowsPerStrip;
+    const uint16_t nEntries = 13;
+
+    //Header, directory, values which don't fit in the entries and pixels
+    const uint32_t ifdOffset = 8;
+    const uint32_t bitsOffset = ifdOffset + 2 + 12*nEntries + 4;
+    const uint32_t resolutionOffset = bitsOffset + 8;
+    const uint32_t stripOffsetsOffset = resolutionOffset + 16;
+    const uint32_t stripCountsOffset = stripOffsetsOffset + (nStrips > 1 ? 4*nStrips : 0);
+    const uint32_t dataOffset = stripCountsOffset + (nStrips > 1 ? 4*nStrips : 0);
+    if(dataOffset + imageBytes > 0xffffffffull){
+        printf("posterWriter: Image too large for a TIFF file, use PNG instead\n");
+        return false;
+    }
+
+    std::vector<unsigned char> header;
+    header.push_back('I');
+    header.push_back('I');
+    putLE16(header, 42);
+    putLE32(header, ifdOffset);
+
+    putLE16(header, nEntries);
+    auto entry = [&](const uint16_t tag, const uint16_t type, const uint32_t count, const uint32_t value){
+        putLE16(header, tag);
+        putLE16(header, type);
+        putLE32(header, count);
+        if(type == 3 && count == 1){
+            //Short values are left justified
+            putLE16(header, static_cast<uint16_t>(value));
+            putLE16(header, 0);
+        }else
+            putLE32(header, value);
+    };
+    const uint16_t SHORT = 3, LONG = 4, RATIONAL = 5;
+    entry(256, LONG, 1, width);                            //ImageWidth
+    entry(257, LONG, 1, height);                           //ImageLength
+    entry(258, SHORT, 3, bitsOffset);                      //BitsPerSample
+    entry(259, SHORT, 1, 1);                               //No compression
+    entry(262, SHORT, 1, 2);                               //RGB
+    entry(273, LONG, nStrips, nStrips > 1 ? stripOffsetsOffset : dataOffset);
+    entry(277, SHORT, 1, 3);                               //SamplesPerPixel
+    entry(278, LONG, 1, rowsPerStrip);
+    entry(279, LONG, nStrips, nStrips > 1 ? stripCountsOffset : static_cast<uint32_t>(imageBytes));
+    entry(282, RATIONAL, 1, resolutionOffset);             //XResolution
+    entry(283, RATIONAL, 1, resolutionOffset + 8);         //YResolution
+    entry(284, SHORT, 1, 1);                               //Chunky planar configuration
+    entry(296, SHORT, 1, 2);                               //Resolution in inches
+    putLE32(header, 0); //Last directory
+
+    for(unsigned i = 0; i < 3; ++i)
+        putLE16(header, 8);
+    putLE16(header, 0);
+    for(unsigned i = 0; i < 2; ++i){
+        putLE32(header, 72);
+        putLE32(header, 1);
+    }
+    if(nStrips > 1){
+        for(uint32_t i = 0; i < nStrips; ++i)
+            putLE32(header, dataOffset + static_cast<uint32_t>(i*rowsPerStrip*rowBytes));
+        for(uint32_t i = 0; i < nStrips; ++i){
+            const uint32_t rows = std::min(rowsPerStrip, height - i*rowsPerStrip);
+            putLE32(header, static_cast<uint32_t>(rows*rowBytes));
+        }
+    }
+
+    put(header.data(), header.size());
+    row.resize(rowBytes);
+    return !failed;
+}
+
+void posterWriter::flushChunk(const bool last){
+    if(failed)
+        return;
+#ifdef VIEW_WITH_ZLIB
+    (void)last;
+    if(!pending.empty() && !writeChunk(fout, "IDAT", pending.data(), pending.size()))
+        failed = true;
+    pending.clear();
+#else
+    //'pending' holds the raw bytes of a stored block, after the
+    //zlib header on the first one
+    const size_t offset = blockOffset;
+    blockOffset = 0;
+    const size_t blockSize = pending.size() - offset;
+    std::vector<unsigned char> chunk(pending.begin(), pending.begin() + offset);
+    chunk.reserve(pending.size() + 9);
+    chunk.push_back(last ? 1 : 0);
+    putLE16(chunk, static_cast<uint16_t>(blockSize));
+    putLE16(chunk, static_cast<uint16_t>(~blockSize));
+    chunk.insert(chunk.end(), pending.begin() + offset, pending.end());
+    if(last)
+        putBE32(chunk, adler);
+    if(!writeChunk(fout, "IDAT", chunk.data(), chunk.size()))
+        failed = true;
+    pending.clear();
+#endif
+}
+
+bool posterWriter::writeRows(const uint32_t* argb, const unsigned nrows){
+
+    if(fout == nullptr || failed || writtenRows + nrows > height)
+        return false;
+
+    const size_t rowBytes = static_cast<size_t>(width)*3;
+    const size_t first = format == PNG ? 1 : 0; //PNG filter byte
+    for(unsigned j = 0; j < nrows; ++j){
+        const uint32_t* pixels = argb + static_cast<size_t>(j)*width;
+        unsigned char* out = row.data() + first;
+        for(unsigned i = 0; i < width; ++i){
+            out[3*i    ] = static_cast<unsigned char>(pixels[i] >> 16);
+            out[3*i + 1] = static_cast<unsigned char>(pixels[i] >> 8);
+            out[3*i + 2] = static_cast<unsigned char>(pixels[i]);
+        }
+
+        if(format == TIFF){
+            put(row.data(), rowBytes);
+            continue;
+        }
+
+#ifdef VIEW_WITH_ZLIB
+        z_stream* z = static_cast<z_stream*>(stream);
+        z->next_in = row.data();
+        z->avail_in = static_cast<uInt>(row.size());
+        while(z->avail_in > 0 && !failed){
+            const size_t used = pending.size();
+            pending.resize(idatSize);
+            z->next_out = pending.data() + used;
+            z->avail_out = static_cast<uInt>(idatSize - used);
+            deflate(z, Z_NO_FLUSH);
+            pending.resize(idatSize - z->avail_out);
+            if(pending.size() == idatSize)
+                flushChunk(false);
+        }
+#else
+        adler = adler32Update(adler, row.data(), row.size());
+        const unsigned char* data = row.data();
+        size_t remaining = row.size();
+        while(remaining > 0 && !failed){
+            const size_t offset = blockOffset;
+            const size_t n = std::min(remaining, idatSize - (pending.size() - offset));
+            pending.insert(pending.end(), data, data + n);
+            data += n;
+            remaining -= n;
+            if(pending.size() - offset == idatSize)
+                flushChunk(false);
+        }
+#endif
+    }
+    writtenRows += nrows;
+    return !failed;
+}
+
+bool posterWriter::writeTrailer(){
+    if(format == TIFF)
+        return !failed;
+
+#ifdef VIEW_WITH_ZLIB
+    z_stream* z = static_cast<z_stream*>(stream);
+    z->next_in = nullptr;
+    z->avail_in = 0;
+    int status = Z_OK;
+    while(status != Z_STREAM_END && !failed){
+        const size_t used = pending.size();
+        pending.resize(idatSize);
+        z->next_out = pending.data() + used;
+        z->avail_out = static_cast<uInt>(idatSize - used);
+        status = deflate(z, Z_FINISH);
+        pending.resize(idatSize - z->avail_out);
+        if(status == Z_STREAM_ERROR)
+            failed = true;
+        else if(pending.size() == idatSize || status == Z_STREAM_END)
+            flushChunk(true);
+    }
+#else
+    flushChunk(true);
+#endif
+    if(!failed && !writeChunk(fout, "IEND", nullptr, 0))
+        failed = true;
+    return !failed;
+}
+
+bool posterWriter::close(){
+    if(fout == nullptr)
+        return false;
+
+    bool ok = writtenRows == height && writeTrailer();
+    if(fclose(fout) != 0)
+        ok = false;
+    fout = nullptr;
+    return ok;
+}
@@ -0,0 +1,71 @@
+#ifndef POSTERWRITER_H
+#define POSTERWRITER_H
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+//Writes RGB images row by row, top row first, so images of any size can
+//be encoded without keeping them in memory. Supported formats are PNG and
+//baseline TIFF, chosen from the file extension ('.tif' or '.tiff' for TIFF,
+//PNG otherwise).
+//
+//PNG rows are deflated with zlib when the viewer is built with it, and
+//stored in uncompressed deflate blocks otherwise. TIFF images are written
+//uncompressed, so they are limited to 4 GB.
+class posterWriter{
+
+public:
+
+    enum imageFormat{
+        PNG,
+        TIFF
+    };
+
+private:
+
+    FILE* fout;
+    imageFormat format;
+    unsigned width, height;
+    unsigned writtenRows;
+    bool failed;
+
+    //Encoded bytes waiting to be written
+    std::vector<unsigned char> pending;
+    //Row converted to the output pixel layout
+    std::vector<unsigned char> row;
+
+    //PNG state
+    uint32_t adler;
+    size_t blockOffset; //Zlib header bytes before the first stored block
+    void* stream; //zlib stream, if available
+
+    void put(const void* data, const size_t size);
+    void flushChunk(const bool last);
+    bool writeHeader();
+    bool writeTrailer();
+
+public:
+
+    posterWriter();
+    ~posterWriter();
+
+    posterWriter(const posterWriter&) = delete;
+    posterWriter& operator=(const posterWriter&) = delete;
+
+    static imageFormat formatFromName(const std::string& file);
+
+    //Creates the file and writes the image header. Returns false on error
+    bool open(const std::string& file, const unsigned widthIn, const unsigned heightIn);
+
+    //Appends 'nrows' rows of 'width' pixels in the 0xffRRGGBB layout
+    bool writeRows(const uint32_t* argb, const unsigned nrows);
+
+    //Writes the image trailer and closes the file. Fails if any row is missing
+    bool close();
+
+    inline unsigned readWrittenRows() const {return writtenRows;}
+};
+
+#endif // POSTERWRITER_H
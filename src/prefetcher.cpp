@@ -0,0 +1,145 @@
+#include "prefetcher.h"
+
+planePrefetcher::planePrefetcher()
+    : pending(false), active(false), stopRequested(false),
+      generation(0), prefetchedFrames(0)
+{
+    prefetchThread = std::thread(&planePrefetcher::run, this);
+}
+
+planePrefetcher::~planePrefetcher(){
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopRequested = true;
+        pending = false;
+        ++generation;
+    }
+    queueCondition.notify_one();
+    if(prefetchThread.joinable())
+        prefetchThread.join();
+}
+
+bool planePrefetcher::compatible(const renderRequest& a, const renderRequest& b){
+    return a.pPenRedViewer == b.pPenRedViewer &&
+           a.perspective == b.perspective && a.perspective != 3 &&
+           a.pixelSize == b.pixelSize &&
+           a.width == b.width && a.height == b.height &&
+           a.exactRender == b.exactRender;
+}
+
+void planePrefetcher::schedule(const renderRequest& request){
+
+    if(request.prefetchPlanes == 0 || request.perspective == 3 ||
+       request.pPenRedViewer == nullptr)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if(active && !compatible(request, activeRequest))
+            ++generation;
+        pendingRequest = request;
+        pending = true;
+    }
+    queueCondition.notify_one();
+}
+
+void planePrefetcher::cancel(const renderRequest& request){
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if(pending && !compatible(request, pendingRequest))
+        pending = false;
+    if(active && !compatible(request, activeRequest))
+        ++generation;
+}
+
+void planePrefetcher::cancel(){
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    pending = false;
+    if(active)
+        ++generation;
+}
+
+void planePrefetcher::cancelAndWait(){
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    pending = false;
+    if(active)
+        ++generation;
+    idleCondition.wait(lock, [this]{ return !active; });
+}
+
+void planePrefetcher::run(){
+
+    frameCache& cache = frameCache::instance();
+
+    for(;;){
+        renderRequest center;
+        unsigned long long id;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            active = false;
+            idleCondition.notify_all();
+            queueCondition.wait(lock, [this]{ return stopRequested || pending; });
+            if(stopRequested)
+                return;
+            center = pendingRequest;
+            activeRequest = center;
+            pending = false;
+            active = true;
+            id = generation.load();
+        }
+        const cancelToken token(generation, id);
+        const unsigned long long epoch = cache.readEpoch();
+
+        double h, v, depth;
+        sliceRenderer::planeCoordinates(center.perspective, center.x, center.y, center.z, h, v, depth);
+
+        //Render the nearest planes first, alternating forward and backward
+        bool stopPrefetch = false;
+        for(unsigned k = 1; k <= center.prefetchPlanes && !stopPrefetch; ++k){
+            for(const double sign : {1.0, -1.0}){
+
+                //Stop if cancelled or re-centered
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    stopPrefetch = pending || stopRequested || token.cancelled();
+                }
+                if(stopPrefetch)
+                    break;
+
+                renderRequest request = center;
+                request.moveOnPlane = false;
+                request.progressive = false;
+                sliceRenderer::spaceCoordinates(center.perspective, h, v,
+                                                depth + sign*static_cast<double>(k)*center.prefetchStep,
+                                                request.x, request.y, request.z);
+                if(cache.contains(request))
+                    continue;
+
+                std::shared_ptr<renderFrame> frame = std::make_shared<renderFrame>();
+                frame->request = request;
+                frame->width = request.width;
+                frame->height = request.height;
+                frame->phi3D = request.phi3D;
+                frame->matImage.resize(frame->nPixels());
+                frame->bodyImage.resize(frame->nPixels(), request.labelBytes);
+
+                //Use only idle threads
+                bool rendered;
+                if(request.exactRender)
+                    rendered = sliceRenderer::renderTiles(request, *frame, token, nullptr,
+                                                          sliceRenderer::requestScheduler(request), true);
+                else
+                    rendered = sliceRenderer::renderAdaptive(request, *frame, token, nullptr,
+                                                             sliceRenderer::requestScheduler(request), true);
+                if(!rendered){
+                    stopPrefetch = true;
+                    break;
+                }
+
+                cache.insert(frame, epoch);
+                ++prefetchedFrames;
+            }
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "renderframe.h"
+#include "framecache.h"
+#include "slicerender.h"
+
+//Speculatively renders the planes next to the displayed slice along the
+//view axis, i.e. the planes reached with the forward and backward keys,
+//and stores them in the shared frame cache.
+//
+//Prefetch renders run in a dedicated thread as background tasks of the
+//tile scheduler, so they only use otherwise idle cores. Moving the plane
+//re-centers the prefetch window after the plane in progress, while changing
+//the perspective, pixel size or resolution cancels it immediately.
+class planePrefetcher
+{
+
+private:
+
+    std::thread prefetchThread;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::condition_variable idleCondition;
+    bool pending;
+    renderRequest pendingRequest; //Displayed slice to prefetch around
+    renderRequest activeRequest;  //Slice of the running prefetch
+    bool active;
+    bool stopRequested;
+
+    //Prefetch renders are cancelled when the generation changes
+    std::atomic<unsigned long long> generation;
+
+    //Profiling counters
+    std::atomic<unsigned long long> prefetchedFrames;
+
+    void run();
+
+public:
+
+    planePrefetcher();
+    ~planePrefetcher();
+
+    planePrefetcher(const planePrefetcher&) = delete;
+    planePrefetcher& operator=(const planePrefetcher&) = delete;
+
+    //Checks if the prefetched planes of 'a' are also valid for 'b'
+    static bool compatible(const renderRequest& a, const renderRequest& b);
+
+    //Prefetches the planes around the displayed slice
+    void schedule(const renderRequest& request);
+
+    //Cancels the prefetch if the new request is not compatible with it
+    void cancel(const renderRequest& request);
+
+    //Cancels any prefetch
+    void cancel();
+
+    //Cancels any prefetch and waits until the running one has stopped,
+    //e.g. before the geometry library is reloaded
+    void cancelAndWait();
+
+    //Getter functions
+    inline unsigned long long readPrefetchedFrames() const {return prefetchedFrames.load();}
+};
+
+#endif // PREFETCHER_H
@@ -0,0 +1,250 @@
+#ifndef RENDERFRAME_H
+#define RENDERFRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <string>
+
+#include "pen_geoViewInterface.hh"
+
+class tileScheduler;
+
+//Snapshot of the viewer camera state required to render a single frame.
+//It is filled in the GUI thread and consumed by the render worker, so it
+//must not reference any viewer owned data.
+struct renderRequest{
+
+    const pen_geoViewInterface* pPenRedViewer = nullptr;
+
+    unsigned perspective = 0; // x,y,z,3d -> 0,1,2,3
+
+    //2D plane center
+    double x = 0.0, y = 0.0, z = 0.0;
+    double pixelSize = 0.1;
+    unsigned width = 0, height = 0;
+
+    //Try to reuse the previous frame on plane movements and zooms
+    bool moveOnPlane = false;
+
+    //Render every pixel (true) or refine only near boundaries (false)
+    bool exactRender = true;
+
+    //Publish coarse previews before the complete frame
+    bool progressive = true;
+
+    //Bytes per body label of the rendered frame, see 'labelImage::bytesFor'
+    unsigned labelBytes = 4;
+
+    //Pool used to render 2D slices, the shared one if null
+    tileScheduler* scheduler = nullptr;
+
+    //Planes to prefetch on each side of a 2D slice, and their spacing in cm
+    unsigned prefetchPlanes = 0;
+    double prefetchStep = 0.0;
+
+    //3D camera
+    double camera3DX = 0.0, camera3DY = 0.0, camera3DZ = 0.0;
+    double u = 0.0, v = 0.0, w = 1.0;
+    double omega = 0.0;
+    float phi3D = 0.0;
+    unsigned width3D = 0, height3D = 0;
+    double pixelSize3D = 0.1;
+    double perspective3D = 0.0;
+    //Orthographic projection, traced in parallel tiles (see 'cameraRenderer')
+    bool ortho3D = false;
+
+    //Generation of the requesting viewer, frames answering older ones are
+    //discarded (see 'viewer::releaseBuffers'). It doesn't change the view
+    unsigned long long generation = 0;
+};
+
+//Body labels of a frame. Labels are stored with the narrowest element able
+//to hold the body indexes of the loaded geometry, 1, 2 or 4 bytes, so the
+//frames of geometries with few bodies take less memory and bandwidth. The
+//geometry library renders 32 bit labels, which are narrowed when stored.
+//Labels beyond the element range saturate to its maximum value.
+class labelImage{
+
+private:
+    std::vector<uint8_t> labels8;
+    std::vector<uint16_t> labels16;
+    std::vector<uint32_t> labels32;
+    unsigned nBytes = 4;
+    size_t count = 0;
+
+    template<class labelType>
+    static inline labelType narrow(const unsigned int label){
+        const unsigned int maxLabel = std::numeric_limits<labelType>::max();
+        return static_cast<labelType>(label < maxLabel ? label : maxLabel);
+    }
+
+public:
+
+    //Element size able to hold the labels [0,maxLabel]
+    static inline unsigned bytesFor(const unsigned maxLabel){
+        return maxLabel <= 0xffu ? 1 : (maxLabel <= 0xffffu ? 2 : 4);
+    }
+
+    //Resizes the image to 'n' labels of 'elementBytes' bytes. The
+    //storage of the previous element size is freed when it changes
+    inline void resize(const size_t n, const unsigned elementBytes){
+        const unsigned newBytes = elementBytes <= 1 ? 1 : (elementBytes == 2 ? 2 : 4);
+        if(newBytes != nBytes){
+            std::vector<uint8_t>().swap(labels8);
+            std::vector<uint16_t>().swap(labels16);
+            std::vector<uint32_t>().swap(labels32);
+            nBytes = newBytes;
+        }
+        count = n;
+        if(nBytes == 1)
+            labels8.resize(n);
+        else if(nBytes == 2)
+            labels16.resize(n);
+        else
+            labels32.resize(n);
+    }
+
+    inline size_t size() const {return count;}
+    inline unsigned elementBytes() const {return nBytes;}
+    inline size_t capacityBytes() const {
+        return labels8.capacity() + labels16.capacity()*2 + labels32.capacity()*4;
+    }
+
+    //Labels of the current element type
+    template<class labelType>
+    inline labelType* data(){
+        if constexpr(std::is_same<labelType, uint8_t>::value)
+            return labels8.data();
+        else if constexpr(std::is_same<labelType, uint16_t>::value)
+            return labels16.data();
+        else{
+            static_assert(std::is_same<labelType, uint32_t>::value, "Unsupported label type");
+            return labels32.data();
+        }
+    }
+    template<class labelType>
+    inline const labelType* data() const {
+        return const_cast<labelImage*>(this)->data<labelType>();
+    }
+
+    //Calls 'f' with the labels, typed with the current element type
+    template<class F>
+    inline void visit(F&& f) const {
+        if(nBytes == 1)
+            f(labels8.data());
+        else if(nBytes == 2)
+            f(labels16.data());
+        else
+            f(labels32.data());
+    }
+
+    inline unsigned int operator[](const size_t i) const {
+        return nBytes == 1 ? labels8[i] : (nBytes == 2 ? labels16[i] : labels32[i]);
+    }
+
+    inline void set(const size_t i, const unsigned int label){
+        if(nBytes == 1)
+            labels8[i] = narrow<uint8_t>(label);
+        else if(nBytes == 2)
+            labels16[i] = narrow<uint16_t>(label);
+        else
+            labels32[i] = label;
+    }
+
+    //Sets the labels [begin,end) to 'label'
+    inline void fill(const size_t begin, const size_t end, const unsigned int label){
+        if(nBytes == 1)
+            std::fill(labels8.begin() + begin, labels8.begin() + end, narrow<uint8_t>(label));
+        else if(nBytes == 2)
+            std::fill(labels16.begin() + begin, labels16.begin() + end, narrow<uint16_t>(label));
+        else
+            std::fill(labels32.begin() + begin, labels32.begin() + end, label);
+    }
+
+    //Stores 'n' labels rendered by the geometry library from position 'to'
+    inline void store(const size_t to, const unsigned int* labels, const size_t n){
+        if(nBytes == 1){
+            for(size_t i = 0; i < n; ++i)
+                labels8[to + i] = narrow<uint8_t>(labels[i]);
+        }else if(nBytes == 2){
+            for(size_t i = 0; i < n; ++i)
+                labels16[to + i] = narrow<uint16_t>(labels[i]);
+        }else
+            std::copy(labels, labels + n, labels32.begin() + to);
+    }
+
+    //Copies 'n' labels of 'source', from position 'from', to position 'to'.
+    //The source can be this image, if both ranges don't overlap
+    inline void copy(const labelImage& source, const size_t from,
+                     const size_t to, const size_t n){
+        if(source.nBytes != nBytes){
+            for(size_t i = 0; i < n; ++i)
+                set(to + i, source[from + i]);
+        }else if(nBytes == 1)
+            std::copy(source.labels8.begin() + from, source.labels8.begin() + from + n, labels8.begin() + to);
+        else if(nBytes == 2)
+            std::copy(source.labels16.begin() + from, source.labels16.begin() + from + n, labels16.begin() + to);
+        else
+            std::copy(source.labels32.begin() + from, source.labels32.begin() + from + n, labels32.begin() + to);
+    }
+};
+
+//Result of a render request. Once a frame has been handed to the GUI thread
+//it is never modified again, so it can be shared between viewers safely.
+struct renderFrame{
+
+    renderRequest request;
+
+    unsigned width = 0, height = 0;
+    std::vector<unsigned char> matImage;
+    labelImage bodyImage;
+    std::vector<float> distances; //3D only
+    float minD = 0.0, maxD = 0.0; //3D only
+    float phi3D = 0.0;            //3D only, phi returned by the render
+
+    //Side, in pixels, of the blocks filled with a single sample.
+    //Complete frames use 1, progressive previews use greater values
+    unsigned previewStride = 1;
+    //Preview resampled from the previous frame on zooms, or reprojected
+    //on 3D camera movements
+    bool resampled = false;
+    //Rays traced by adaptive 3D renders, 0 on other renders
+    unsigned long long rays = 0;
+
+    //Geometry queries start and end, in the frame profiler clock (us)
+    long long renderStart = -1, renderEnd = -1;
+
+    inline bool preview() const {return previewStride > 1 || resampled;}
+
+    inline size_t nPixels() const {return static_cast<size_t>(width)*static_cast<size_t>(height);}
+};
+
+typedef std::shared_ptr<const renderFrame> renderFramePtr;
+
+//Cooperative cancellation of a render. Each request gets an identifier and
+//the render is cancelled as soon as a newer request is submitted, i.e. when
+//the latest identifier no longer matches. Long renders check it between
+//tiles.
+class cancelToken{
+
+private:
+    const std::atomic<unsigned long long>* latest;
+    unsigned long long id;
+
+public:
+    cancelToken() : latest(nullptr), id(0) {}
+    cancelToken(const std::atomic<unsigned long long>& latestIn,
+                const unsigned long long idIn) : latest(&latestIn), id(idIn) {}
+
+    inline bool cancelled() const {
+        return latest != nullptr && latest->load(std::memory_order_relaxed) != id;
+    }
+};
+
+#endif // RENDERFRAME_H
@@ -0,0 +1,483 @@
+#include "renderworker.h"
+
+std::mutex renderWorker::render3DMutex;
+bool renderWorker::resolution3DSet = false;
+const pen_geoViewInterface* renderWorker::viewer3DSet = nullptr;
+unsigned renderWorker::width3DSet = 0;
+unsigned renderWorker::height3DSet = 0;
+double renderWorker::pixelSize3DSet = 0.0;
+double renderWorker::perspective3DSet = 0.0;
+
+renderWorker::renderWorker(QObject *parent)
+    : QObject{parent}, pending(false), stopRequested(false), releaseRequested(false), busy(false), latestRequest(0),
+      renderedFrames(0), droppedFrames(0), cancelledFrames(0), chainedReprojections(0), renderStart(-1), memoryUsage(0)
+{
+    qRegisterMetaType<renderFramePtr>("renderFramePtr");
+
+    //Start the render thread
+    workerThread = std::thread(&renderWorker::run, this);
+}
+
+renderWorker::~renderWorker(){
+
+    //Discard the pending request and cancel the current render
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopRequested = true;
+        pending = false;
+        ++latestRequest;
+    }
+    queueCondition.notify_one();
+    if(workerThread.joinable())
+        workerThread.join();
+}
+
+void renderWorker::submit(const renderRequest& request){
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        //Replace the waiting request, if any
+        if(pending)
+            ++droppedFrames;
+        pendingRequest = request;
+        pending = true;
+        //Cancel the render in progress
+        ++latestRequest;
+    }
+    queueCondition.notify_one();
+
+    //Stop prefetching planes which will not be displayed
+    prefetcher.cancel(request);
+}
+
+void renderWorker::release(){
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if(pending)
+            ++droppedFrames;
+        pending = false;
+        releaseRequested = true;
+        //Cancel the render in progress
+        ++latestRequest;
+    }
+    queueCondition.notify_one();
+    prefetcher.cancel();
+}
+
+void renderWorker::cancelAndWait(){
+    {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        if(pending)
+            ++droppedFrames;
+        pending = false;
+        //Cancel the render in progress
+        ++latestRequest;
+        idleCondition.wait(lock, [this]{ return !busy; });
+    }
+    //The idle worker schedules no more prefetches
+    prefetcher.cancelAndWait();
+}
+
+void renderWorker::resetResolution3D(){
+    std::lock_guard<std::mutex> lock(render3DMutex);
+    resolution3DSet = false;
+}
+
+void renderWorker::releaseFrames(){
+
+    //Frames still referenced elsewhere, e.g. by the frame cache,
+    //are freed by their last owner
+    framePool.clear();
+    framePool.shrink_to_fit();
+    lastFrame.reset();
+    preview3D = renderFrame();
+    std::vector<unsigned char>().swap(refineMask);
+    std::vector<unsigned int>().swap(body3D);
+    updateMemoryUsage();
+}
+
+void renderWorker::updateMemoryUsage(){
+    auto frameBytes = [](const renderFrame& frame){
+        return frame.matImage.capacity()*sizeof(unsigned char) +
+               frame.bodyImage.capacityBytes() +
+               frame.distances.capacity()*sizeof(float);
+    };
+
+    size_t bytes = frameBytes(preview3D) + refineMask.capacity() +
+                   body3D.capacity()*sizeof(unsigned int);
+    for(const std::shared_ptr<renderFrame>& frame : framePool)
+        bytes += frameBytes(*frame);
+    memoryUsage = bytes;
+}
+
+void renderWorker::run(){
+
+    for(;;){
+        renderRequest request;
+        unsigned long long requestID;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            busy = false;
+            idleCondition.notify_all();
+            queueCondition.wait(lock, [this]{ return stopRequested || pending || releaseRequested; });
+            if(stopRequested)
+                return;
+            busy = true;
+            if(releaseRequested){
+                releaseRequested = false;
+                lock.unlock();
+                releaseFrames();
+                continue;
+            }
+            request = pendingRequest;
+            pending = false;
+            requestID = latestRequest.load();
+        }
+
+        if(request.pPenRedViewer == nullptr)
+            continue;
+
+        //Reuse a cached frame, if any, skipping the geometry library
+        frameCache& cache = frameCache::instance();
+        renderFramePtr cached = cache.find(request);
+        if(cached){
+            lastFrame = cached;
+            emit frameReady(cached, request.generation);
+            prefetcher.schedule(request);
+            continue;
+        }
+        const unsigned long long epoch = cache.readEpoch();
+
+        std::shared_ptr<renderFrame> frame = acquireFrame();
+        renderStart = frameProfiler::now();
+        if(!renderInto(request, *frame, cancelToken(latestRequest, requestID))){
+            //Superseded by a newer request, the frame returns to the pool
+            ++cancelledFrames;
+            continue;
+        }
+        frame->renderStart = renderStart;
+        frame->renderEnd = frameProfiler::now();
+        lastFrame = frame;
+        ++renderedFrames;
+        updateMemoryUsage();
+        cache.insert(frame, epoch);
+
+        //Hand the frame to the GUI thread
+        emit frameReady(frame, request.generation);
+
+        //Render the next planes while the user looks at this one
+        prefetcher.schedule(request);
+    }
+}
+
+std::shared_ptr<renderFrame> renderWorker::acquireFrame(){
+
+    //Reuse a frame which is neither displayed nor waiting to be displayed
+    for(const std::shared_ptr<renderFrame>& frame : framePool){
+        if(frame.use_count() == 1)
+            return frame;
+    }
+
+    std::shared_ptr<renderFrame> frame = std::make_shared<renderFrame>();
+    if(framePool.size() < maxPoolFrames)
+        framePool.push_back(frame);
+    return frame;
+}
+
+void renderWorker::publishPreview(const std::shared_ptr<renderFrame>& preview){
+
+    //Pool frames can keep the count of a previous adaptive render
+    preview->rays = 0;
+
+    //Previews are timed from the start of the render
+    preview->renderStart = renderStart;
+    preview->renderEnd = frameProfiler::now();
+    emit frameReady(preview, preview->request.generation);
+}
+
+bool renderWorker::renderInto(const renderRequest& request, renderFrame& frame,
+                              const cancelToken& token){
+
+    if(token.cancelled())
+        return false;
+
+    frame.request = request;
+    frame.previewStride = 1;
+    frame.resampled = false;
+    frame.rays = 0;
+
+    if(request.perspective == 3)
+        return render3D(request, frame, token);
+
+    frame.width = request.width;
+    frame.height = request.height;
+    frame.phi3D = request.phi3D;
+    frame.distances.clear();
+
+    const size_t nPixels = frame.nPixels();
+    frame.matImage.resize(nPixels);
+    frame.bodyImage.resize(nPixels, request.labelBytes);
+
+    //On plane movements, move the previous frame and render only the new region
+    int dx, dy;
+    if(request.moveOnPlane && lastFrame &&
+       sliceRenderer::shiftable(request, *lastFrame, dx, dy))
+        return sliceRenderer::renderShift(request, *lastFrame, dx, dy, frame, token, nullptr,
+                                          sliceRenderer::requestScheduler(request));
+
+    //On zooms, resample the previous frame and render only the changed
+    //pixels, or the whole frame on exact renders
+    if(request.moveOnPlane && lastFrame &&
+       sliceRenderer::zoomable(request, *lastFrame))
+        return renderZoom(request, frame, token);
+
+    if(request.exactRender){
+        if(request.progressive && nPixels >= sliceRenderer::progressiveMinPixels)
+            return renderProgressive(request, frame, token);
+        return sliceRenderer::renderTiles(request, frame, token, nullptr,
+                                          sliceRenderer::requestScheduler(request));
+    }
+    else
+        return sliceRenderer::renderAdaptive(request, frame, token, nullptr,
+                                             sliceRenderer::requestScheduler(request));
+}
+
+bool renderWorker::renderProgressive(const renderRequest& request, renderFrame& frame,
+                                     const cancelToken& token){
+
+    //Render from coarse to fine. Each pass renders only the pixels not
+    //rendered by the previous ones, and all but the last are published
+    //as previews while the next pass is rendered
+    bool first = true;
+    for(unsigned stride = sliceRenderer::progressiveStride; stride >= 1; stride /= 2){
+        if(!sliceRenderer::renderPass(request, frame, stride, first, token, nullptr,
+                                      sliceRenderer::requestScheduler(request)))
+            return false;
+        first = false;
+
+        if(stride > 1 && !token.cancelled()){
+            std::shared_ptr<renderFrame> preview = acquireFrame();
+            sliceRenderer::fillPreview(frame, stride, *preview);
+            publishPreview(preview);
+        }
+    }
+    return true;
+}
+
+bool renderWorker::renderZoom(const renderRequest& request, renderFrame& frame,
+                              const cancelToken& token){
+
+    sliceRenderer::resample(request, *lastFrame, frame, refineMask,
+                            sliceRenderer::requestScheduler(request));
+    if(token.cancelled())
+        return false;
+
+    //Show the resampled frame while the frame is rendered
+    std::shared_ptr<renderFrame> preview = acquireFrame();
+    preview->request = request;
+    preview->width = frame.width;
+    preview->height = frame.height;
+    preview->phi3D = frame.phi3D;
+    preview->previewStride = 1;
+    preview->resampled = true;
+    preview->matImage = frame.matImage;
+    preview->bodyImage = frame.bodyImage;
+    preview->distances.clear();
+    publishPreview(preview);
+
+    //Details smaller than the previous pixels can be missing in uniform
+    //regions, which are not refined, so exact renders trace the whole frame
+    if(request.exactRender)
+        return sliceRenderer::renderTiles(request, frame, token, nullptr,
+                                          sliceRenderer::requestScheduler(request));
+    return sliceRenderer::renderMasked(request, frame, refineMask, token, nullptr,
+                                       sliceRenderer::requestScheduler(request));
+}
+
+bool renderWorker::render3D(const renderRequest& request, renderFrame& frame,
+                            const cancelToken& token){
+
+    const unsigned width = request.width3D;
+    const unsigned height = request.height3D;
+
+    if(request.moveOnPlane && lastFrame){
+        //Orthographic views are moved and zoomed reusing the previous frame, like 2D slices
+        int dx, dy;
+        if(request.ortho3D && cameraRenderer::orthoShiftable(request, *lastFrame, dx, dy))
+            return cameraRenderer::renderOrthoShift(request, *lastFrame, dx, dy, frame, token,
+                                                    sliceRenderer::requestScheduler(request));
+        if(request.ortho3D && cameraRenderer::orthoZoomable(request, *lastFrame))
+            return renderOrthoZoom(request, frame, token);
+
+        //Small camera movements reproject the previous frame
+        if(cameraRenderer::reprojectable(request, *lastFrame) &&
+           (!request.ortho3D || chainedReprojections < maxChainedReprojections))
+            return renderReprojection(request, frame, token);
+    }
+    chainedReprojections = 0;
+
+    if(request.ortho3D && !request.exactRender){
+        renderStats stats;
+        if(!cameraRenderer::renderOrthoAdaptive(request, frame, token, &stats,
+                                                sliceRenderer::requestScheduler(request)))
+            return false;
+        frame.rays = stats.queries;
+        return true;
+    }
+
+    //Publish reduced resolution previews first. The library renders the
+    //whole camera grid on each call, so previews can't be reused by the
+    //final render and only the cheapest ones are computed
+    if(request.progressive &&
+       static_cast<size_t>(width)*height >= sliceRenderer::progressiveMinPixels){
+        for(unsigned stride = sliceRenderer::progressiveStride; stride > 2; stride /= 2){
+
+            const unsigned previewWidth = std::max(1u, width/stride);
+            const unsigned previewHeight = std::max(1u, height/stride);
+            preview3D.phi3D = request.phi3D;
+            if(!trace3D(request, previewWidth, previewHeight,
+                        request.pixelSize3D*static_cast<double>(stride), preview3D, token) ||
+               token.cancelled())
+                return false;
+
+            //Replicate each ray over its block of the full resolution image
+            std::shared_ptr<renderFrame> preview = acquireFrame();
+            preview->request = request;
+            preview->width = width;
+            preview->height = height;
+            preview->phi3D = preview3D.phi3D;
+            preview->minD = preview3D.minD;
+            preview->maxD = preview3D.maxD;
+            preview->previewStride = stride;
+            preview->resampled = false;
+            preview->matImage.resize(preview->nPixels());
+            preview->bodyImage.resize(preview->nPixels(), request.labelBytes);
+            preview->distances.resize(preview->nPixels());
+            for(unsigned j = 0; j < height; ++j){
+                const size_t from = static_cast<size_t>(std::min(j/stride, previewHeight-1))*previewWidth;
+                const size_t to = static_cast<size_t>(j)*width;
+                for(unsigned i = 0; i < width; ++i){
+                    const size_t ifrom = from + std::min(i/stride, previewWidth-1);
+                    preview->matImage[to + i] = preview3D.matImage[ifrom];
+                    preview->bodyImage.set(to + i, preview3D.bodyImage[ifrom]);
+                    preview->distances[to + i] = preview3D.distances[ifrom];
+                }
+            }
+            publishPreview(preview);
+        }
+    }
+
+    frame.phi3D = request.phi3D;
+    return trace3D(request, width, height, request.pixelSize3D, frame, token);
+}
+
+bool renderWorker::renderOrthoZoom(const renderRequest& request, renderFrame& frame,
+                                   const cancelToken& token){
+
+    tileScheduler& scheduler = sliceRenderer::requestScheduler(request);
+    cameraRenderer::orthoResample(request, *lastFrame, frame, refineMask, scheduler);
+    if(token.cancelled())
+        return false;
+
+    //Show the resampled frame while the view is traced
+    std::shared_ptr<renderFrame> preview = acquireFrame();
+    preview->request = request;
+    preview->width = frame.width;
+    preview->height = frame.height;
+    preview->phi3D = frame.phi3D;
+    preview->previewStride = 1;
+    preview->resampled = true;
+    preview->matImage = frame.matImage;
+    preview->bodyImage = frame.bodyImage;
+    preview->distances = frame.distances;
+    cameraRenderer::finishDistances(*preview, scheduler);
+    publishPreview(preview);
+
+    //As on slices, uniform regions are not refined, so exact renders
+    //trace the whole view
+    if(request.exactRender)
+        return cameraRenderer::renderOrthoTiles(request, request.width3D, request.height3D,
+                                                request.pixelSize3D, frame, token, scheduler);
+    return cameraRenderer::renderOrthoMasked(request, frame, refineMask, token, scheduler);
+}
+
+bool renderWorker::renderReprojection(const renderRequest& request, renderFrame& frame,
+                                      const cancelToken& token){
+
+    tileScheduler& scheduler = sliceRenderer::requestScheduler(request);
+    cameraRenderer::reproject(request, *lastFrame, frame, refineMask, scheduler);
+    if(token.cancelled())
+        return false;
+
+    //Show the reprojected frame while the view is traced
+    std::shared_ptr<renderFrame> preview = acquireFrame();
+    preview->request = request;
+    preview->width = frame.width;
+    preview->height = frame.height;
+    preview->phi3D = frame.phi3D;
+    preview->previewStride = 1;
+    preview->resampled = true;
+    preview->matImage = frame.matImage;
+    preview->bodyImage = frame.bodyImage;
+    preview->distances = frame.distances;
+    cameraRenderer::finishDistances(*preview, scheduler);
+    publishPreview(preview);
+
+    //Perspective views can only be traced as a whole, and the warp can
+    //miss disoccluded details, so exact renders trace the whole view too
+    if(!request.ortho3D || request.exactRender){
+        frame.phi3D = request.phi3D;
+        return trace3D(request, request.width3D, request.height3D, request.pixelSize3D, frame, token);
+    }
+
+    ++chainedReprojections;
+    return cameraRenderer::renderOrthoMasked(request, frame, refineMask, token, scheduler);
+}
+
+bool renderWorker::trace3D(const renderRequest& request, const unsigned width, const unsigned height,
+                           const double pixelSize, renderFrame& frame, const cancelToken& token){
+
+    if(request.ortho3D)
+        return cameraRenderer::renderOrthoTiles(request, width, height, pixelSize, frame, token,
+                                                sliceRenderer::requestScheduler(request));
+
+    frame.width = width;
+    frame.height = height;
+
+    const size_t nPixels = frame.nPixels();
+    frame.matImage.resize(nPixels);
+    frame.bodyImage.resize(nPixels, request.labelBytes);
+    frame.distances.resize(nPixels);
+
+    //The library renders 32 bit labels, narrower ones are stored after the render
+    const bool narrowLabels = frame.bodyImage.elementBytes() != 4;
+    if(narrowLabels)
+        body3D.resize(nPixels);
+    unsigned int* renderBody = narrowLabels ? body3D.data() : frame.bodyImage.data<uint32_t>();
+
+    std::lock_guard<std::mutex> lock(render3DMutex);
+
+    //Update the library 3D resolution only if it has been changed
+    if(!resolution3DSet || viewer3DSet != request.pPenRedViewer ||
+       width3DSet != width || height3DSet != height ||
+       pixelSize3DSet != pixelSize || perspective3DSet != request.perspective3D){
+
+        //Set3DResolution is not const, the library object is owned by the main window
+        const_cast<pen_geoViewInterface*>(request.pPenRedViewer)->set3DResolution(width, height,
+                                                                                   pixelSize, pixelSize,
+                                                                                   request.perspective3D);
+        resolution3DSet = true;
+        viewer3DSet = request.pPenRedViewer;
+        width3DSet = width;
+        height3DSet = height;
+        pixelSize3DSet = pixelSize;
+        perspective3DSet = request.perspective3D;
+    }
+
+    request.pPenRedViewer->render3D(frame.matImage.data(), renderBody,
+                                    request.camera3DX, request.camera3DY, request.camera3DZ,
+                                    request.u, request.v, request.w, request.omega, frame.phi3D,
+                                    frame.distances.data(), frame.minD, frame.maxD);
+    if(narrowLabels)
+        frame.bodyImage.store(0, renderBody, nPixels);
+    return true;
+}
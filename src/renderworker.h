@@ -0,0 +1,154 @@
+#ifndef RENDERWORKER_H
+#define RENDERWORKER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <QObject>
+#include <QMetaType>
+
+#include "renderframe.h"
+#include "slicerender.h"
+#include "camerarender.h"
+#include "framecache.h"
+#include "prefetcher.h"
+#include "frameprofiler.h"
+
+Q_DECLARE_METATYPE(renderFramePtr)
+
+//Renders the requests of a single viewer in a dedicated thread. Finished
+//frames are handed back to the GUI thread through the 'frameReady' signal,
+//with the generation of the request they answer.
+//
+//Requests found in the shared frame cache are answered without rendering.
+//Only the newest request is rendered. A request submitted while another one
+//is waiting replaces it (dropped frame), and the render in progress is
+//cancelled at the next tile (cancelled frame).
+class renderWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    //Maximum number of frames kept for reuse. One is displayed, one can be
+    //waiting in the event queue, one is being rendered and, on progressive
+    //renders, the last one is filled with the preview of the current pass.
+    static const size_t maxPoolFrames = 4;
+
+    //Adaptive orthographic frames reprojected from reprojected ones
+    //accumulate the errors of the warps, the view is traced again after
+    //this number of them
+    static const unsigned maxChainedReprojections = 8;
+
+private:
+
+    //Each viewer sends its own 3D resolution with the request, but the
+    //perspective one must be set in the geometry library, where it is a
+    //global state. So perspective 3D renders of all workers are serialized
+    //and the library resolution is only updated when the request differs
+    //from the last one set on the same library object. Orthographic renders
+    //take the resolution on each call and are traced in parallel
+    static std::mutex render3DMutex;
+    static bool resolution3DSet;
+    static const pen_geoViewInterface* viewer3DSet;
+    static unsigned width3DSet, height3DSet;
+    static double pixelSize3DSet, perspective3DSet;
+
+    std::thread workerThread;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::condition_variable idleCondition;
+    bool pending;
+    renderRequest pendingRequest;
+    bool stopRequested;
+    bool releaseRequested;
+    bool busy; //A request or release is being processed
+
+    //Identifier of the latest submitted request
+    std::atomic<unsigned long long> latestRequest;
+
+    //Profiling counters
+    std::atomic<unsigned long long> renderedFrames;
+    std::atomic<unsigned long long> droppedFrames;
+    std::atomic<unsigned long long> cancelledFrames;
+
+    //Frames owned by the worker. A frame is reused only when nobody
+    //else holds a reference to it
+    std::vector<std::shared_ptr<renderFrame>> framePool;
+    //Last rendered frame, used as base for adaptative renders
+    renderFramePtr lastFrame;
+    //Reduced resolution 3D renders used by progressive previews
+    renderFrame preview3D;
+    //Pixels to render after resampling the previous frame on 2D and
+    //orthographic 3D zooms, or reprojecting it on 3D camera movements
+    std::vector<unsigned char> refineMask;
+    //32 bit labels rendered by the library on 3D frames with narrower labels
+    std::vector<unsigned int> body3D;
+    //Consecutive adaptive orthographic frames built reprojecting the previous one
+    unsigned chainedReprojections;
+
+    //Renders the planes next to the displayed slice while idle
+    planePrefetcher prefetcher;
+
+    //Start of the render in progress, in the frame profiler clock
+    long long renderStart;
+
+    //Bytes allocated by the worker frames and buffers
+    std::atomic<size_t> memoryUsage;
+
+    void releaseFrames();
+    void updateMemoryUsage();
+
+    void run();
+    std::shared_ptr<renderFrame> acquireFrame();
+    void publishPreview(const std::shared_ptr<renderFrame>& preview);
+    bool renderInto(const renderRequest& request, renderFrame& frame,
+                    const cancelToken& token);
+    bool renderProgressive(const renderRequest& request, renderFrame& frame,
+                           const cancelToken& token);
+    bool renderZoom(const renderRequest& request, renderFrame& frame,
+                    const cancelToken& token);
+    bool render3D(const renderRequest& request, renderFrame& frame,
+                  const cancelToken& token);
+    bool renderOrthoZoom(const renderRequest& request, renderFrame& frame,
+                         const cancelToken& token);
+    bool renderReprojection(const renderRequest& request, renderFrame& frame,
+                            const cancelToken& token);
+    bool trace3D(const renderRequest& request, const unsigned width, const unsigned height,
+                 const double pixelSize, renderFrame& frame, const cancelToken& token);
+
+public:
+
+    explicit renderWorker(QObject *parent = nullptr);
+    ~renderWorker();
+
+    void submit(const renderRequest& request);
+
+    //Discards the pending request and frees the worker frames once
+    //they are no longer displayed. Frames are allocated again on demand
+    void release();
+
+    //Discards the pending request, cancels the render in progress and the
+    //prefetch, and waits until they have stopped, e.g. before the geometry
+    //library is reloaded. Requests submitted afterwards are rendered as usual
+    void cancelAndWait();
+
+    //Forces the next perspective 3D render to set the library resolution,
+    //to be called when the geometry is loaded, which can reset it
+    static void resetResolution3D();
+
+    //Getter functions
+    inline unsigned long long readRenderedFrames() const {return renderedFrames.load();}
+    inline unsigned long long readDroppedFrames() const {return droppedFrames.load();}
+    inline unsigned long long readCancelledFrames() const {return cancelledFrames.load();}
+    inline unsigned long long readPrefetchedFrames() const {return prefetcher.readPrefetchedFrames();}
+    inline size_t readMemoryUsage() const {return memoryUsage.load();}
+
+signals:
+    void frameReady(renderFramePtr, unsigned long long);
+};
+
+#endif // RENDERWORKER_H
@@ -0,0 +1,656 @@
+#include "slicerender.h"
+
+void sliceRenderer::regionCenter(const renderRequest& request,
+                                 const unsigned col0, const unsigned row0,
+                                 const unsigned ncols, const unsigned nrows,
+                                 double& x, double& y, double& z,
+                                 const unsigned stride){
+
+    double h, v, depth;
+    planeCoordinates(request.perspective, request.x, request.y, request.z, h, v, depth);
+
+    //Pixel index of the region center in the whole image
+    const long icol = static_cast<long>(col0 + (ncols/2)*stride) - static_cast<long>(request.width/2);
+    const long irow = static_cast<long>(row0 + (nrows/2)*stride) - static_cast<long>(request.height/2);
+
+    h += static_cast<double>(icol)*request.pixelSize;
+    v -= static_cast<double>(irow)*request.pixelSize;
+
+    spaceCoordinates(request.perspective, h, v, depth, x, y, z);
+}
+
+void sliceRenderer::renderRegion(const renderRequest& request,
+                                 const unsigned col0, const unsigned row0,
+                                 const unsigned ncols, const unsigned nrows,
+                                 unsigned char* renderMat, unsigned int* renderBody,
+                                 const unsigned stride,
+                                 const unsigned nthreads){
+
+    double x, y, z;
+    regionCenter(request, col0, row0, ncols, nrows, x, y, z, stride);
+
+    const pen_geoViewInterface* pPenRedViewer = request.pPenRedViewer;
+    const double pixelSize = request.pixelSize*static_cast<double>(stride);
+    if(request.perspective == 0){
+        pPenRedViewer->renderX(renderMat, renderBody,
+                               x,y,z, pixelSize, pixelSize, ncols, nrows, nthreads);
+    }else if(request.perspective == 1){
+        pPenRedViewer->renderY(renderMat, renderBody,
+                               x,y,z, pixelSize, pixelSize, ncols, nrows, nthreads);
+    }else if(request.perspective == 2){
+        pPenRedViewer->renderZ(renderMat, renderBody,
+                               x,y,z, pixelSize, pixelSize, ncols, nrows, nthreads);
+    }
+}
+
+bool sliceRenderer::renderTiles(const renderRequest& request, renderFrame& frame,
+                                const cancelToken& token, renderStats* stats,
+                                tileScheduler& scheduler, const bool background){
+
+    return renderRectangle(request, frame, 0, 0, request.width, request.height,
+                           token, stats, scheduler, background);
+}
+
+//Renders a single tile of an adaptive render. The tile is covered by a
+//lattice of points with a whole number of coarse blocks per side, which can
+//exceed the tile. Lattice points are sampled only when required to decide
+//if a block is uniform, grouping consecutive points of each lattice row in
+//a single library call.
+static void adaptiveTile(const renderRequest& request,
+                         const unsigned col0, const unsigned row0,
+                         const unsigned ncols, const unsigned nrows,
+                         renderFrame& frame, renderStats* stats){
+
+    struct block{
+        unsigned x, y, size;
+    };
+
+    const unsigned B0 = sliceRenderer::adaptiveBlock;
+    const unsigned latticeW = ((ncols + B0 - 1)/B0)*B0;
+    const unsigned latticeH = ((nrows + B0 - 1)/B0)*B0;
+    const size_t latticeWidth = static_cast<size_t>(latticeW) + 1;
+    const size_t nLattice = latticeWidth*(static_cast<size_t>(latticeH) + 1);
+
+    //Lattice point states
+    const unsigned char unknown = 0;
+    const unsigned char requested = 1;
+    const unsigned char known = 2;
+
+    thread_local std::vector<unsigned char> latticeMat;
+    thread_local std::vector<unsigned int> latticeBody;
+    thread_local std::vector<unsigned char> latticeState;
+    thread_local std::vector<unsigned char> sampleMat;
+    thread_local std::vector<unsigned int> sampleBody;
+    thread_local std::vector<block> blocks;
+    thread_local std::vector<block> children;
+
+    latticeMat.resize(nLattice);
+    latticeBody.resize(nLattice);
+    latticeState.assign(nLattice, unknown);
+
+    unsigned long long queries = 0;
+    unsigned long long calls = 0;
+
+    //Sample the coarse lattice with a single call
+    const unsigned nCoarseX = latticeW/B0 + 1;
+    const unsigned nCoarseY = latticeH/B0 + 1;
+    sampleMat.resize(static_cast<size_t>(nCoarseX)*nCoarseY);
+    sampleBody.resize(static_cast<size_t>(nCoarseX)*nCoarseY);
+    sliceRenderer::renderRegion(request, col0, row0, nCoarseX, nCoarseY,
+                                sampleMat.data(), sampleBody.data(), B0);
+    queries += static_cast<unsigned long long>(nCoarseX)*nCoarseY;
+    ++calls;
+    for(unsigned j = 0; j < nCoarseY; ++j){
+        for(unsigned i = 0; i < nCoarseX; ++i){
+            const size_t il = static_cast<size_t>(j*B0)*latticeWidth + i*B0;
+            const size_t is = static_cast<size_t>(j)*nCoarseX + i;
+            latticeMat[il] = sampleMat[is];
+            latticeBody[il] = sampleBody[is];
+            latticeState[il] = known;
+        }
+    }
+
+    //Samples all requested lattice points with the specified step
+    auto sampleRequested = [&](const unsigned step){
+        for(unsigned ly = 0; ly <= latticeH; ly += step){
+            const size_t rowOffset = static_cast<size_t>(ly)*latticeWidth;
+            unsigned lx = 0;
+            while(lx <= latticeW){
+                if(latticeState[rowOffset + lx] != requested){
+                    lx += step;
+                    continue;
+                }
+                //Find consecutive requested points
+                unsigned lxEnd = lx;
+                while(lxEnd + step <= latticeW && latticeState[rowOffset + lxEnd + step] == requested)
+                    lxEnd += step;
+
+                const unsigned n = (lxEnd - lx)/step + 1;
+                sampleMat.resize(n);
+                sampleBody.resize(n);
+                sliceRenderer::renderRegion(request, col0 + lx, row0 + ly, n, 1,
+                                            sampleMat.data(), sampleBody.data(), step);
+                queries += n;
+                ++calls;
+                for(unsigned k = 0; k < n; ++k){
+                    const size_t il = rowOffset + lx + k*step;
+                    latticeMat[il] = sampleMat[k];
+                    latticeBody[il] = sampleBody[k];
+                    latticeState[il] = known;
+                }
+                lx = lxEnd + step;
+            }
+        }
+    };
+
+    auto requestPoint = [&](const unsigned lx, const unsigned ly){
+        unsigned char& state = latticeState[static_cast<size_t>(ly)*latticeWidth + lx];
+        if(state == unknown)
+            state = requested;
+    };
+
+    //Fills the block region inside the tile
+    const unsigned width = frame.width;
+    auto fill = [&](const block& b, const unsigned char mat, const unsigned int body){
+        const unsigned xEnd = std::min(b.x + b.size, ncols);
+        const unsigned yEnd = std::min(b.y + b.size, nrows);
+        for(unsigned ly = b.y; ly < yEnd; ++ly){
+            const size_t offset = static_cast<size_t>(row0 + ly)*width + col0;
+            std::fill(frame.matImage.begin() + offset + b.x, frame.matImage.begin() + offset + xEnd, mat);
+            frame.bodyImage.fill(offset + b.x, offset + xEnd, body);
+        }
+    };
+
+    blocks.clear();
+    for(unsigned ly = 0; ly < nrows; ly += B0)
+        for(unsigned lx = 0; lx < ncols; lx += B0)
+            blocks.push_back(block{lx, ly, B0});
+
+    while(!blocks.empty()){
+        children.clear();
+        for(const block& b : blocks){
+            const size_t i00 = static_cast<size_t>(b.y)*latticeWidth + b.x;
+            const unsigned char mat = latticeMat[i00];
+            const unsigned int body = latticeBody[i00];
+
+            //Single pixel blocks are the top left lattice point
+            if(b.size == 1){
+                fill(b, mat, body);
+                continue;
+            }
+
+            const size_t i10 = i00 + b.size;
+            const size_t i01 = i00 + b.size*latticeWidth;
+            const size_t i11 = i01 + b.size;
+            if(latticeBody[i10] == body && latticeBody[i01] == body && latticeBody[i11] == body &&
+               latticeMat[i10] == mat && latticeMat[i01] == mat && latticeMat[i11] == mat){
+                //Uniform block
+                fill(b, mat, body);
+                continue;
+            }
+
+            //Subdivide the block and request the new corners
+            const unsigned half = b.size/2;
+            requestPoint(b.x + half, b.y);
+            requestPoint(b.x, b.y + half);
+            requestPoint(b.x + half, b.y + half);
+            if(half > 1){
+                //Single pixel children only need its own pixel
+                requestPoint(b.x + b.size, b.y + half);
+                requestPoint(b.x + half, b.y + b.size);
+            }
+
+            children.push_back(block{b.x, b.y, half});
+            if(b.x + half < ncols)
+                children.push_back(block{b.x + half, b.y, half});
+            if(b.y + half < nrows){
+                children.push_back(block{b.x, b.y + half, half});
+                if(b.x + half < ncols)
+                    children.push_back(block{b.x + half, b.y + half, half});
+            }
+        }
+
+        if(!children.empty())
+            sampleRequested(children.front().size);
+        std::swap(blocks, children);
+    }
+
+    if(stats != nullptr){
+        stats->queries += queries;
+        stats->calls += calls;
+    }
+}
+
+bool sliceRenderer::renderAdaptive(const renderRequest& request, renderFrame& frame,
+                                   const cancelToken& token, renderStats* stats,
+                                   tileScheduler& scheduler, const bool background){
+
+    const unsigned width = request.width;
+    const unsigned height = request.height;
+    if(width == 0 || height == 0)
+        return true;
+
+    const unsigned nTilesX = (width + tileSize - 1)/tileSize;
+    const unsigned nTilesY = (height + tileSize - 1)/tileSize;
+
+    std::atomic<bool> skipped(false);
+    scheduler.parallelFor(static_cast<size_t>(nTilesX)*nTilesY, [&](size_t itile){
+
+        if(token.cancelled()){
+            skipped = true;
+            return;
+        }
+
+        const unsigned col0 = static_cast<unsigned>(itile % nTilesX)*tileSize;
+        const unsigned row0 = static_cast<unsigned>(itile / nTilesX)*tileSize;
+        const unsigned ncols = std::min(tileSize, width - col0);
+        const unsigned nrows = std::min(tileSize, height - row0);
+
+        adaptiveTile(request, col0, row0, ncols, nrows, frame, stats);
+    }, background);
+
+    return !skipped;
+}
+
+bool sliceRenderer::renderPass(const renderRequest& request, renderFrame& frame,
+                               const unsigned stride, const bool first,
+                               const cancelToken& token, renderStats* stats,
+                               tileScheduler& scheduler){
+
+    const unsigned width = request.width;
+    const unsigned height = request.height;
+    if(width == 0 || height == 0)
+        return true;
+
+    //Sub-lattices of the pass, as (column offset, row offset, step). The
+    //first pass renders the whole lattice. The following ones skip the
+    //points of the previous pass, which is twice as coarse
+    struct subLattice{
+        unsigned ox, oy, step;
+    };
+    std::vector<subLattice> lattices;
+    if(first){
+        lattices.push_back(subLattice{0, 0, stride});
+    }else{
+        lattices.push_back(subLattice{stride, 0, 2*stride});
+        lattices.push_back(subLattice{0, stride, 2*stride});
+        lattices.push_back(subLattice{stride, stride, 2*stride});
+    }
+
+    const unsigned nTilesX = (width + tileSize - 1)/tileSize;
+    const unsigned nTilesY = (height + tileSize - 1)/tileSize;
+
+    std::atomic<bool> skipped(false);
+    scheduler.parallelFor(static_cast<size_t>(nTilesX)*nTilesY, [&](size_t itile){
+
+        if(token.cancelled()){
+            skipped = true;
+            return;
+        }
+
+        //Tiles start at multiples of the tile size, so the lattices
+        //of each tile are aligned with the whole image ones
+        const unsigned col0 = static_cast<unsigned>(itile % nTilesX)*tileSize;
+        const unsigned row0 = static_cast<unsigned>(itile / nTilesX)*tileSize;
+        const unsigned ncols = std::min(tileSize, width - col0);
+        const unsigned nrows = std::min(tileSize, height - row0);
+
+        thread_local std::vector<unsigned char> tileMat;
+        thread_local std::vector<unsigned int> tileBody;
+
+        for(const subLattice& lattice : lattices){
+            if(lattice.ox >= ncols || lattice.oy >= nrows)
+                continue;
+            const unsigned nx = (ncols - lattice.ox + lattice.step - 1)/lattice.step;
+            const unsigned ny = (nrows - lattice.oy + lattice.step - 1)/lattice.step;
+            const size_t nSamples = static_cast<size_t>(nx)*ny;
+            tileMat.resize(nSamples);
+            tileBody.resize(nSamples);
+
+            renderRegion(request, col0 + lattice.ox, row0 + lattice.oy, nx, ny,
+                         tileMat.data(), tileBody.data(), lattice.step);
+            if(stats != nullptr){
+                stats->queries += nSamples;
+                ++stats->calls;
+            }
+
+            //Scatter the samples to their frame pixels
+            for(unsigned j = 0; j < ny; ++j){
+                const size_t rowOffset = static_cast<size_t>(row0 + lattice.oy + j*lattice.step)*width;
+                for(unsigned i = 0; i < nx; ++i){
+                    const size_t to = rowOffset + col0 + lattice.ox + i*lattice.step;
+                    const size_t from = static_cast<size_t>(j)*nx + i;
+                    frame.matImage[to] = tileMat[from];
+                    frame.bodyImage.set(to, tileBody[from]);
+                }
+            }
+        }
+    });
+
+    return !skipped;
+}
+
+void sliceRenderer::fillPreview(const renderFrame& frame, const unsigned stride,
+                                renderFrame& preview){
+
+    const unsigned width = frame.width;
+    const unsigned height = frame.height;
+
+    preview.request = frame.request;
+    preview.width = width;
+    preview.height = height;
+    preview.phi3D = frame.phi3D;
+    preview.previewStride = stride;
+    preview.resampled = false;
+    preview.distances.clear();
+    preview.matImage.resize(frame.nPixels());
+    preview.bodyImage.resize(frame.nPixels(), frame.bodyImage.elementBytes());
+
+    for(unsigned j = 0; j < height; ++j){
+        const size_t rowOffset = static_cast<size_t>(j)*width;
+        if(j % stride != 0){
+            //Repeat the previous row
+            std::copy(preview.matImage.begin() + (rowOffset - width),
+                      preview.matImage.begin() + rowOffset,
+                      preview.matImage.begin() + rowOffset);
+            preview.bodyImage.copy(preview.bodyImage, rowOffset - width, rowOffset, width);
+            continue;
+        }
+        for(unsigned i = 0; i < width; i += stride){
+            const unsigned iEnd = std::min(i + stride, width);
+            std::fill(preview.matImage.begin() + (rowOffset + i),
+                      preview.matImage.begin() + (rowOffset + iEnd),
+                      frame.matImage[rowOffset + i]);
+            preview.bodyImage.fill(rowOffset + i, rowOffset + iEnd, frame.bodyImage[rowOffset + i]);
+        }
+    }
+}
+
+bool sliceRenderer::shiftable(const renderRequest& request, const renderFrame& last,
+                              int& dx, int& dy){
+
+    const renderRequest& lastRequest = last.request;
+    if(lastRequest.perspective != request.perspective || request.perspective > 2 ||
+       lastRequest.width != request.width || lastRequest.height != request.height ||
+       lastRequest.pixelSize != request.pixelSize ||
+       lastRequest.exactRender != request.exactRender)
+        return false;
+
+    double h, v, depth;
+    double hlast, vlast, depthLast;
+    planeCoordinates(request.perspective, request.x, request.y, request.z, h, v, depth);
+    planeCoordinates(lastRequest.perspective, lastRequest.x, lastRequest.y, lastRequest.z,
+                     hlast, vlast, depthLast);
+
+    const double tolerance = 1.0e-3;
+    if(std::fabs(depth - depthLast) > tolerance*request.pixelSize)
+        return false;
+
+    //Displacement in pixels
+    const double dh = (h - hlast)/request.pixelSize;
+    const double dv = (v - vlast)/request.pixelSize;
+    const double dhRound = std::round(dh);
+    const double dvRound = std::round(dv);
+    if(std::fabs(dh - dhRound) > tolerance || std::fabs(dv - dvRound) > tolerance)
+        return false;
+
+    //Nothing can be reused if the whole image has been moved out
+    if(std::fabs(dhRound) >= static_cast<double>(request.width) ||
+       std::fabs(dvRound) >= static_cast<double>(request.height))
+        return false;
+
+    //Image rows grow downwards, i.e. along -v
+    dx = static_cast<int>(dhRound);
+    dy = -static_cast<int>(dvRound);
+    return true;
+}
+
+bool sliceRenderer::renderRectangle(const renderRequest& request, renderFrame& frame,
+                                    const unsigned col0, const unsigned row0,
+                                    const unsigned ncols, const unsigned nrows,
+                                    const cancelToken& token, renderStats* stats,
+                                    tileScheduler& scheduler, const bool background){
+
+    if(ncols == 0 || nrows == 0)
+        return true;
+
+    const unsigned width = frame.width;
+    const unsigned nTilesX = (ncols + tileSize - 1)/tileSize;
+    const unsigned nTilesY = (nrows + tileSize - 1)/tileSize;
+
+    std::atomic<bool> skipped(false);
+    scheduler.parallelFor(static_cast<size_t>(nTilesX)*nTilesY, [&](size_t itile){
+
+        if(token.cancelled()){
+            skipped = true;
+            return;
+        }
+
+        const unsigned tileCol0 = col0 + static_cast<unsigned>(itile % nTilesX)*tileSize;
+        const unsigned tileRow0 = row0 + static_cast<unsigned>(itile / nTilesX)*tileSize;
+        const unsigned tileCols = std::min(tileSize, col0 + ncols - tileCol0);
+        const unsigned tileRows = std::min(tileSize, row0 + nrows - tileRow0);
+
+        //Render the tile in a thread local buffer, the geometry
+        //library stores the results contiguously
+        thread_local std::vector<unsigned char> tileMat;
+        thread_local std::vector<unsigned int> tileBody;
+        const size_t tilePixels = static_cast<size_t>(tileCols)*tileRows;
+        tileMat.resize(tilePixels);
+        tileBody.resize(tilePixels);
+
+        renderRegion(request, tileCol0, tileRow0, tileCols, tileRows, tileMat.data(), tileBody.data());
+        if(stats != nullptr){
+            stats->queries += tilePixels;
+            ++stats->calls;
+        }
+
+        //Copy the tile rows to the frame
+        for(unsigned j = 0; j < tileRows; ++j){
+            const size_t from = static_cast<size_t>(j)*tileCols;
+            const size_t to = static_cast<size_t>(tileRow0 + j)*width + tileCol0;
+            std::copy(tileMat.begin() + from, tileMat.begin() + from + tileCols, frame.matImage.begin() + to);
+            frame.bodyImage.store(to, tileBody.data() + from, tileCols);
+        }
+    }, background);
+
+    return !skipped;
+}
+
+bool sliceRenderer::renderShift(const renderRequest& request, const renderFrame& last,
+                                const int dx, const int dy, renderFrame& frame,
+                                const cancelToken& token, renderStats* stats,
+                                tileScheduler& scheduler){
+
+    const unsigned width = request.width;
+    const unsigned height = request.height;
+
+    //Pixel (i,j) of the new frame is the pixel (i+dx, j+dy) of the
+    //previous one. Copy the overlapping region
+    const unsigned adx = static_cast<unsigned>(std::abs(dx));
+    const unsigned ady = static_cast<unsigned>(std::abs(dy));
+    const unsigned keptCols = width - adx;
+    const unsigned keptRows = height - ady;
+    const unsigned keptCol0 = dx < 0 ? adx : 0; //First kept column in the new frame
+    const unsigned keptRow0 = dy < 0 ? ady : 0; //First kept row in the new frame
+
+    for(unsigned j = 0; j < keptRows; ++j){
+        const size_t to = static_cast<size_t>(keptRow0 + j)*width + keptCol0;
+        const size_t from = static_cast<size_t>(static_cast<int>(keptRow0 + j) + dy)*width +
+                            static_cast<size_t>(static_cast<int>(keptCol0) + dx);
+        std::copy(last.matImage.begin() + from, last.matImage.begin() + from + keptCols,
+                  frame.matImage.begin() + to);
+        frame.bodyImage.copy(last.bodyImage, from, to, keptCols);
+    }
+
+    //Render the exposed L shaped region as a full width band of rows
+    //and a band of columns along the kept rows
+    const unsigned bandRow0 = dy > 0 ? keptRows : 0;
+    if(!renderRectangle(request, frame, 0, bandRow0, width, ady, token, stats, scheduler))
+        return false;
+
+    const unsigned bandCol0 = dx > 0 ? keptCols : 0;
+    return renderRectangle(request, frame, bandCol0, keptRow0, adx, keptRows, token, stats, scheduler);
+}
+
+bool sliceRenderer::zoomable(const renderRequest& request, const renderFrame& last){
+
+    const renderRequest& lastRequest = last.request;
+    if(lastRequest.perspective != request.perspective || request.perspective > 2 ||
+       lastRequest.width != request.width || lastRequest.height != request.height ||
+       lastRequest.exactRender != request.exactRender ||
+       lastRequest.pixelSize == request.pixelSize ||
+       request.width == 0 || request.height == 0)
+        return false;
+
+    double h, v, depth;
+    double hlast, vlast, depthLast;
+    planeCoordinates(request.perspective, request.x, request.y, request.z, h, v, depth);
+    planeCoordinates(lastRequest.perspective, lastRequest.x, lastRequest.y, lastRequest.z,
+                     hlast, vlast, depthLast);
+
+    if(std::fabs(depth - depthLast) > 1.0e-3*std::min(request.pixelSize, lastRequest.pixelSize))
+        return false;
+
+    //Check if both images overlap
+    const double halfW = 0.5*static_cast<double>(request.width);
+    const double halfH = 0.5*static_cast<double>(request.height);
+    return std::fabs(h - hlast) < halfW*(request.pixelSize + lastRequest.pixelSize) &&
+           std::fabs(v - vlast) < halfH*(request.pixelSize + lastRequest.pixelSize);
+}
+
+void sliceRenderer::resample(const renderRequest& request, const renderFrame& last,
+                             renderFrame& frame, std::vector<unsigned char>& refine,
+                             tileScheduler& scheduler){
+
+    const unsigned width = request.width;
+    const unsigned height = request.height;
+    const int lastWidth = static_cast<int>(last.width);
+    const int lastHeight = static_cast<int>(last.height);
+
+    double h, v, depth;
+    double hlast, vlast, depthLast;
+    planeCoordinates(request.perspective, request.x, request.y, request.z, h, v, depth);
+    planeCoordinates(last.request.perspective, last.request.x, last.request.y, last.request.z,
+                     hlast, vlast, depthLast);
+
+    //Source column and row of each pixel, -1 if out of the previous frame
+    const double ratio = request.pixelSize/last.request.pixelSize;
+    std::vector<int> sourceCol(width), sourceRow(height);
+    for(unsigned i = 0; i < width; ++i){
+        const double hi = (h - hlast)/last.request.pixelSize +
+            static_cast<double>(static_cast<int>(i) - static_cast<int>(width/2))*ratio;
+        const int is = static_cast<int>(std::lround(hi)) + lastWidth/2;
+        sourceCol[i] = is >= 0 && is < lastWidth ? is : -1;
+    }
+    for(unsigned j = 0; j < height; ++j){
+        const double vj = (vlast - v)/last.request.pixelSize +
+            static_cast<double>(static_cast<int>(j) - static_cast<int>(height/2))*ratio;
+        const int js = static_cast<int>(std::lround(vj)) + lastHeight/2;
+        sourceRow[j] = js >= 0 && js < lastHeight ? js : -1;
+    }
+
+    refine.resize(static_cast<size_t>(width)*height);
+
+    //Checks if a source pixel is surrounded by pixels with the same values.
+    //Pixels on the previous frame edges are never considered uniform
+    auto uniform = [&](const int is, const int js){
+        if(is == 0 || js == 0 || is == lastWidth-1 || js == lastHeight-1)
+            return false;
+        const size_t center = static_cast<size_t>(js)*lastWidth + is;
+        const unsigned char mat = last.matImage[center];
+        const unsigned int body = last.bodyImage[center];
+        for(int dj = -1; dj <= 1; ++dj){
+            const size_t rowOffset = static_cast<size_t>(js + dj)*lastWidth;
+            for(int di = -1; di <= 1; ++di){
+                const size_t index = rowOffset + (is + di);
+                if(last.matImage[index] != mat || last.bodyImage[index] != body)
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    const unsigned rowsPerTask = 16;
+    const unsigned nTasks = (height + rowsPerTask - 1)/rowsPerTask;
+    scheduler.parallelFor(nTasks, [&](size_t itask){
+        const unsigned rowEnd = std::min(height, static_cast<unsigned>(itask + 1)*rowsPerTask);
+        for(unsigned j = static_cast<unsigned>(itask)*rowsPerTask; j < rowEnd; ++j){
+            const size_t rowOffset = static_cast<size_t>(j)*width;
+            const int js = sourceRow[j];
+            for(unsigned i = 0; i < width; ++i){
+                const int is = sourceCol[i];
+                if(js < 0 || is < 0){
+                    //Exposed region
+                    frame.matImage[rowOffset + i] = 0;
+                    frame.bodyImage.set(rowOffset + i, 0);
+                    refine[rowOffset + i] = 1;
+                    continue;
+                }
+                const size_t source = static_cast<size_t>(js)*lastWidth + is;
+                frame.matImage[rowOffset + i] = last.matImage[source];
+                frame.bodyImage.set(rowOffset + i, last.bodyImage[source]);
+                refine[rowOffset + i] = uniform(is, js) ? 0 : 1;
+            }
+        }
+    });
+}
+
+bool sliceRenderer::renderMasked(const renderRequest& request, renderFrame& frame,
+                                 const std::vector<unsigned char>& mask,
+                                 const cancelToken& token, renderStats* stats,
+                                 tileScheduler& scheduler){
+
+    const unsigned width = request.width;
+    const unsigned height = request.height;
+
+    const unsigned rowsPerTask = 8;
+    const unsigned nTasks = (height + rowsPerTask - 1)/rowsPerTask;
+
+    std::atomic<bool> skipped(false);
+    scheduler.parallelFor(nTasks, [&](size_t itask){
+
+        if(token.cancelled()){
+            skipped = true;
+            return;
+        }
+
+        thread_local std::vector<unsigned char> runMat;
+        thread_local std::vector<unsigned int> runBody;
+        unsigned long long queries = 0;
+        unsigned long long calls = 0;
+
+        const unsigned rowEnd = std::min(height, static_cast<unsigned>(itask + 1)*rowsPerTask);
+        for(unsigned j = static_cast<unsigned>(itask)*rowsPerTask; j < rowEnd; ++j){
+            const size_t rowOffset = static_cast<size_t>(j)*width;
+            unsigned i = 0;
+            while(i < width){
+                if(mask[rowOffset + i] == 0){
+                    ++i;
+                    continue;
+                }
+                //Find consecutive flagged pixels
+                unsigned iEnd = i + 1;
+                while(iEnd < width && mask[rowOffset + iEnd] != 0)
+                    ++iEnd;
+
+                const unsigned n = iEnd - i;
+                runMat.resize(n);
+                runBody.resize(n);
+                renderRegion(request, i, j, n, 1, runMat.data(), runBody.data());
+                std::copy(runMat.begin(), runMat.end(), frame.matImage.begin() + (rowOffset + i));
+                frame.bodyImage.store(rowOffset + i, runBody.data(), n);
+                queries += n;
+                ++calls;
+                i = iEnd;
+            }
+        }
+
+        if(stats != nullptr){
+            stats->queries += queries;
+            stats->calls += calls;
+        }
+    });
+
+    return !skipped;
+}
@@ -0,0 +1,190 @@
+#ifndef SLICERENDER_H
+#define SLICERENDER_H
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+#include "pen_geoViewInterface.hh"
+#include "renderframe.h"
+#include "tilescheduler.h"
+
+//Host side helpers to render 2D slices (perspectives X, Y and Z) through
+//the geometry library.
+//
+//Each slice is described by plane coordinates (h,v), i.e. the horizontal
+//and vertical image axis, and the depth coordinate along the view axis:
+//
+//   X -> (y,z), depth x
+//   Y -> (x,z), depth y
+//   Z -> (x,y), depth z
+//
+//Renders of nx x ny pixels centered at (hc,vc) store the pixel (i,j),
+//with j the image row, at
+//
+//   h = hc + (i - nx/2)*dh
+//   v = vc - (j - ny/2)*dv
+//
+//using integer divisions, i.e. the first row is the top one. This layout
+//is used to split a slice in regions rendered by independent calls.
+
+//Geometry queries performed by slice renders
+struct renderStats{
+    std::atomic<unsigned long long> queries{0}; //Pixels requested to the library
+    std::atomic<unsigned long long> calls{0};   //Library calls
+};
+
+class sliceRenderer{
+
+public:
+
+    //Tile side, in pixels, used to split slices among threads
+    static constexpr unsigned tileSize = 128;
+    //Side, in pixels, of the coarse blocks sampled by adaptive renders
+    static constexpr unsigned adaptiveBlock = 16;
+    //Coarsest sample spacing, in pixels, of progressive renders. Must be
+    //a power of two which divides 'tileSize'
+    static constexpr unsigned progressiveStride = 8;
+    //Slices with fewer pixels are rendered without previews
+    static constexpr size_t progressiveMinPixels = 256*256;
+
+    static inline void planeCoordinates(const unsigned perspective,
+                                        const double x, const double y, const double z,
+                                        double& h, double& v, double& depth){
+        if(perspective == 0){
+            h = y; v = z; depth = x;
+        }else if(perspective == 1){
+            h = x; v = z; depth = y;
+        }else{
+            h = x; v = y; depth = z;
+        }
+    }
+
+    static inline void spaceCoordinates(const unsigned perspective,
+                                        const double h, const double v, const double depth,
+                                        double& x, double& y, double& z){
+        if(perspective == 0){
+            x = depth; y = h; z = v;
+        }else if(perspective == 1){
+            x = h; y = depth; z = v;
+        }else{
+            x = h; y = v; z = depth;
+        }
+    }
+
+    //Returns the pool selected by the request
+    static inline tileScheduler& requestScheduler(const renderRequest& request){
+        return request.scheduler != nullptr ? *request.scheduler : tileScheduler::instance();
+    }
+
+    //Calculates the space position of the center of the region with
+    //'ncols' x 'nrows' pixels starting at pixel (col0, row0). With a
+    //stride greater than one, only one of each 'stride' pixels is included
+    //in the region along both image axis
+    static void regionCenter(const renderRequest& request,
+                             const unsigned col0, const unsigned row0,
+                             const unsigned ncols, const unsigned nrows,
+                             double& x, double& y, double& z,
+                             const unsigned stride = 1);
+
+    //Renders a region of the slice described by the request. Results are
+    //stored contiguously in the output buffers, i.e. with 'ncols' pixels per row
+    static void renderRegion(const renderRequest& request,
+                             const unsigned col0, const unsigned row0,
+                             const unsigned ncols, const unsigned nrows,
+                             unsigned char* renderMat, unsigned int* renderBody,
+                             const unsigned stride = 1,
+                             const unsigned nthreads = 1);
+
+    //Renders the whole slice in tiles using the shared tile scheduler. The
+    //cancellation token is checked before each tile. Returns false if the
+    //render has been cancelled. Background renders use only idle threads
+    static bool renderTiles(const renderRequest& request, renderFrame& frame,
+                            const cancelToken& token,
+                            renderStats* stats = nullptr,
+                            tileScheduler& scheduler = tileScheduler::instance(),
+                            const bool background = false);
+
+    //Renders the whole slice in tiles like 'renderTiles', but each tile is
+    //first sampled on a coarse grid of 'adaptiveBlock' pixels. Blocks whose
+    //corners share body and material are filled without more queries, and
+    //the remaining ones are subdivided until single pixels are reached.
+    //Features smaller than a block which touch none of its sampled corners
+    //can be missed, use 'renderTiles' for exact results
+    static bool renderAdaptive(const renderRequest& request, renderFrame& frame,
+                               const cancelToken& token,
+                               renderStats* stats = nullptr,
+                               tileScheduler& scheduler = tileScheduler::instance(),
+                               const bool background = false);
+
+    //Renders a pass of a progressive render, i.e. the pixels whose row and
+    //column are multiples of 'stride'. If 'first' is false, the pixels with
+    //both multiples of 2*stride have already been rendered by the previous
+    //pass and are not requested again. Passes are rendered in tiles like
+    //'renderTiles' and the pixels of the frame not in the pass are not
+    //modified. Returns false if the render has been cancelled
+    static bool renderPass(const renderRequest& request, renderFrame& frame,
+                           const unsigned stride, const bool first,
+                           const cancelToken& token,
+                           renderStats* stats = nullptr,
+                           tileScheduler& scheduler = tileScheduler::instance());
+
+    //Fills 'preview' with the pixels rendered by a progressive pass of
+    //the specified stride, replicating each sample over its block
+    static void fillPreview(const renderFrame& frame, const unsigned stride,
+                            renderFrame& preview);
+
+    //Renders the rectangle of the frame with 'ncols' x 'nrows' pixels
+    //starting at pixel (col0, row0) in tiles, like 'renderTiles'
+    static bool renderRectangle(const renderRequest& request, renderFrame& frame,
+                                const unsigned col0, const unsigned row0,
+                                const unsigned ncols, const unsigned nrows,
+                                const cancelToken& token,
+                                renderStats* stats = nullptr,
+                                tileScheduler& scheduler = tileScheduler::instance(),
+                                const bool background = false);
+
+    //Checks if the request can be rendered shifting the previous frame, i.e.
+    //if both share the plane, the resolution and the pixel size, the
+    //centers differ in an integer number of pixels and both images overlap.
+    //On success, the displacement of the center in image columns and rows
+    //(rows grow downwards) is returned
+    static bool shiftable(const renderRequest& request, const renderFrame& last,
+                          int& dx, int& dy);
+
+    //Checks if the request can be rendered resampling the previous frame,
+    //i.e. if both share the plane and the resolution, the pixel size
+    //differs and the images overlap
+    static bool zoomable(const renderRequest& request, const renderFrame& last);
+
+    //Fills the frame with the nearest pixel of the previous frame, which
+    //can have a different pixel size and center. Pixels which must be
+    //rendered are flagged in 'refine': the pixels outside the previous
+    //frame, and the ones whose source pixel is not surrounded by pixels
+    //with its same material and body. Features smaller than the previous
+    //pixel size not touching any of its pixels can be missed
+    static void resample(const renderRequest& request, const renderFrame& last,
+                         renderFrame& frame, std::vector<unsigned char>& refine,
+                         tileScheduler& scheduler = tileScheduler::instance());
+
+    //Renders the pixels flagged in 'mask', grouping consecutive pixels of
+    //each row in a single call. Returns false if the render has been cancelled
+    static bool renderMasked(const renderRequest& request, renderFrame& frame,
+                             const std::vector<unsigned char>& mask,
+                             const cancelToken& token,
+                             renderStats* stats = nullptr,
+                             tileScheduler& scheduler = tileScheduler::instance());
+
+    //Renders the request moving the previous frame by (dx,dy) pixels. Only
+    //the exposed region, an L shaped strip for diagonal movements, is
+    //rendered. Returns false if the render has been cancelled
+    static bool renderShift(const renderRequest& request, const renderFrame& last,
+                            const int dx, const int dy, renderFrame& frame,
+                            const cancelToken& token,
+                            renderStats* stats = nullptr,
+                            tileScheduler& scheduler = tileScheduler::instance());
+};
+
+#endif // SLICERENDER_H
@@ -0,0 +1,278 @@
+//
+//  Incremental render test
+//
+//  Checks that the frames built by 'renderWorker' reusing the previous one,
+//  on slices and orthographic 3D views, match the full renders of the same
+//  requests when exact renders are enabled. The geometry is the procedural lattice of the mock library
+//  (see 'mock/mockgeoview.h'), linked in the executable, with spheres
+//  smaller than the initial pixels, so renders which only refine the
+//  previous frame miss them. Returns a non zero status on failures.
+//
+//  Usage:
+//
+//    GeometryViewerRefineTest
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <mutex>
+#include <condition_variable>
+#include <QCoreApplication>
+
+#include "renderworker.h"
+#include "framecache.h"
+#include "mock/mockgeoview.h"
+
+//Waits the final frames published by a worker, previews are skipped
+class frameWaiter{
+
+    std::mutex waitMutex;
+    std::condition_variable waitCondition;
+    renderFramePtr frame;
+
+public:
+
+    explicit frameWaiter(renderWorker& worker){
+        QObject::connect(&worker, &renderWorker::frameReady, [this](renderFramePtr newFrame){
+            if(newFrame->preview())
+                return;
+            std::lock_guard<std::mutex> lock(waitMutex);
+            frame = newFrame;
+            waitCondition.notify_one();
+        }, Qt::DirectConnection);
+    }
+
+    renderFramePtr wait(){
+        std::unique_lock<std::mutex> lock(waitMutex);
+        waitCondition.wait(lock, [this](){return frame != nullptr;});
+        renderFramePtr result = frame;
+        frame = nullptr;
+        return result;
+    }
+};
+
+//Counts the pixels of the frame which differ from the full render of its
+//request. Distances of orthographic 3D views must match too
+static size_t differences(const renderFrame& frame){
+
+    const renderRequest& request = frame.request;
+    renderFrame reference;
+    reference.request = request;
+    reference.request.moveOnPlane = false;
+    if(request.perspective == 3){
+        cameraRenderer::renderOrthoTiles(reference.request, request.width3D, request.height3D,
+                                         request.pixelSize3D, reference, cancelToken());
+    }else{
+        reference.width = request.width;
+        reference.height = request.height;
+        reference.matImage.resize(reference.nPixels());
+        reference.bodyImage.resize(reference.nPixels(), request.labelBytes);
+        sliceRenderer::renderTiles(reference.request, reference, cancelToken());
+    }
+
+    if(frame.width != reference.width || frame.height != reference.height)
+        return reference.nPixels();
+    size_t nDiff = 0;
+    for(size_t i = 0; i < reference.nPixels(); ++i){
+        if(frame.matImage[i] != reference.matImage[i] ||
+           frame.bodyImage[i] != reference.bodyImage[i] ||
+           (!reference.distances.empty() && frame.distances[i] != reference.distances[i]))
+            ++nDiff;
+    }
+    return nDiff;
+}
+
+//Zooms in a slice step by step, as the '+' key does
+static bool testSliceZoom(pen_geoViewInterface* penRedViewer){
+
+    renderWorker worker;
+    frameWaiter waiter(worker);
+
+    renderRequest request;
+    request.pPenRedViewer = penRedViewer;
+    request.perspective = 2;
+    request.z = 1.0;
+    request.width = 200;
+    request.height = 200;
+    request.pixelSize = 0.5;
+    request.labelBytes = labelImage::bytesFor(penRedViewer->getBodies());
+    request.exactRender = true;
+    request.progressive = false;
+    request.prefetchPlanes = 0;
+    worker.submit(request);
+    waiter.wait();
+
+    bool ok = true;
+    for(unsigned step = 1; step <= 15; ++step){
+        request.pixelSize *= 0.9;
+        request.moveOnPlane = true;
+        worker.submit(request);
+        const size_t nDiff = differences(*waiter.wait());
+        if(nDiff > 0){
+            printf("  Z slice zoom step %u: %lu pixels differ from the full render\n",
+                   step, static_cast<unsigned long>(nDiff));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+//Orthographic 3D request looking at the origin from (x,y,z)
+static renderRequest orthoRequest(pen_geoViewInterface* penRedViewer,
+                                  const double x, const double y, const double z){
+
+    renderRequest request;
+    request.pPenRedViewer = penRedViewer;
+    request.perspective = 3;
+    request.ortho3D = true;
+    request.width3D = 200;
+    request.height3D = 200;
+    request.pixelSize3D = 0.5;
+    request.camera3DX = x;
+    request.camera3DY = y;
+    request.camera3DZ = z;
+    request.u = -x;
+    request.v = -y;
+    request.w = -z;
+    request.omega = -1.5707963267948966;
+    request.labelBytes = labelImage::bytesFor(penRedViewer->getBodies());
+    request.exactRender = true;
+    request.progressive = false;
+    request.prefetchPlanes = 0;
+    return request;
+}
+
+//Zooms in an orthographic 3D view step by step, as the '+' key does
+static bool testOrthoZoom(pen_geoViewInterface* penRedViewer){
+
+    renderWorker worker;
+    frameWaiter waiter(worker);
+
+    renderRequest request = orthoRequest(penRedViewer, 40.0, 30.0, 50.0);
+    worker.submit(request);
+    renderFramePtr frame = waiter.wait();
+
+    bool ok = true;
+    for(unsigned step = 1; step <= 15; ++step){
+        //The viewer keeps the phi angle of the displayed frame
+        request.phi3D = frame->phi3D;
+        request.pixelSize3D *= 0.9;
+        request.moveOnPlane = true;
+        worker.submit(request);
+        frame = waiter.wait();
+        const size_t nDiff = differences(*frame);
+        if(nDiff > 0){
+            printf("  Orthographic zoom step %u: %lu pixels differ from the full render\n",
+                   step, static_cast<unsigned long>(nDiff));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+//Enables the exact render of an adaptive orthographic 3D view and moves
+//it before the exact frame is displayed, as a quick pan does
+static bool testOrthoExactSwitch(pen_geoViewInterface* penRedViewer){
+
+    renderWorker worker;
+    frameWaiter waiter(worker);
+
+    renderRequest request = orthoRequest(penRedViewer, 40.0, 30.0, 50.0);
+    request.exactRender = false;
+    worker.submit(request);
+    renderFramePtr frame = waiter.wait();
+
+    request.phi3D = frame->phi3D;
+    request.exactRender = true;
+    request.moveOnPlane = true;
+    worker.submit(request);
+    const size_t nDiff = differences(*waiter.wait());
+    if(nDiff > 0){
+        printf("  Exact orthographic pan: %lu pixels differ from the full render\n",
+               static_cast<unsigned long>(nDiff));
+        return false;
+    }
+    return true;
+}
+
+//Rotates an orthographic 3D view around the origin in small steps, which
+//are reprojected from the previous frame
+static bool testOrthoRotation(pen_geoViewInterface* penRedViewer){
+
+    renderWorker worker;
+    frameWaiter waiter(worker);
+
+    const double radius = 70.0;
+    double angle = 0.6;
+    renderRequest request = orthoRequest(penRedViewer, radius*std::cos(angle),
+                                         radius*std::sin(angle), 30.0);
+    worker.submit(request);
+    renderFramePtr frame = waiter.wait();
+
+    bool ok = true;
+    for(unsigned step = 1; step <= 15; ++step){
+        angle += 0.02;
+        const renderRequest rotated = orthoRequest(penRedViewer, radius*std::cos(angle),
+                                                   radius*std::sin(angle), 30.0);
+        request.camera3DX = rotated.camera3DX;
+        request.camera3DY = rotated.camera3DY;
+        request.u = rotated.u;
+        request.v = rotated.v;
+        request.phi3D = frame->phi3D;
+        request.moveOnPlane = true;
+        worker.submit(request);
+        frame = waiter.wait();
+        const size_t nDiff = differences(*frame);
+        if(nDiff > 0){
+            printf("  Orthographic rotation step %u: %lu pixels differ from the full render\n",
+                   step, static_cast<unsigned long>(nDiff));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const char* configFile = "refinetest.conf";
+    FILE* fout = fopen(configFile, "w");
+    if(fout == nullptr){
+        printf("Unable to create '%s'\n", configFile);
+        return EXIT_FAILURE;
+    }
+    fprintf(fout, "scene lattice\n");
+    fprintf(fout, "lattice 20 20 20 2.0 0.1\n");
+    fprintf(fout, "materials 12\n");
+    fclose(fout);
+
+    mockGeoView penRedViewer;
+    if(penRedViewer.init(configFile, 0) != 0){
+        printf("Error loading the mock geometry\n");
+        return EXIT_FAILURE;
+    }
+
+    //Compare rendered frames only
+    frameCache::instance().setBudget(0);
+
+    bool ok = true;
+    const bool sliceZoom = testSliceZoom(&penRedViewer);
+    printf("%s chained slice zooms\n", sliceZoom ? "PASS" : "FAIL");
+    ok = ok && sliceZoom;
+
+    const bool orthoZoom = testOrthoZoom(&penRedViewer);
+    printf("%s chained orthographic zooms\n", orthoZoom ? "PASS" : "FAIL");
+    ok = ok && orthoZoom;
+
+    const bool orthoExact = testOrthoExactSwitch(&penRedViewer);
+    printf("%s exact orthographic pan after adaptive frames\n", orthoExact ? "PASS" : "FAIL");
+    ok = ok && orthoExact;
+
+    const bool orthoRotation = testOrthoRotation(&penRedViewer);
+    printf("%s reprojected orthographic rotations\n", orthoRotation ? "PASS" : "FAIL");
+    ok = ok && orthoRotation;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,181 @@
+#include "tilescheduler.h"
+
+tileScheduler::tileScheduler(const unsigned nthreads)
+    : queuedTasks(0), nextQueue(0), stop(false)
+{
+    //The calling thread uses its own queue too
+    const size_t nQueues = static_cast<size_t>(nthreads) + 1;
+    queues.reserve(nQueues);
+    for(size_t i = 0; i < nQueues; ++i)
+        queues.push_back(std::make_unique<taskQueue>());
+
+    threads.reserve(nthreads);
+    for(size_t i = 0; i < nthreads; ++i)
+        threads.emplace_back(&tileScheduler::workerLoop, this, i);
+}
+
+tileScheduler::~tileScheduler(){
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stop = true;
+    }
+    wakeUp.notify_all();
+    for(std::thread& t : threads)
+        t.join();
+}
+
+tileScheduler& tileScheduler::instance(){
+
+    //The caller participates in the work, so a thread less is required
+    static tileScheduler scheduler(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return scheduler;
+}
+
+bool tileScheduler::popTask(const size_t iqueue, taskItem& item, const bool background){
+
+    //Try the own queue first
+    {
+        taskQueue& queue = *queues[iqueue];
+        std::lock_guard<std::mutex> lock(queue.queueMutex);
+        if(!queue.tasks.empty()){
+            item = queue.tasks.front();
+            queue.tasks.pop_front();
+            --queuedTasks;
+            return true;
+        }
+    }
+
+    //Steal from the back of the other queues
+    const size_t nQueues = queues.size();
+    for(size_t i = 1; i < nQueues; ++i){
+        taskQueue& queue = *queues[(iqueue + i) % nQueues];
+        std::lock_guard<std::mutex> lock(queue.queueMutex);
+        if(!queue.tasks.empty()){
+            item = queue.tasks.back();
+            queue.tasks.pop_back();
+            --queuedTasks;
+            return true;
+        }
+    }
+
+    //Take background tasks only when there is nothing else to do
+    if(background){
+        std::lock_guard<std::mutex> lock(backgroundQueue.queueMutex);
+        if(!backgroundQueue.tasks.empty()){
+            item = backgroundQueue.tasks.front();
+            backgroundQueue.tasks.pop_front();
+            --queuedTasks;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool tileScheduler::popBatchTask(const taskBatch& batch, taskItem& item){
+
+    //Search from the back of the queues, where the tasks of the latest
+    //calls are, so the batch tasks are usually found at once
+    auto popFrom = [&](taskQueue& queue){
+        std::lock_guard<std::mutex> lock(queue.queueMutex);
+        for(auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it){
+            if(it->batch == &batch){
+                item = *it;
+                queue.tasks.erase(std::next(it).base());
+                --queuedTasks;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for(const std::unique_ptr<taskQueue>& queue : queues){
+        if(popFrom(*queue))
+            return true;
+    }
+    return popFrom(backgroundQueue);
+}
+
+void tileScheduler::execute(const taskItem& item){
+
+    taskBatch& batch = *item.batch;
+    (*batch.task)(item.index);
+
+    //The batch can be destroyed as soon as the mutex is released
+    std::lock_guard<std::mutex> lock(batch.batchMutex);
+    if(--batch.remaining == 0)
+        batch.finished.notify_all();
+}
+
+void tileScheduler::workerLoop(const size_t iqueue){
+
+    for(;;){
+        taskItem item;
+        if(popTask(iqueue, item, true)){
+            execute(item);
+            continue;
+        }
+
+        //No work available, sleep until new tasks are queued
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this]{ return stop || queuedTasks.load() > 0; });
+        if(stop)
+            return;
+    }
+}
+
+void tileScheduler::parallelFor(const size_t nTasks, const std::function<void(size_t)>& task,
+                                const bool background, const bool ownTasks){
+
+    if(nTasks == 0)
+        return;
+
+    taskBatch batch;
+    batch.task = &task;
+    batch.remaining = nTasks;
+
+    //Count the tasks before queue them, so they are never negative
+    queuedTasks += nTasks;
+
+    //Distribute the tasks among all queues, starting at a different
+    //queue on each call to spread concurrent batches
+    const size_t nQueues = queues.size();
+    if(background){
+        std::lock_guard<std::mutex> lock(backgroundQueue.queueMutex);
+        for(size_t i = 0; i < nTasks; ++i)
+            backgroundQueue.tasks.push_back(taskItem{&batch, i});
+    }else{
+        const size_t first = nextQueue++ % nQueues;
+        for(size_t iq = 0; iq < nQueues; ++iq){
+            taskQueue& queue = *queues[(first + iq) % nQueues];
+            std::lock_guard<std::mutex> lock(queue.queueMutex);
+            for(size_t i = iq; i < nTasks; i += nQueues)
+                queue.tasks.push_back(taskItem{&batch, i});
+        }
+    }
+    {
+        //Synchronize with threads going to sleep
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeUp.notify_all();
+
+    //Help with the queued work until this batch is empty. Foreground
+    //calls don't take background tasks, to not delay their own batch,
+    //and 'ownTasks' calls take only the tasks of their batch
+    const size_t ownQueue = nQueues - 1;
+    for(;;){
+        {
+            std::lock_guard<std::mutex> lock(batch.batchMutex);
+            if(batch.remaining == 0)
+                break;
+        }
+        taskItem item;
+        if(ownTasks ? popBatchTask(batch, item) : popTask(ownQueue, item, background))
+            execute(item);
+        else
+            break;
+    }
+
+    //Wait for the tasks still running in other threads
+    std::unique_lock<std::mutex> lock(batch.batchMutex);
+    batch.finished.wait(lock, [&batch]{ return batch.remaining == 0; });
+}
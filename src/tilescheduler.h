@@ -0,0 +1,90 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+//Persistent thread pool shared by all viewers to render image tiles.
+//
+//Each pool thread owns a task queue. The tasks of a 'parallelFor' call are
+//distributed among all queues, and threads which run out of work steal
+//tasks from the back of the other queues. This balances the load between
+//tiles on empty regions, which are cheap, and tiles with many geometry
+//boundaries. The calling thread also executes tasks until its own call
+//has been completed. By default it takes tasks of any call, but calls
+//flagged with 'ownTasks' only run their own tasks on the caller, e.g. to
+//keep the GUI thread out of the render tiles queued by other viewers.
+//
+//Background tasks, e.g. speculative renders, are kept in a separate queue
+//and are executed only by threads which found no other work.
+class tileScheduler
+{
+
+private:
+
+    struct taskBatch{
+        const std::function<void(size_t)>* task;
+        size_t remaining;
+        std::mutex batchMutex;
+        std::condition_variable finished;
+    };
+
+    struct taskItem{
+        taskBatch* batch;
+        size_t index;
+    };
+
+    struct taskQueue{
+        std::mutex queueMutex;
+        std::deque<taskItem> tasks;
+    };
+
+    std::vector<std::unique_ptr<taskQueue>> queues;
+    taskQueue backgroundQueue;
+    std::vector<std::thread> threads;
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<size_t> queuedTasks;
+    std::atomic<size_t> nextQueue;
+    bool stop;
+
+    bool popTask(const size_t iqueue, taskItem& item, const bool background);
+    bool popBatchTask(const taskBatch& batch, taskItem& item);
+    void execute(const taskItem& item);
+    void workerLoop(const size_t iqueue);
+
+public:
+
+    //Creates a pool with 'nthreads' threads. With zero threads, all
+    //tasks are executed by the calling thread
+    explicit tileScheduler(const unsigned nthreads);
+    ~tileScheduler();
+
+    tileScheduler(const tileScheduler&) = delete;
+    tileScheduler& operator=(const tileScheduler&) = delete;
+
+    //Pool shared by all viewers, using all the available cores
+    static tileScheduler& instance();
+
+    //Number of threads working on a 'parallelFor' call, including the caller
+    inline unsigned readThreads() const {return static_cast<unsigned>(threads.size()) + 1;}
+
+    //Executes 'task(i)' for each i in [0,nTasks) and returns when all
+    //of them have finished. It can be called concurrently from several
+    //threads, all calls share the pool threads. Background calls are
+    //executed only when no other tasks are waiting. With 'ownTasks', the
+    //calling thread executes only tasks of this call while it waits.
+    void parallelFor(const size_t nTasks, const std::function<void(size_t)>& task,
+                     const bool background = false, const bool ownTasks = false);
+};
+
+#endif // TILESCHEDULER_H
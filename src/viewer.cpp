@@ -1,37 +1,103 @@
 #include "viewer.h"
 
 std::array<unsigned char, viewer::nColorsPos> viewer::colors;
+std::vector<QString> viewer::bodyNames;
+unsigned viewer::labelBytes = 4;
+unsigned long long viewer::nKeys = 0;
+unsigned viewer::nProfileIds = 0;
+
+double frameView::scale() const{
+    //The image covers the whole widget, keeping its aspect ratio
+    if(image.width() == 0 || image.height() == 0)
+        return 0.0;
+    return std::max(static_cast<double>(width())/static_cast<double>(image.width()),
+                    static_cast<double>(height())/static_cast<double>(image.height()));
+}
+
+void frameView::paintEvent(QPaintEvent*){
+
+    const long long start = frameProfiler::now();
+
+    QPainter painter(this);
+    const double factor = scale();
+    if(factor <= 0.0){
+        //Nothing rendered yet
+        painter.fillRect(rect(), Qt::black);
+    }else{
+        //Draw the image centered, scaled by the painter
+        painter.translate(0.5*width(), 0.5*height());
+        painter.scale(factor, factor);
+        painter.drawImage(QPointF(-0.5*image.width(), -0.5*image.height()), image);
+        painter.resetTransform();
+    }
+
+    if(perspective != 3){ //No 3D
+        //Add the coordinate system
+        const int midH = width()/2;
+        const int midV = height()/2;
+        const double imageWidth = factor*image.width();
+        const double imageHeight = factor*image.height();
+
+        painter.save();
+        painter.setPen(QPen(Qt::white, std::min(imageWidth, imageHeight)/2000.0, Qt::DashLine));
+        painter.setOpacity(0.8);
+        painter.drawLine(0, midV, width(), midV);
+        painter.drawLine(midH, 0, midH, height());
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setRenderHint(QPainter::TextAntialiasing, true);
+
+        static const char* axes[3][2] = {{"Y", "Z"}, {"X", "Z"}, {"X", "Y"}};
+        painter.drawText(QPoint(width()*0.9, midV-2), axes[perspective][0]);
+        painter.drawText(QPoint(midH+2, height()*0.1), axes[perspective][1]);
+        painter.restore();
+    }
 
-viewer::viewer(std::vector<uchar>& bufferIn,
-               std::vector<unsigned char>& matImageIn,
-               std::vector<unsigned int>& bodyImageIn,
-               std::vector<float>& distancesIn,
-               QWidget *parent)
-    : QWidget{parent}, buffer(bufferIn), matImage(matImageIn), bodyImage(bodyImageIn), distances(distancesIn),
-      x(0.0), y(0.0), z(0.0), xlast(0.0), ylast(0.0), zlast(0.0), camera3DX(0.0), camera3DY(0.0), camera3DZ(0.0),
+    const long long end = frameProfiler::now();
+
+    if(!overlay.isEmpty()){
+        QFont font = painter.font();
+        font.setStyleHint(QFont::Monospace);
+        font.setFamily("monospace");
+        painter.setFont(font);
+        const QRect textRect = painter.boundingRect(rect().adjusted(8, 8, -8, -8),
+                                                    Qt::AlignLeft | Qt::AlignTop, overlay);
+        painter.fillRect(textRect.adjusted(-4, -4, 4, 4), QColor(0, 0, 0, 160));
+        painter.setPen(Qt::white);
+        painter.drawText(textRect, Qt::AlignLeft | Qt::AlignTop, overlay);
+    }
+
+    if(painted)
+        painted(start, end);
+}
+
+viewer::viewer(QWidget *parent)
+    : QWidget{parent},
+      x(0.0), y(0.0), z(0.0), camera3DX(0.0), camera3DY(0.0), camera3DZ(0.0),
       u(0.0), v(0.0), w(1.0), rho(10.0), theta(1.5707963267948966), phi(0.0), omega(-1.5707963267948966), lastRender3DPhi(0.0),
-      perspective(0), matView(true), pixelSize(0.1), pixelSize3D(0.1), pPenRedViewer(nullptr), geometryLoaded(false)
+      dragging(false), dragResidualX(0.0), dragResidualY(0.0),
+      perspective(0), ortho3D(false), matView(true), exactRender(true), progressiveRender(true), prefetchPlanes(2), pixelSize(0.1), pixelSize3D(0.1), pPenRedViewer(nullptr), scheduler(nullptr), keyMatView(true), keyValid(false), keyVersion(0), keyPage(0), keyPageShown(0), geometryLoaded(false), generation(0),
+      profileId(nProfileIds++), timingPending(false), lastSubmit(0), lastRepaint(-1), showTimings(false)
 {
 
-    //Calculate the number of threads
-    nthreads = std::thread::hardware_concurrency();
-    if(nthreads % 2 == 0)
-        nthreads /= 2;
-    else
-        nthreads = nthreads/2 + 1;
+    //Receive rendered frames from the render thread
+    connect(&worker, &renderWorker::frameReady, this, &viewer::on_frameReady, Qt::QueuedConnection);
 
-    //Configure the label
-    label.setSizePolicy(QSizePolicy::Expanding,QSizePolicy::Expanding);
-    label.setMinimumSize(10,10); //Enable resizing the label itself to small size
-    label.setTextInteractionFlags(Qt::TextSelectableByMouse);
-    label.setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
-    label.setTextInteractionFlags(Qt::TextSelectableByMouse);
+    //Time the view repaints
+    view.painted = [this](long long paintStart, long long paintEnd){
+        finishTiming(paintStart, paintEnd);
+    };
+
+    //Configure the view
+    view.setSizePolicy(QSizePolicy::Expanding,QSizePolicy::Expanding);
+    view.setMinimumSize(10,10); //Enable resizing the view itself to small size
+    //The image covers the whole widget, skip the background
+    view.setAttribute(Qt::WA_OpaquePaintEvent);
 
     //Set the main layout
     QVBoxLayout* widgetLayout = new QVBoxLayout;
     setLayout(widgetLayout);
-    //Add the label
-    layout()->addWidget(&label);
+    //Add the view
+    layout()->addWidget(&view);
 
     //Create the base image
     imageWidth = 600;
@@ -39,130 +105,28 @@ viewer::viewer(std::vector<uchar>& bufferIn,
     image3DWidth = 400;
     image3DHeight = 400;
 
-
-    for(size_t i = 0; i < imageWidth*imageHeight; ++i){
-        buffer[i*3  ] = 0;   //Red
-        buffer[i*3+1] = 0;   //Green
-        buffer[i*3+2] = 0;   //Blue
-    }
-
-    //Create the image
-    image = QImage(buffer.data(), imageWidth, imageHeight, imageWidth*3, QImage::Format_RGB888);
-
-    //Create a pixel map from image
-    pixMap = QPixmap::fromImage(image);
-
-    //Set the pixmap in the label scaling int
+    //The color buffer is allocated with the first frame,
+    //the view is black until then
     resizeImage();
 }
 
-std::array<unsigned char, viewer::nColorsPos> viewer::defaultColors(){
-
-    const unsigned int baseIncrementPerRow = 300;
-    const unsigned int baseSteps = 2;
-    const unsigned int stepIncrement = baseIncrementPerRow/baseSteps;
-    const unsigned int colorsPerRow = 7*baseSteps;
-    const unsigned int nRows = 1 + nColors / colorsPerRow;
-    const unsigned int maxIntensity = baseIncrementPerRow*nRows + stepIncrement*baseSteps;
-
-    std::array<unsigned char, nColorsPos> a{};
-
-    //Define first color as black
-    a[0] = 0;
-    a[1] = 0;
-    a[2] = 0;
-    //Set color counter
-    size_t icolor = 1;
-    for(size_t irow = 0; irow < nRows ; ++irow){
-        //Init RGB
-        unsigned int R = maxIntensity - baseIncrementPerRow*irow;
-        unsigned int G = maxIntensity - baseIncrementPerRow*irow;
-        unsigned int B = maxIntensity - baseIncrementPerRow*irow;
-
-        size_t colorIndex = 3*icolor++;
-        a[colorIndex  ] = R;
-        a[colorIndex+1] = G;
-        a[colorIndex+2] = B;
-
-        //R increase
-        for(size_t istep = 0; istep < baseSteps; ++istep){
-            R += stepIncrement;
-            colorIndex = 3*icolor++;
-            if(icolor < nColors){
-                a[colorIndex  ] = R;
-                a[colorIndex+1] = G;
-                a[colorIndex+2] = B;
-            }
-        }
-
-        //G increase
-        for(size_t istep = 0; istep < baseSteps; ++istep){
-            G += stepIncrement;
-            colorIndex = 3*icolor++;
-            if(icolor < nColors){
-                a[colorIndex  ] = R;
-                a[colorIndex+1] = G;
-                a[colorIndex+2] = B;
-            }
-        }
-
-        //R decrease
-        for(size_t istep = 0; istep < baseSteps; ++istep){
-            R -= stepIncrement;
-            colorIndex = 3*icolor++;
-            if(icolor < nColors){
-                a[colorIndex  ] = R;
-                a[colorIndex+1] = G;
-                a[colorIndex+2] = B;
-            }
-        }
-
-        //B increase
-        for(size_t istep = 0; istep < baseSteps; ++istep){
-            B += stepIncrement;
-            colorIndex = 3*icolor++;
-            if(icolor < nColors){
-                a[colorIndex  ] = R;
-                a[colorIndex+1] = G;
-                a[colorIndex+2] = B;
-            }
-        }
-
-        //G decrease
-        for(size_t istep = 0; istep < baseSteps; ++istep){
-            G -= stepIncrement;
-            colorIndex = 3*icolor++;
-            if(icolor < nColors){
-                a[colorIndex  ] = R;
-                a[colorIndex+1] = G;
-                a[colorIndex+2] = B;
-            }
-        }
-
-        //R increase
-        for(size_t istep = 0; istep < baseSteps; ++istep){
-            R += stepIncrement;
-            colorIndex = 3*icolor++;
-            if(icolor < nColors){
-                a[colorIndex  ] = R;
-                a[colorIndex+1] = G;
-                a[colorIndex+2] = B;
-            }
-        }
-
-        //B partial decrease
-        for(size_t istep = 0; istep < baseSteps-1; ++istep){
-            B -= stepIncrement;
-            colorIndex = 3*icolor++;
-            if(icolor < nColors){
-                a[colorIndex  ] = R;
-                a[colorIndex+1] = G;
-                a[colorIndex+2] = B;
-            }
-        }
+void viewer::loadBodyNames(const pen_geoViewInterface* p){
+    bodyNames.clear();
+    labelBytes = 4;
+    if(p == nullptr)
+        return;
+    const unsigned nBodies = p->getBodies();
+    //Points outside the geometry are labelled with the number of bodies
+    labelBytes = labelImage::bytesFor(nBodies);
+    bodyNames.reserve(nBodies);
+    for(unsigned i = 0; i < nBodies; ++i){
+        //Cut long body names to 20 characters
+        bodyNames.push_back(QString::fromStdString(p->getBodyName(i).substr(0,20)));
     }
+}
 
-    return a;
+std::array<unsigned char, viewer::nColorsPos> viewer::defaultColors(){
+    return colorMap::defaultColors();
 }
 
 void viewer::resetColors(){
@@ -173,29 +137,22 @@ void viewer::copy(const viewer& viewer2copy){
     imageWidth = viewer2copy.imageWidth;
     imageHeight = viewer2copy.imageHeight;
 
-    //Copy material, body and distances buffers
-    matImage = viewer2copy.matImage;
-    bodyImage = viewer2copy.bodyImage;
-    distances = viewer2copy.distances;
+    //Share the displayed frame, frames are never modified once rendered
+    frame = viewer2copy.frame;
 
-    //Copy buffer data
+    //Copy buffer data and the image over it
     buffer = viewer2copy.buffer;
-    //Create the image
-    image = QImage(buffer.data(), imageWidth, imageHeight, imageWidth*3, QImage::Format_RGB888);
-
-    //Create a pixel map from image
-    pixMap = QPixmap::fromImage(image);
+    if(viewer2copy.image.isNull())
+        image = QImage();
+    else
+        image = QImage(reinterpret_cast<const uchar*>(buffer.data()), viewer2copy.image.width(),
+                       viewer2copy.image.height(), viewer2copy.image.width()*4, QImage::Format_RGB32);
 
     //Copy position
     x = viewer2copy.x;
     y = viewer2copy.y;
     z = viewer2copy.z;
 
-    //Copy last position
-    xlast = viewer2copy.xlast;
-    ylast = viewer2copy.ylast;
-    zlast = viewer2copy.zlast;
-
     //Copy look at position
     camera3DX = viewer2copy.camera3DX;
     camera3DY = viewer2copy.camera3DY;
@@ -213,18 +170,36 @@ void viewer::copy(const viewer& viewer2copy){
 
     //Copy perspective
     perspective = viewer2copy.perspective;
+    ortho3D = viewer2copy.ortho3D;
 
     //Copy material/body view type
     matView = viewer2copy.matView;
 
+    //Copy render mode
+    exactRender = viewer2copy.exactRender;
+    progressiveRender = viewer2copy.progressiveRender;
+    prefetchPlanes = viewer2copy.prefetchPlanes;
+
     //Copy pixel size
     pixelSize = viewer2copy.pixelSize;
 
+    //Copy 3D resolution
+    image3DWidth = viewer2copy.image3DWidth;
+    image3DHeight = viewer2copy.image3DHeight;
+    pixelSize3D = viewer2copy.pixelSize3D;
+
     //Copy penred render
     pPenRedViewer = viewer2copy.pPenRedViewer;
 
     //Copy key text
     keyText = viewer2copy.keyText;
+    visibleLabels = viewer2copy.visibleLabels;
+    keyVisible = viewer2copy.keyVisible;
+    keyMatView = viewer2copy.keyMatView;
+    keyValid = viewer2copy.keyValid;
+    keyVersion = viewer2copy.keyVersion;
+    keyPage = viewer2copy.keyPage;
+    keyPageShown = viewer2copy.keyPageShown;
 
     //Copy geometry loaded flag
     geometryLoaded = viewer2copy.geometryLoaded;
@@ -236,279 +211,318 @@ void viewer::copy(const viewer& viewer2copy){
 
 void viewer::geometryLoad(){
     geometryLoaded = true;
-    render();
+    //Body names may have changed
+    keyValid = false;
+    //Frames of the previous geometry are no longer valid
+    frameCache::instance().clear();
+    //The load can reset the 3D resolution of the library
+    renderWorker::resetResolution3D();
+    //Hidden viewers render when they are shown again
+    if(!isHidden())
+        render();
     emit changed(this);
 }
 
-void viewer::render(bool moveOnPlane, unsigned char direction, unsigned nPixels){
+void viewer::geometryUnload(){
+    //No requests are submitted until the geometry is loaded again
+    geometryLoaded = false;
+    worker.cancelAndWait();
+}
 
-    // direction -> On move on plane renders, 0, 1, 2, 3 means left, right, up and down respectivelly
+renderRequest viewer::createRequest() const{
+
+    renderRequest request;
+    request.pPenRedViewer = pPenRedViewer;
+    request.perspective = perspective;
+
+    request.x = x;
+    request.y = y;
+    request.z = z;
+    request.pixelSize = pixelSize;
+    request.width = imageWidth;
+    request.height = imageHeight;
+    request.scheduler = scheduler;
+    request.exactRender = exactRender;
+    request.progressive = progressiveRender;
+    request.labelBytes = labelBytes;
+    request.prefetchPlanes = prefetchPlanes;
+    request.prefetchStep = static_cast<double>(keyStepPixels)*pixelSize;
+
+    request.camera3DX = camera3DX;
+    request.camera3DY = camera3DY;
+    request.camera3DZ = camera3DZ;
+    request.u = u;
+    request.v = v;
+    request.w = w;
+    request.omega = omega;
+    request.phi3D = lastRender3DPhi;
+    request.width3D = image3DWidth;
+    request.height3D = image3DHeight;
+    request.pixelSize3D = pixelSize3D;
+    request.perspective3D = perspective3DAngle;
+    request.ortho3D = ortho3D;
+    request.generation = generation;
+
+    return request;
+}
 
-    if(pPenRedViewer != nullptr && geometryLoaded){
-        if(perspective == 0){
-            if(moveOnPlane){
-                switch(direction){
-                    case 0:
-                        pPenRedViewer->renderXtoLeft(matImage.data(), bodyImage.data(), nPixels,
-                                                     xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                    case 1:
-                        pPenRedViewer->renderXtoRight(matImage.data(), bodyImage.data(), nPixels,
-                                                      xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                    case 2:
-                        pPenRedViewer->renderXtoUp(matImage.data(), bodyImage.data(), nPixels,
-                                                     xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                    case 3:
-                        pPenRedViewer->renderXtoDown(matImage.data(), bodyImage.data(), nPixels,
-                                                     xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                }
-            }else{
-                pPenRedViewer->renderX(matImage.data(), bodyImage.data(),
-                                       x,y,z, pixelSize, pixelSize, imageWidth, imageHeight, nthreads);
-            }
-        }else if(perspective == 1){
-            if(moveOnPlane){
-                switch(direction){
-                    case 0:
-                        pPenRedViewer->renderYtoLeft(matImage.data(), bodyImage.data(), nPixels,
-                                                     xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                    case 1:
-                        pPenRedViewer->renderYtoRight(matImage.data(), bodyImage.data(), nPixels,
-                                                      xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                    case 2:
-                        pPenRedViewer->renderYtoUp(matImage.data(), bodyImage.data(), nPixels,
-                                                     xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                    case 3:
-                        pPenRedViewer->renderYtoDown(matImage.data(), bodyImage.data(), nPixels,
-                                                     xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                }
-            }else{
-                pPenRedViewer->renderY(matImage.data(), bodyImage.data(),
-                                       x,y,z, pixelSize, pixelSize, imageWidth, imageHeight, nthreads);
-            }
-        }else if(perspective == 2){
-            if(moveOnPlane){
-                switch(direction){
-                    case 0:
-                        pPenRedViewer->renderZtoLeft(matImage.data(), bodyImage.data(), nPixels,
-                                                     xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                    case 1:
-                        pPenRedViewer->renderZtoRight(matImage.data(), bodyImage.data(), nPixels,
-                                                      xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                    case 2:
-                        pPenRedViewer->renderZtoUp(matImage.data(), bodyImage.data(), nPixels,
-                                                     xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                    case 3:
-                        pPenRedViewer->renderZtoDown(matImage.data(), bodyImage.data(), nPixels,
-                                                     xlast, ylast, zlast, pixelSize, pixelSize, imageWidth, imageHeight);
-                        break;
-                }
-            }else{
-                pPenRedViewer->renderZ(matImage.data(), bodyImage.data(),
-                                       x,y,z, pixelSize, pixelSize, imageWidth, imageHeight, nthreads);
-            }
-        }else if(perspective == 3){
+renderRequest viewer::createPosterRequest(const unsigned scale) const{
 
-            pPenRedViewer->render3D(matImage.data(), bodyImage.data(),
-                                    camera3DX, camera3DY, camera3DZ, u, v, w, omega, lastRender3DPhi, distances.data(), minD, maxD);
-        }
+    renderRequest request = createRequest();
+    request.width = imageWidth*scale;
+    request.height = imageHeight*scale;
+    request.pixelSize = pixelSize/static_cast<double>(scale);
+    request.exactRender = true;
+    request.progressive = false;
+    request.prefetchPlanes = 0;
+    return request;
+}
+
+void viewer::render(bool moveOnPlane){
+
+    // moveOnPlane -> Try to render only the region exposed by the movement,
+    //                or changed by the zoom, and reproject 3D views
 
-        xlast = x;
-        ylast = y;
-        zlast = z;
-        updateMatView();
+    if(pPenRedViewer != nullptr && geometryLoaded){
+
+        //Send a snapshot of the camera state to the render thread. Pending
+        //requests are superseded, so only the newest position is rendered
+        renderRequest request = createRequest();
+        request.moveOnPlane = moveOnPlane;
+        lastSubmit = frameProfiler::now();
+        worker.submit(request);
     }
 }
 
+void viewer::on_frameReady(renderFramePtr newFrame, unsigned long long requestGeneration){
+
+    //Frames requested before the viewer was deleted, which can
+    //arrive after it has been added again
+    if(isHidden() || requestGeneration != generation)
+        return;
+
+    //Display the new frame. The previous one is released and
+    //can be reused by the render thread
+    frame = newFrame;
+    //Previews are rendered at lower resolution, keep the final phi
+    if(frame->request.perspective == 3 && !frame->preview())
+        lastRender3DPhi = frame->phi3D;
+
+    //Frames rendered before the last request come from the cache
+    beginTiming();
+    if(frame->renderStart >= lastSubmit)
+        timing.set(frameTiming::QUERY, frame->renderStart, frame->renderEnd);
+    else
+        timing.cached = true;
+
+    updateMatView();
+    emit rendered(this);
+}
+
 void viewer::updateMatView(){
 
-    //Check if geometry has been loaded
-    if(!geometryLoaded)
+    //Check if geometry has been loaded and rendered
+    if(!geometryLoaded || !frame)
         return;
 
+    if(!timingPending)
+        beginTiming();
+
     //Set the image in the label
-    std::array<bool,nColors> visibleColors{false};
+    visibleLabels.clear();
 
-    unsigned int renderWidth;
-    unsigned int renderHeight;
-    if(perspective == 3){ //3D
-        renderWidth = image3DWidth;
-        renderHeight= image3DHeight;
-    }else{
-        renderWidth = imageWidth;
-        renderHeight= imageHeight;
-    }
+    //Use the frame dimensions, the viewer ones could have been
+    //changed while the frame was rendered
+    const unsigned int renderWidth = frame->width;
+    const unsigned int renderHeight = frame->height;
 
-    const unsigned int nRenderPixels = renderWidth*renderHeight;
+    long long stageStart = frameProfiler::now();
+    reserveBuffer(frame->nPixels());
+    colorMap::colorize(*frame, matView, colors, buffer.data(), &visibleLabels, scheduler);
+    long long stageEnd = frameProfiler::now();
+    timing.set(frameTiming::COLORIZE, stageStart, stageEnd);
 
-    if(perspective != 3){ //No 3D
-        if(matView){
-            for(size_t i = 0; i < nRenderPixels; ++i){
-                size_t index = i*3;
-                unsigned imat = matImage[i];
-                unsigned icolor = 3*imat;
-                if(imat < nColors){
-                    buffer[index  ] = colors[icolor  ];
-                    buffer[index+1] = colors[icolor+1];
-                    buffer[index+2] = colors[icolor+2];
-
-                    //Flag this material as visible
-                    visibleColors[imat] = true;
-                }else{
-                    //Out of range, set it to white
-                    buffer[index  ] = 255;
-                    buffer[index+1] = 255;
-                    buffer[index+2] = 255;
-                }
-            }
-        }else{
-            for(size_t i = 0; i < nRenderPixels; ++i){
-                size_t index = i*3;
-                unsigned ibody = bodyImage[i];
-                unsigned icolor = 3*ibody;
-                if(ibody < nColors){
-                    buffer[index  ] = colors[icolor  ];
-                    buffer[index+1] = colors[icolor+1];
-                    buffer[index+2] = colors[icolor+2];
-
-                    //Flag this body as visible
-                    visibleColors[ibody] = true;
-                }else{
-                    //Out of range, set it to white
-                    buffer[index  ] = 255;
-                    buffer[index+1] = 255;
-                    buffer[index+2] = 255;
-                }
-            }
-        }
-    }else{ //3D case
-        float distInterval = (maxD-minD);
-        if(matView){
-            for(size_t i = 0; i < nRenderPixels; ++i){
-                size_t index = i*3;
-                unsigned imat = matImage[i];
-                unsigned icolor = 3*imat;
-                float beyondFact = (distances[i]-minD)/distInterval;
-                float distanceCorrection = 1.0/(1.0 + 1.1*beyondFact);
-                if(imat < nColors){
-                    buffer[index  ] = colors[icolor  ]*distanceCorrection;
-                    buffer[index+1] = colors[icolor+1]*distanceCorrection;
-                    buffer[index+2] = colors[icolor+2]*distanceCorrection;
-
-                    //Flag this material as visible
-                    visibleColors[imat] = true;
-                }else{
-                    //Out of range, set it to white
-                    buffer[index  ] = 255;
-                    buffer[index+1] = 255;
-                    buffer[index+2] = 255;
-                }
-            }
-        }else{
-            for(size_t i = 0; i < nRenderPixels; ++i){
-                size_t index = i*3;
-                unsigned ibody = bodyImage[i];
-                unsigned icolor = 3*ibody;
-                float beyondFact = (distances[i]-minD)/distInterval;
-                float distanceCorrection = 1.2/(1.0 + 2.0*beyondFact);
-                if(ibody < nColors){
-                    buffer[index  ] = colors[icolor  ]*distanceCorrection;
-                    buffer[index+1] = colors[icolor+1]*distanceCorrection;
-                    buffer[index+2] = colors[icolor+2]*distanceCorrection;
-
-                    //Flag this body as visible
-                    visibleColors[ibody] = true;
-                }else{
-                    //Out of range, set it to white
-                    buffer[index  ] = 255;
-                    buffer[index+1] = 255;
-                    buffer[index+2] = 255;
-                }
-            }
-        }
-    }
+    //Rebuild the key only if the visible labels have changed
+    updateKey();
+    stageStart = stageEnd;
+    stageEnd = frameProfiler::now();
+    timing.set(frameTiming::LEGEND, stageStart, stageEnd);
+
+    //Wrap the buffer, the image is painted without copies
+    image = QImage(reinterpret_cast<const uchar*>(buffer.data()), renderWidth, renderHeight, renderWidth*4, QImage::Format_RGB32);
+    timing.set(frameTiming::IMAGE, stageEnd, frameProfiler::now());
+
+    resizeImage();
+}
+
+void viewer::reserveBuffer(const size_t nPixels){
+
+    //Grow geometrically, so sequences of increasing resolutions
+    //reallocate only a few times. The displayed image is rebuilt
+    //over the new buffer after colorization
+    if(buffer.size() >= nPixels)
+        return;
+    size_t newSize = std::max(nPixels, 2*buffer.size());
+    if(nPixels <= maxPixels)
+        newSize = std::min(newSize, maxPixels);
+    std::vector<uint32_t>().swap(buffer);
+    buffer.resize(newSize);
+}
+
+void viewer::releaseBuffers(){
+
+    //Stop rendering and free the worker frames. Frames already
+    //requested are discarded
+    worker.release();
+    ++generation;
+
+    //Free the displayed frame and the color buffer
+    frame.reset();
+    image = QImage();
+    view.image = QImage();
+    std::vector<uint32_t>().swap(buffer);
+    visibleLabels.clear();
+    keyVisible.clear();
+    keyValid = false;
+    view.update();
+}
+
+size_t viewer::readMemoryUsage() const{
+    return buffer.capacity()*sizeof(uint32_t) + worker.readMemoryUsage();
+}
+
+void viewer::updateKey(){
+
+    //Keep the page in range when the visible labels change
+    const unsigned nPages = readKeyPages();
+    const unsigned page = keyPage < nPages ? keyPage : nPages - 1;
+
+    if(keyValid && keyMatView == matView && keyPageShown == page && keyVisible == visibleLabels)
+        return;
 
-    //Fill key text with the corresponding colors
+    //Fill key text with the colors of the labels in the page
     keyText = QString("<table>\n <tr>");
     size_t included = 0;
-    for(size_t i = 0; i < viewer::nColors; ++i){
+    visibleLabels.forEach([&](const unsigned ilabel){
 
-        if(visibleColors[i]){
-            if(included % 3 == 0 && included > 0){
-                keyText.append(" </tr>\n<tr>");
-            }
-
-            std::string text2show;
-            if(matView){
-                const char* matString  = " Material ";
-                text2show = matString + std::to_string(i);
-            }else{
-                std::string bodyName = pPenRedViewer->getBodyName(i);
-                text2show = bodyName.substr(0,20); //Cut long body names to 20 characters
-            }
+        if(included % keyColumns == 0 && included > 0){
+            keyText.append(" </tr>\n<tr>");
+        }
 
-            size_t index = i*3;
-            keyText.append(std::string("<th style=\"color:rgb(" + std::to_string(viewer::colors[index]) + "," + std::to_string(viewer::colors[index+1]) + "," + std::to_string(viewer::colors[index+2]) + ")\"> " + text2show + " </th>\n").c_str());
-            ++included;
+        QString text2show;
+        if(matView){
+            text2show = QString(" Material %1").arg(ilabel);
+        }else if(ilabel < bodyNames.size()){
+            text2show = bodyNames[ilabel];
+        }else{
+            text2show = QString(" Body %1").arg(ilabel);
         }
-    }
+
+        const uint32_t color = colorMap::labelColor(ilabel, colors);
+        keyText.append(QString("<th style=\"color:rgb(%1,%2,%3)\"> %4 </th>\n")
+                       .arg(color >> 16 & 0xff).arg(color >> 8 & 0xff).arg(color & 0xff)
+                       .arg(text2show));
+        ++included;
+    }, static_cast<size_t>(page)*keyPageSize, keyPageSize);
     keyText.append(" </tr>\n</table>");
 
-    //Create the image
-    image = QImage(buffer.data(), renderWidth, renderHeight, renderWidth*3, QImage::Format_RGB888);
+    keyVisible = visibleLabels;
+    keyMatView = matView;
+    keyPageShown = page;
+    keyValid = true;
+    keyVersion = ++nKeys;
+}
 
-    //Create a pixel map from image
-    pixMap = QPixmap::fromImage(image);
+unsigned viewer::readKeyPages() const{
+    const size_t nLabels = visibleLabels.size();
+    return nLabels == 0 ? 1 : static_cast<unsigned>((nLabels + keyPageSize - 1)/keyPageSize);
+}
 
-    resizeImage();
+void viewer::setKeyPage(unsigned page){
+    keyPage = page;
+    updateKey();
 }
 
 void viewer::resizeImage(){
 
-    //Create a resized pixel map
-    QPixmap scaledPixMap = pixMap.scaled(label.width(), label.height(), Qt::KeepAspectRatioByExpanding);
+    //Time display updates of rendered frames only
+    const bool timed = frame != nullptr;
+    if(timed && !timingPending)
+        beginTiming();
+    const long long scaleStart = frameProfiler::now();
 
-    if(perspective != 3){ //No 3D
-        //Add the coordinate system
+    //Show the image with the axis of the displayed frame perspective.
+    //Scaling is done by the view on repaint
+    view.image = image;
+    view.perspective = frame ? frame->request.perspective : perspective;
 
-        size_t midH = scaledPixMap.width()/2;
-        size_t midV = scaledPixMap.height()/2;
+    if(timed){
+        timing.set(frameTiming::SCALE, scaleStart, frameProfiler::now());
+        updateOverlay();
+    }
 
-        QPainter painter(&scaledPixMap);
-        painter.setPen(QPen(Qt::white, std::min(scaledPixMap.width(),scaledPixMap.height())/2000.0, Qt::DashLine));
-        painter.setOpacity(0.8);
-        painter.drawLine(0,midV,scaledPixMap.width(),midV);
-        painter.drawLine(midH,0,midH,scaledPixMap.height());
-        painter.setRenderHint(QPainter::Antialiasing, true);
-        painter.setRenderHint(QPainter::TextAntialiasing, true);
-        painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    view.update();
+}
 
-        if(perspective == 0){ //X
-            painter.drawText(QPoint(scaledPixMap.width()*0.9,midV-2), "Y");
-            painter.drawText(QPoint(midH+2, scaledPixMap.height()*0.1), "Z");
-        }
-        else if(perspective == 1){ //Y
-            painter.drawText(QPoint(scaledPixMap.width()*0.9,midV-2), "X");
-            painter.drawText(QPoint(midH+2, scaledPixMap.height()*0.1), "Z");
-        }
-        else if(perspective == 2){ //Z
-            painter.drawText(QPoint(scaledPixMap.width()*0.9,midV-2), "X");
-            painter.drawText(QPoint(midH+2, scaledPixMap.height()*0.1), "Y");
-        }
+void viewer::beginTiming(){
+
+    //Frames never repainted, e.g. on hidden viewers, are recorded as they are
+    if(timingPending)
+        frameProfiler::instance().record(profileId, timing);
+
+    timing = frameTiming();
+    if(frame){
+        timing.perspective = frame->request.perspective;
+        timing.width = frame->width;
+        timing.height = frame->height;
+        timing.preview = frame->preview();
+        timing.rays = frame->rays;
+    }
+    timingPending = true;
+}
+
+void viewer::finishTiming(const long long paintStart, const long long paintEnd){
+
+    //Only the first repaint after a frame update belongs to the frame
+    if(!timingPending)
+        return;
+
+    timing.set(frameTiming::REPAINT, paintStart, paintEnd);
+    frameProfiler::instance().record(profileId, timing);
+    timingPending = false;
+    lastRepaint = paintEnd - paintStart;
+}
+
+void viewer::updateOverlay(){
+
+    if(!showTimings){
+        view.overlay.clear();
+        return;
     }
 
-    //Set the pixmap in the label scaling int
-    label.setPixmap(scaledPixMap);
+    //The repaint of this frame happens later, show the last one
+    QString text = QString("%1x%2%3\n").arg(timing.width).arg(timing.height)
+                                       .arg(timing.preview ? " preview" : "");
+    if(timing.rays > 0 && !timing.cached){
+        //Adaptive renders trace only a fraction of the pixels
+        const double pixels = static_cast<double>(timing.width)*static_cast<double>(timing.height);
+        text.append(QString("%1 %2 (%3% of pixels)\n").arg("rays", -9).arg(timing.rays)
+                    .arg(100.0*static_cast<double>(timing.rays)/pixels, 0, 'f', 1));
+    }
+    for(unsigned i = 0; i < frameTiming::nStages; ++i){
+        QString value;
+        if(i == frameTiming::QUERY && timing.cached)
+            value = "cached";
+        else if(i == frameTiming::REPAINT && lastRepaint >= 0)
+            value = QString("%1 ms").arg(static_cast<double>(lastRepaint)/1000.0, 0, 'f', 2);
+        else if(timing.measured(i))
+            value = QString("%1 ms").arg(static_cast<double>(timing.duration[i])/1000.0, 0, 'f', 2);
+        else
+            value = "-";
+        text.append(QString("%1 %2\n").arg(frameTiming::stageName(i), -9).arg(value));
+    }
+    text.append(QString("%1 %2 ms").arg("total", -9).arg(timing.total(), 0, 'f', 2));
+    view.overlay = text;
 }
 
 std::vector<geoError> viewer::test() const{
@@ -532,15 +546,6 @@ std::vector<geoError> viewer::test() const{
     return errors;
 }
 
-void viewer::update3D(unsigned width, unsigned height, double pixSize){
-    image3DWidth = width;
-    image3DHeight = height;
-    pixelSize3D = pixSize;
-    if(perspective == 3){ //3D
-        render();
-    }
-}
-
 //Setter functions
 
 void viewer::setViewer(const pen_geoViewInterface* p, const bool _geometryLoaded){
@@ -559,6 +564,30 @@ void viewer::setImageHeight(unsigned height){
         render();
 }
 
+void viewer::setImage3DWidth(unsigned width){
+    if(width == image3DWidth)
+        return;
+    image3DWidth = width;
+    if(perspective == 3) //3D
+        render();
+}
+void viewer::setImage3DHeight(unsigned height){
+    if(height == image3DHeight)
+        return;
+    image3DHeight = height;
+    if(perspective == 3) //3D
+        render();
+}
+void viewer::setPixelSize3D(double newPixelSize){
+    if(newPixelSize < 0.00001)
+        newPixelSize = 0.00001;
+    if(newPixelSize == pixelSize3D)
+        return;
+    pixelSize3D = newPixelSize;
+    if(perspective == 3) //3D, orthographic views resample the current frame
+        render(ortho3D);
+}
+
 void viewer::setX(double newX){
     x = newX;
     render();
@@ -596,6 +625,38 @@ void viewer::update3Ddirections(){
     emit changed(this);
 }
 
+void viewer::pan3D(const double dh, const double dv){
+
+    if(pPenRedViewer == nullptr)
+        return;
+
+    //Move the camera and the look at point along the image axes,
+    //keeping the view direction. Orthographic images are just shifted
+    double eh[3], ev[3], dir[3];
+    cameraRenderer::imageAxes(createRequest(), eh, ev, dir);
+    const double offset[3] = {dh*eh[0] + dv*ev[0],
+                              dh*eh[1] + dv*ev[1],
+                              dh*eh[2] + dv*ev[2]};
+    const double newX = camera3DX + offset[0];
+    const double newY = camera3DY + offset[1];
+    const double newZ = camera3DZ + offset[2];
+    const double newRho = sqrt(newX*newX + newY*newY + newZ*newZ);
+    if(newRho <= 0.0)
+        return;
+
+    x += offset[0];
+    y += offset[1];
+    z += offset[2];
+
+    //Spherical coordinates of the new camera position
+    rho = newRho;
+    theta = acos(newZ/newRho);
+    phi = atan2(newY, newX);
+    if(phi < 0.0)
+        phi += 6.283185307179586;
+    update3Ddirections();
+}
+
 void viewer::setRho(double newRho){
     rho = newRho;
     update3Ddirections();
@@ -616,19 +677,47 @@ void viewer::setPhi(double newPhi){
 }
 
 void viewer::setPerspective(unsigned index){
-    perspective = index;
+    ortho3D = index == 4;
+    perspective = ortho3D ? 3 : index;
     if(perspective == 3) //3D
         update3Ddirections();
     render();
 }
 void viewer::setMatView(bool enabled){
     matView = enabled;
+    //Also used to apply palette changes, rebuild the key colors
+    keyValid = false;
     updateMatView();
 }
+void viewer::setExactRender(bool enabled){
+    exactRender = enabled;
+    if(perspective != 3 || ortho3D) //Perspective 3D views are always exact
+        render();
+}
+void viewer::setProgressiveRender(bool enabled){
+    //Applies to the next renders
+    progressiveRender = enabled;
+}
+void viewer::setPrefetchPlanes(unsigned planes){
+    prefetchPlanes = planes;
+    if(perspective != 3) // not 3D
+        render();
+}
 void viewer::setPixelSize(double newPixelSize){
     pixelSize = newPixelSize;
     if(perspective != 3) // not 3D
-        render();
+        render(true);
+}
+
+void viewer::setScheduler(tileScheduler* newScheduler){
+    //Applies to the next renders
+    scheduler = newScheduler;
+}
+
+void viewer::setShowTimings(bool enabled){
+    showTimings = enabled;
+    updateOverlay();
+    view.update();
 }
 
 void viewer::resizeEvent(QResizeEvent *){
@@ -637,17 +726,111 @@ void viewer::resizeEvent(QResizeEvent *){
 }
 
 void viewer::mousePressEvent(QMouseEvent* event) {
+    //Start panning 2D slices and orthographic 3D views
+    if(event->button() == Qt::LeftButton && (perspective != 3 || ortho3D)){
+        dragging = true;
+        lastDragPosition = event->pos();
+        dragResidualX = 0.0;
+        dragResidualY = 0.0;
+    }
     emit clicked(this);
 }
 
+void viewer::mouseMoveEvent(QMouseEvent* event) {
+
+    if(!dragging || (perspective == 3 && !ortho3D))
+        return;
+
+    const double scale = displayScale();
+    if(scale <= 0.0)
+        return;
+
+    const QPoint delta = event->pos() - lastDragPosition;
+    lastDragPosition = event->pos();
+
+    //Accumulate the movement in image pixels and apply only whole pixels,
+    //so the previous frame can be shifted
+    dragResidualX += static_cast<double>(delta.x())/scale;
+    dragResidualY += static_cast<double>(delta.y())/scale;
+    const double dx = std::trunc(dragResidualX);
+    const double dy = std::trunc(dragResidualY);
+    if(dx == 0.0 && dy == 0.0)
+        return;
+    dragResidualX -= dx;
+    dragResidualY -= dy;
+
+    //The plane follows the mouse, so the center moves in the opposite
+    //direction. Image rows grow downwards
+    if(perspective == 3){
+        pan3D(-dx*pixelSize3D, dy*pixelSize3D);
+    }else{
+        double h, v, depth;
+        sliceRenderer::planeCoordinates(perspective, x, y, z, h, v, depth);
+        h -= dx*pixelSize;
+        v += dy*pixelSize;
+        sliceRenderer::spaceCoordinates(perspective, h, v, depth, x, y, z);
+    }
+
+    render(true);
+    emit changed(this);
+}
+
+void viewer::mouseReleaseEvent(QMouseEvent* event) {
+    if(event->button() == Qt::LeftButton)
+        dragging = false;
+}
+
+void viewer::wheelEvent(QWheelEvent* event) {
+
+    const int delta = event->angleDelta().y();
+    if(delta == 0)
+        return;
+
+    if(perspective == 3){ //3D
+        setPixelSize3D(delta > 0 ? pixelSize3D*0.9 : pixelSize3D*1.1);
+        emit changed(this);
+        return;
+    }
+
+    double newPixelSize = delta > 0 ? pixelSize*0.9 : pixelSize*1.1;
+    if(newPixelSize < 0.00001)
+        newPixelSize = 0.00001;
+
+    //Keep the plane point under the cursor fixed
+    const double scale = displayScale();
+    if(scale > 0.0){
+        const QPoint position = view.mapFrom(this, event->position().toPoint());
+        const double offsetX = (static_cast<double>(position.x()) - 0.5*view.width())/scale;
+        const double offsetY = (static_cast<double>(position.y()) - 0.5*view.height())/scale;
+
+        double h, v, depth;
+        sliceRenderer::planeCoordinates(perspective, x, y, z, h, v, depth);
+        h += offsetX*(pixelSize - newPixelSize);
+        v -= offsetY*(pixelSize - newPixelSize);
+        sliceRenderer::spaceCoordinates(perspective, h, v, depth, x, y, z);
+    }
+
+    pixelSize = newPixelSize;
+    render(true);
+    emit changed(this);
+}
+
+double viewer::displayScale() const{
+    //The image is scaled to cover the whole view
+    const unsigned width = perspective == 3 ? image3DWidth : imageWidth;
+    const unsigned height = perspective == 3 ? image3DHeight : imageHeight;
+    if(width == 0 || height == 0)
+        return 0.0;
+    return std::max(static_cast<double>(view.width())/static_cast<double>(width),
+                    static_cast<double>(view.height())/static_cast<double>(height));
+}
+
 void viewer::keyPressEvent(QKeyEvent *event){
     bool known = true;
     bool needRender = true;
     bool moveOnPlane = false;
-    unsigned char direction = 0;
-    unsigned nPixels = 0;
 
-    const unsigned dPixels = 10;
+    const unsigned dPixels = keyStepPixels;
     const double d = static_cast<double>(dPixels)*pixelSize;
     const double d3D = static_cast<double>(dPixels)*pixelSize3D;
     const double dangle3D = 0.1;
@@ -660,6 +843,7 @@ void viewer::keyPressEvent(QKeyEvent *event){
                 if(theta < 0.1)
                     theta = 0.1;
                 update3Ddirections();
+                moveOnPlane = true; //Reproject the current frame
                 break;
             }
         case Qt::Key_W:
@@ -669,17 +853,17 @@ void viewer::keyPressEvent(QKeyEvent *event){
                 z += d;
             else if(perspective == 2)
                 y += d;
+            else if(perspective == 3 && ortho3D){
+                //Move the view up
+                pan3D(0.0, d3D);
+            }
             else if(perspective == 3){ //3D
                 //Movement look at point Up
                 z += d3D;
                 update3Ddirections();
             }
 
-            if(perspective != 3){ //not 3D
-                moveOnPlane = true; //Adaptative render
-                direction = 2; //Up
-                nPixels = dPixels; //Move 10 pixels
-            }
+            moveOnPlane = true; //Adaptative render, 3D views are reprojected
 
             break;
         case Qt::Key_Down:
@@ -690,6 +874,7 @@ void viewer::keyPressEvent(QKeyEvent *event){
                     theta = 3.141592653589793-0.1;
                 }
                 update3Ddirections();
+                moveOnPlane = true; //Reproject the current frame
                 break;
             }
         case Qt::Key_S:
@@ -699,17 +884,17 @@ void viewer::keyPressEvent(QKeyEvent *event){
                 z -= d;
             else if(perspective == 2)
                 y -= d;
+            else if(perspective == 3 && ortho3D){
+                //Move the view down
+                pan3D(0.0, -d3D);
+            }
             else if(perspective == 3){
                 //Movement look at point Down
                 z -= d3D;
                 update3Ddirections();
             }
 
-            if(perspective != 3){ //not 3D
-                moveOnPlane = true; //Adaptative render
-                direction = 3; //Down
-                nPixels = dPixels; //Move 10 pixels
-            }
+            moveOnPlane = true; //Adaptative render, 3D views are reprojected
 
             break;
         case Qt::Key_Left:
@@ -720,6 +905,7 @@ void viewer::keyPressEvent(QKeyEvent *event){
                     phi -= 6.283185307179586;
                 }
                 update3Ddirections();
+                moveOnPlane = true; //Reproject the current frame
                 break;
             }
         case Qt::Key_A:
@@ -729,17 +915,17 @@ void viewer::keyPressEvent(QKeyEvent *event){
                 x -= d;
             else if(perspective == 2)
                 x -= d;
+            else if(perspective == 3 && ortho3D){
+                //Move the view left
+                pan3D(-d3D, 0.0);
+            }
             else if(perspective == 3){
                 //Movement look at point Left
                 y -= d3D;
                 update3Ddirections();
             }
 
-            if(perspective != 3){ //not 3D
-                moveOnPlane = true; //Adaptative render
-                direction = 0; //Left
-                nPixels = dPixels; //Move 10 pixels
-            }
+            moveOnPlane = true; //Adaptative render, 3D views are reprojected
 
             break;
         case Qt::Key_Right:
@@ -750,6 +936,7 @@ void viewer::keyPressEvent(QKeyEvent *event){
                 phi += 6.283185307179586;
             }
             update3Ddirections();
+            moveOnPlane = true; //Reproject the current frame
             break;
         }
         case Qt::Key_D:
@@ -759,17 +946,17 @@ void viewer::keyPressEvent(QKeyEvent *event){
                 x += d;
             else if(perspective == 2)
                 x += d;
+            else if(perspective == 3 && ortho3D){
+                //Move the view right
+                pan3D(d3D, 0.0);
+            }
             else if(perspective == 3){
                 //Movement look at point Right
                 y += d3D;
                 update3Ddirections();
             }
 
-            if(perspective != 3){ //not 3D
-                moveOnPlane = true; //Adaptative render
-                direction = 1; //Right
-                nPixels = dPixels; //Move 10 pixels
-            }
+            moveOnPlane = true; //Adaptative render, 3D views are reprojected
             break;
         case Qt::Key_F: //Forward
             if(perspective == 0)
@@ -785,6 +972,7 @@ void viewer::keyPressEvent(QKeyEvent *event){
                     rho = 1.0;
                 }
                 update3Ddirections();
+                moveOnPlane = true; //Reproject the current frame
             }
             break;
         case Qt::Key_B: //Backward
@@ -798,43 +986,57 @@ void viewer::keyPressEvent(QKeyEvent *event){
                 //Increase radius
                 rho += d3D;
                 update3Ddirections();
+                moveOnPlane = true; //Reproject the current frame
             }
             break;
         case Qt::Key_Plus: // zoom in
             if(perspective == 3){ //3D
-                known = false;
-                emit zoomIn3D();
+                pixelSize3D *= 0.9;
+                if(pixelSize3D < 0.00001)
+                    pixelSize3D = 0.00001;
+                moveOnPlane = ortho3D; //Resample orthographic views
             }else{
                 pixelSize *= 0.9;
                 if(pixelSize < 0.00001)
                     pixelSize = 0.00001;
+                moveOnPlane = true; //Resample the current frame
             }
             break;
         case Qt::Key_Minus:  // zoom out
             if(perspective == 3){ //3D
-                known = false;
-                emit zoomOut3D();
+                pixelSize3D *= 1.1;
+                moveOnPlane = ortho3D; //Resample orthographic views
             }else{
                 pixelSize *= 1.1;
+                moveOnPlane = true; //Resample the current frame
             }
             break;
         case Qt::Key_X: //Change perspective to X
             if(perspective == 0)
                 known = false;
-            else
-                perspective = 0;
+            else{
+                //Also clears the orthographic mode, as the selector does
+                setPerspective(0);
+                needRender = false;
+            }
             break;
         case Qt::Key_Y: //Change perspective to Y
             if(perspective == 1)
                 known = false;
-            else
-                perspective = 1;
+            else{
+                //Also clears the orthographic mode, as the selector does
+                setPerspective(1);
+                needRender = false;
+            }
             break;
         case Qt::Key_Z: //Change perspective to Z
             if(perspective == 2)
                 known = false;
-            else
-                perspective = 2;
+            else{
+                //Also clears the orthographic mode, as the selector does
+                setPerspective(2);
+                needRender = false;
+            }
             break;
         case Qt::Key_M: //Change between material and body view
             matView = !matView;
@@ -847,7 +1049,7 @@ void viewer::keyPressEvent(QKeyEvent *event){
     }
     if(known){
         if(needRender)
-            render(moveOnPlane,direction,nPixels);
+            render(moveOnPlane);
         emit changed(this);
     }
 }
@@ -6,16 +6,52 @@
 #include <algorithm>
 #include <vector>
 #include <array>
+#include <functional>
 #include <QWidget>
-#include <QLabel>
 #include <QLayout>
 #include <QImage>
 #include <QColor>
 #include <QPushButton>
 #include <QKeyEvent>
+#include <QMouseEvent>
+#include <QWheelEvent>
 #include <QPainter>
 
 #include "pen_geoViewInterface.hh"
+#include "renderframe.h"
+#include "colormap.h"
+#include "renderworker.h"
+#include "frameprofiler.h"
+
+//Widget which displays the viewer image scaled to cover its whole area,
+//with the axes of 2D perspectives drawn over it. The image is scaled by the
+//painter transform, so no scaled copies are created on frames or resizes.
+//It reports the duration of its repaints and draws an optional text overlay
+class frameView : public QWidget
+{
+
+public:
+
+    //Called after each repaint with its start and end, in the profiler clock
+    std::function<void(long long, long long)> painted;
+
+    //Text drawn over the image, none if empty
+    QString overlay;
+
+    //Displayed image, shared with the viewer
+    QImage image;
+
+    //Axes to draw, none for 3D (3)
+    unsigned perspective = 0;
+
+    explicit frameView(QWidget *parent = nullptr) : QWidget(parent) {}
+
+    //Image to widget scale factor
+    double scale() const;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+};
 
 class viewer : public QWidget
 {
@@ -23,36 +59,46 @@ class viewer : public QWidget
 
 public:
 
-    static const size_t nColors = 200;
-    static const size_t nColorsPos = nColors*3;
+    static const size_t nColors = colorMap::nColors;
+    static const size_t nColorsPos = colorMap::nColorsPos;
     static std::array<unsigned char, nColorsPos> colors;
 
+    //Body names of the loaded geometry, shared by all viewers
+    static std::vector<QString> bodyNames;
+    //Bytes per body label of the rendered frames, chosen from the number of bodies
+    static unsigned labelBytes;
+
     static const size_t maxWidth = 2000;
     static const size_t maxHeight = 2000;
     static constexpr size_t maxPixels = maxWidth*maxHeight;
 
+    //Perspective angle used for 3D renders
+    static constexpr double perspective3DAngle = 0.3490658503988659;
+
+    //Pixels moved on each key press
+    static const unsigned keyStepPixels = 10;
+
+    //Labels shown on each page of the key, and per row
+    static const unsigned keyPageSize = 150;
+    static const unsigned keyColumns = 3;
+
 private:
 
     static constexpr double rot3Dtheta = 5.0;
     static constexpr double ctheta = 0.9961946980917455;
     static constexpr double stheta = 0.08715574274765817;
 
-    std::vector<uchar>& buffer;
-    std::vector<unsigned char>& matImage;
-    std::vector<unsigned int>& bodyImage;
-    std::vector<float>& distances;
-    float minD, maxD;
+    std::vector<uint32_t> buffer; //Colors of the displayed frame, allocated on demand
+    renderFramePtr frame; //Displayed frame
 
     unsigned int imageWidth;    //2D
     unsigned int imageHeight;   //2D
     unsigned int image3DWidth;  //3D
     unsigned int image3DHeight; //3D
     QImage image;
-    QLabel label;
-    QPixmap pixMap;
+    frameView view;
 
     double x, y, z;
-    double xlast, ylast, zlast; //Last x,y,z values
     //3D camera position perspective
     double camera3DX, camera3DY, camera3DZ;
     //3D direction vector between look at point and position
@@ -64,49 +110,109 @@ private:
     //Save last render phi angle (3D only)
     float lastRender3DPhi;
 
+    //Mouse drag state (2D only)
+    bool dragging;
+    QPoint lastDragPosition;
+    double dragResidualX, dragResidualY; //Image pixels not applied yet
+
     unsigned perspective; // x,y,z,3d -> 0,1,2,3
+    bool ortho3D;     //True -> Orthographic 3D view, False -> Perspective 3D view
     bool matView;     //True -> Material view, False -> Body view
+    bool exactRender; //True -> Render all pixels, False -> Adaptive render
+    bool progressiveRender; //True -> Show coarse previews before the final frame
+    unsigned prefetchPlanes; //Planes prefetched on each side of the displayed slice
     double pixelSize; //in cm
     double pixelSize3D; //in cm
 
     const pen_geoViewInterface* pPenRedViewer;
 
+    tileScheduler* scheduler; //Pool for 2D renders and colorization, the shared one if null
+
     QString keyText; //HTML text with key table
 
+    //Labels found in the displayed frame
+    labelSet visibleLabels;
+
+    //Labels, view type and page of the key, rebuilt only when they change
+    static unsigned long long nKeys;
+    labelSet keyVisible;
+    bool keyMatView;
+    bool keyValid;
+    unsigned long long keyVersion; //Unique identifier of the key text
+    unsigned keyPage;      //Requested page
+    unsigned keyPageShown; //Page in the key text
+
+    void updateKey();
+    void reserveBuffer(const size_t nPixels);
+
     bool geometryLoaded;
 
-    unsigned nthreads;
+    renderWorker worker;
+    //Incremented when the buffers are released, frames requested
+    //before are discarded when they arrive
+    unsigned long long generation;
+
+    //Frame timing
+    static unsigned nProfileIds;
+    const unsigned profileId; //Identifier in the frame profiler
+    frameTiming timing;       //Stages of the frame being displayed
+    bool timingPending;       //The frame has not been repainted yet
+    long long lastSubmit;     //Last request submission, in the profiler clock
+    long long lastRepaint;    //Duration of the last timed repaint
+    bool showTimings;         //Draw the timings over the image
+
+    void beginTiming();
+    void finishTiming(const long long paintStart, const long long paintEnd);
+    void updateOverlay();
 
     void update3Ddirections();
+    void pan3D(const double dh, const double dv);
+    renderRequest createRequest() const;
+    double displayScale() const;
 
 protected:
     void mousePressEvent(QMouseEvent* event);
+    void mouseMoveEvent(QMouseEvent* event);
+    void mouseReleaseEvent(QMouseEvent* event);
+    void wheelEvent(QWheelEvent* event);
     void keyPressEvent(QKeyEvent *event);
 
 public:
 
-    explicit viewer(std::vector<uchar>& bufferIn,
-                    std::vector<unsigned char>& matImageIn,
-                    std::vector<unsigned int>& bodyImage,
-                    std::vector<float>& distancesIn,
-                    QWidget *parent = nullptr);
+    explicit viewer(QWidget *parent = nullptr);
 
     static std::array<unsigned char, viewer::nColorsPos> defaultColors();
     static void resetColors();
 
+    //Caches the body names and the label size of the geometry,
+    //to be called on geometry loads
+    static void loadBodyNames(const pen_geoViewInterface* p);
+
     void copy(const viewer& viewer2copy);
 
-    void render(bool moveOnPlane = false, unsigned char direction = 0, unsigned nPixels = 0);
+    void render(bool moveOnPlane = false);
     void resizeImage();
     void updateMatView();
+
+    //Frees the frames and buffers of the viewer, e.g. when it is deleted.
+    //They are allocated again by the next render
+    void releaseBuffers();
     std::vector<geoError> test() const;
 
+    //Request of the displayed 2D slice with 'scale' times its resolution
+    //and the same extent, to be rendered by 'posterRenderer'
+    renderRequest createPosterRequest(const unsigned scale) const;
+
     //Getter functions
     constexpr const QImage& readImage() const {return image;}
 
     constexpr unsigned readImageWidth() const {return imageWidth;}
     constexpr unsigned readImageHeight() const {return imageHeight;}
 
+    constexpr unsigned readImage3DWidth() const {return image3DWidth;}
+    constexpr unsigned readImage3DHeight() const {return image3DHeight;}
+    constexpr double readPixelSize3D() const {return pixelSize3D;}
+
     constexpr double readX() const {return x;}
     constexpr double readY() const {return y;}
     constexpr double readZ() const {return z;}
@@ -124,10 +230,30 @@ public:
     constexpr double readW() const {return w;}
 
     constexpr unsigned readPerspective() const {return perspective;}
+    constexpr bool readOrtho3D() const {return ortho3D;}
     constexpr bool readMatView() const {return matView;}
+    constexpr bool readExactRender() const {return exactRender;}
+    constexpr bool readProgressiveRender() const {return progressiveRender;}
+    constexpr unsigned readPrefetchPlanes() const {return prefetchPlanes;}
     constexpr double readPixelSize() const {return pixelSize;}
 
     constexpr const QString& readKeyText() const {return keyText;}
+    constexpr unsigned long long readKeyVersion() const {return keyVersion;}
+    constexpr unsigned readKeyPage() const {return keyPageShown;}
+    unsigned readKeyPages() const;
+    inline size_t readVisibleLabels() const {return visibleLabels.size();}
+
+    constexpr unsigned readProfileId() const {return profileId;}
+    constexpr bool readShowTimings() const {return showTimings;}
+
+    //Render profiling counters
+    inline unsigned long long readRenderedFrames() const {return worker.readRenderedFrames();}
+    inline unsigned long long readDroppedFrames() const {return worker.readDroppedFrames();}
+    inline unsigned long long readCancelledFrames() const {return worker.readCancelledFrames();}
+    inline unsigned long long readPrefetchedFrames() const {return worker.readPrefetchedFrames();}
+
+    //Bytes allocated by the viewer frames and buffers
+    size_t readMemoryUsage() const;
 
     //Setter functions
 
@@ -136,6 +262,12 @@ public:
     void setImageWidth(unsigned width);
     void setImageHeight(unsigned height);
 
+    //The 3D resolution is owned by each viewer and sent with its render
+    //requests, so changing it only renders this viewer again
+    void setImage3DWidth(unsigned width);
+    void setImage3DHeight(unsigned height);
+    void setPixelSize3D(double newPixelSize);
+
     void setX(double newX);
     void setY(double newY);
     void setZ(double newZ);
@@ -144,22 +276,34 @@ public:
     void setTheta(double newTheta);
     void setPhi(double newPhi);
 
+    //Perspective selector index, x,y,z,3d,3d ortho -> 0,1,2,3,4. Used by
+    //both the selector and the perspective keys
     void setPerspective(unsigned index);
     void setMatView(bool enabled);
+    void setExactRender(bool enabled);
+    void setProgressiveRender(bool enabled);
+    void setPrefetchPlanes(unsigned planes);
     void setPixelSize(double newPixelSize);
-
-    void update3D(unsigned width, unsigned height, double pixSize);
+    void setScheduler(tileScheduler* newScheduler);
+    void setShowTimings(bool enabled);
+    void setKeyPage(unsigned page);
 
 public slots:
     void resizeEvent(QResizeEvent *);
 
     void geometryLoad();
 
+    //Stops the renders of the viewer until the next geometry load,
+    //to be called before the geometry library is reloaded
+    void geometryUnload();
+
+private slots:
+    void on_frameReady(renderFramePtr newFrame, unsigned long long requestGeneration);
+
 signals:
     void clicked(viewer*);
     void changed(viewer*);
-    void zoomIn3D();
-    void zoomOut3D();
+    void rendered(viewer*);
 };
 
 #endif // VIEWER_H